@@ -0,0 +1,54 @@
+#ifndef UDP_GAME_CAPTURE_H
+#define UDP_GAME_CAPTURE_H
+
+#include "../include/metrics.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#define CAPTURE_MAGIC "UGCP"
+#define CAPTURE_MAGIC_SIZE 4
+#define CAPTURE_VERSION 1
+#define CAPTURE_FILE_HEADER_SIZE (CAPTURE_MAGIC_SIZE + sizeof(uint32_t))
+#define CAPTURE_ADDRESS_SIZE 16    // Large enough for an IPv6 address, IPv4 uses the first 4 bytes
+#define CAPTURE_RECORD_HEADER_SIZE (sizeof(uint64_t) + sizeof(uint16_t) + sizeof(uint16_t) + CAPTURE_ADDRESS_SIZE + sizeof(uint32_t))
+#define CAPTURE_STREAM_BUFFER_SIZE (1 << 20)
+
+// One captured datagram, the payload follows the record header in the file
+struct capture_record
+{
+    uint64_t                timestamp_ns;    // Time since the capture started
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;
+    uint32_t                length;
+};
+
+struct capture_writer
+{
+    FILE           *file;
+    struct timespec start;
+    uint64_t        records;
+    uint64_t        bytes;
+};
+
+struct capture_reader
+{
+    FILE    *file;
+    uint64_t records;
+};
+
+void capture_writer_open(const struct p101_env *env, struct p101_error *err, struct capture_writer *writer, const char *path);
+bool capture_write(const struct p101_env *env, struct capture_writer *writer, const struct sockaddr *addr, const uint8_t *data, size_t length);
+void capture_writer_close(const struct p101_env *env, struct capture_writer *writer);
+void capture_reader_open(const struct p101_env *env, struct p101_error *err, struct capture_reader *reader, const char *path);
+bool capture_read(const struct p101_env *env, struct p101_error *err, struct capture_reader *reader, struct capture_record *record, uint8_t *payload, size_t capacity);
+void capture_reader_close(const struct p101_env *env, struct capture_reader *reader);
+
+#endif    // UDP_GAME_CAPTURE_H
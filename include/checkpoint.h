@@ -0,0 +1,64 @@
+#ifndef UDP_GAME_CHECKPOINT_H
+#define UDP_GAME_CHECKPOINT_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/structs.h"
+#include <fcntl.h>
+#include <p101_env/env.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CHECKPOINT_MAGIC 0x55474B50U    // "UGKP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_SYNC_INTERVAL_NS (NANOSECONDS_PER_SECOND / 2)
+
+// One clients[] slot. The network thread writes these in place as players join and leave, the thread
+// simulating the room as their moves are accepted.
+struct checkpoint_entry
+{
+    _Atomic uint32_t   active;     // Stored with release once the rest of the entry is written, loaded with acquire on restore
+    uint32_t           room_id;    // Room id as the client sent it, slots are handed out again on restore
+    uint32_t           address;    // IPv4 address in network byte order
+    uint16_t           port;       // Network byte order
+    uint16_t           reserved;
+    struct coordinates coordinates;
+};
+
+// The whole file. It is stored in native byte order and only read back by the same build,
+// the version and layout sizes in the header turn any mismatch into a fresh start.
+struct checkpoint_region
+{
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                entry_count;
+    uint32_t                entry_size;
+    uint64_t                generation;    // Incremented every time the region is flushed to disk
+    uint64_t                saved_at;      // CLOCK_REALTIME seconds of the last flush
+    struct checkpoint_entry entries[MAX_CLIENTS];
+};
+
+struct checkpoint
+{
+    int                       fd;
+    struct checkpoint_region *region;
+    struct timespec           last_sync;
+    bool                      restored;    // The file held a valid region from an earlier run
+};
+
+void checkpoint_open(const struct p101_env *env, struct p101_error *err, struct checkpoint *checkpoint, const char *path);
+void checkpoint_record_join(const struct p101_env *env, struct checkpoint *checkpoint, int client_index, const struct sockaddr_in *addr, uint32_t room_id, const struct coordinates *coordinates);
+void checkpoint_record_move(const struct p101_env *env, struct checkpoint *checkpoint, int client_index, const struct coordinates *coordinates);
+void checkpoint_record_leave(const struct p101_env *env, struct checkpoint *checkpoint, int client_index);
+void checkpoint_sync(const struct p101_env *env, struct checkpoint *checkpoint);
+void checkpoint_close(const struct p101_env *env, struct checkpoint *checkpoint);
+
+#endif    // UDP_GAME_CHECKPOINT_H
@@ -0,0 +1,50 @@
+#ifndef UDP_GAME_CLOCK_SYNC_H
+#define UDP_GAME_CLOCK_SYNC_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/structs.h"
+#include <inttypes.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#define CLOCK_SYNC_SAMPLES 8                   // Pongs the offset is picked from, the one with the shortest round trip wins
+#define CLOCK_PING_INTERVAL_US 1000000         // Between pings once the clock is synchronized
+#define CLOCK_FIRST_PING_INTERVAL_US 200000    // Between pings until the first pong arrives
+
+// One ping answered: how long it took and where the server's clock stood against ours
+struct clock_sample
+{
+    int64_t rtt_us;
+    int64_t offset_us;    // Server time minus ours
+};
+
+// A client's estimate of the server clock. Every ping is answered with the server's time, and the offset
+// is taken from the sample that spent the least time on the wire, since queueing only ever adds delay
+// and adds it unevenly to the two directions.
+struct clock_sync
+{
+    struct clock_sample samples[CLOCK_SYNC_SAMPLES];
+    uint32_t            sample_count;
+    uint32_t            next_sample;
+    int64_t             rtt_us;           // Smoothed round trip time
+    int64_t             offset_us;        // Server time minus ours, from the best sample kept
+    uint32_t            ping_sequence;    // Of the ping still waiting for its pong
+    int64_t             ping_sent_us;     // 0 when no ping is outstanding
+    int64_t             last_ping_us;
+    bool                synced;
+};
+
+int64_t clock_now_us(void);
+void    clock_sync_reset(struct clock_sync *sync);
+bool    clock_sync_ping_due(const struct clock_sync *sync, int64_t now_us);
+void    clock_sync_write_ping(const struct p101_env *env, struct clock_sync *sync, const struct packet_header *header, const struct coordinates *coordinates, int64_t now_us, uint8_t *buffer);
+bool    clock_sync_read_pong(const struct p101_env *env, struct clock_sync *sync, const uint8_t *packet, int64_t now_us);
+int64_t clock_sync_view_time(const struct clock_sync *sync, int64_t now_us);
+void    clock_write_pong(const struct p101_env *env, const struct packet_header *header, int64_t now_us, uint8_t *buffer);
+bool    is_ping(const struct coordinates *coordinates);
+
+#endif    // UDP_GAME_CLOCK_SYNC_H
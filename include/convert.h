@@ -2,11 +2,13 @@
 #define UDP_GAME_ARGUMENTS_H
 
 #define BASE_TEN 10
+#define DSCP_MAX 63
 
 #include "../include/structs.h"
 #include <arpa/inet.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <p101_c/p101_string.h>
 #include <p101_posix/p101_string.h>
 #include <p101_unix/p101_getopt.h>
@@ -17,7 +19,10 @@
 
 void      convert_client_args(const struct p101_env *env, struct p101_error *err, struct context *context);
 void      convert_server_args(const struct p101_env *env, struct p101_error *err, struct context *context);
+void      convert_group_args(const struct p101_env *env, struct p101_error *err, struct context *context);
+void      convert_socket_options(const struct p101_env *env, struct p101_error *err, struct context *context);
 in_port_t parse_in_port_t(const struct p101_env *env, struct p101_error *err, const char *port_str);
+int       parse_int_option(const struct p101_env *env, struct p101_error *err, const char *value_str, int max);
 void      convert_address(const struct p101_env *env, struct p101_error *err, const char *ip_address, struct sockaddr_storage *addr, socklen_t *addr_len);
 void      get_address_to_server(const struct p101_env *env, struct p101_error *err, struct sockaddr_storage *addr, in_port_t port);
 
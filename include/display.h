@@ -1,9 +1,34 @@
 #ifndef UDP_GAME_DISPLAY_H
 #define UDP_GAME_DISPLAY_H
 
+#include "../include/network.h"
 #include "../include/structs.h"
 #include <ncurses.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VIEWPORT_MAX_CELLS 256         // Other players the client remembers, far more than fit in a room's view
+#define VIEWPORT_SCROLL_MARGIN_X 10    // The window scrolls once the player gets this close to its left or right border
+#define VIEWPORT_SCROLL_MARGIN_Y 5
+
+// The part of the world the window shows. origin is the world cell drawn at the window's top left
+// inner corner, cells holds where the other players the server told us about stand.
+struct viewport
+{
+    uint32_t           columns;    // Inner size, the border excluded
+    uint32_t           rows;
+    uint32_t           origin_x;
+    uint32_t           origin_y;
+    uint32_t           cell_count;
+    struct coordinates cells[VIEWPORT_MAX_CELLS];    // Only new_x and new_y are used
+};
 
 void setup_window(WINDOW *w, const struct coordinates *coordinates, const char *player);
+void viewport_init(struct viewport *view, uint32_t columns, uint32_t rows);
+bool viewport_follow(struct viewport *view, uint32_t x, uint32_t y);
+void viewport_center(struct viewport *view, uint32_t x, uint32_t y);
+void viewport_apply(struct viewport *view, const struct coordinates *coordinates);
+void viewport_forget_distant(struct viewport *view, uint32_t x, uint32_t y);
+void viewport_draw(WINDOW *w, const struct viewport *view, const struct coordinates *coordinates, const char *player);
 
 #endif    // UDP_GAME_DISPLAY_H
@@ -0,0 +1,110 @@
+#ifndef UDP_GAME_GAME_SERVER_H
+#define UDP_GAME_GAME_SERVER_H
+
+#include "../include/capture.h"
+#include "../include/checkpoint.h"
+#include "../include/clock_sync.h"
+#include "../include/convert.h"
+#include "../include/io_backend.h"
+#include "../include/join_cookie.h"
+#include "../include/metrics.h"
+#include "../include/move_limiter.h"
+#include "../include/network.h"
+#include "../include/packet_pool.h"
+#include "../include/position_history.h"
+#include "../include/priority_accumulator.h"
+#include "../include/room.h"
+#include "../include/room_worker.h"
+#include "../include/send_queue.h"
+#include "../include/send_rate.h"
+#include "../include/send_worker.h"
+#include "../include/zone.h"
+#include <p101_env/env.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CLIENT_INDEX_BITS 11
+#define CLIENT_INDEX_SIZE (1 << CLIENT_INDEX_BITS)    // Twice MAX_CLIENTS so probe chains stay short
+#define CLIENT_INDEX_EMPTY (-1)
+
+// Recipients one sender thread still has packets queued for, each listed once
+struct send_backlog
+{
+    int      clients[MAX_CLIENTS];
+    uint32_t count;
+    bool     listed[MAX_CLIENTS];
+};
+
+// Everything the game logic needs, independent of whether datagrams come from a socket or a capture file.
+// The network thread owns the address index, sequence trackers and room admission; each room's members,
+// coordinates and send queues belong to the thread simulating that room (the network thread when there are no workers).
+// With a send stage each room worker hands its encoded packets to its own sender thread, which then owns those clients' queues.
+// In a cluster the network thread also hands players to the zone that owns their position and talks to the other zones.
+// Position histories go with the coordinates, so a move can be judged against the world its sender saw.
+// With a snapshot budget each member's priority accumulator also belongs to its room's thread, which sends
+// what the accumulators owe once a tick. With adapted rates the thread also keeps each member's send rate,
+// which decides how often and how much of that the member gets.
+struct server_state
+{
+    struct io_backend           backend;
+    struct client_info          clients[MAX_CLIENTS];
+    struct send_queue           queues[MAX_CLIENTS];
+    struct sequence_tracker     sequences[MAX_CLIENTS];
+    struct position_history     histories[MAX_CLIENTS];
+    struct priority_accumulator accumulators[MAX_CLIENTS];           // Updates each viewer is owed when snapshots are budgeted
+    struct send_rate            rates[MAX_CLIENTS];                  // How often and how much each viewer is sent when rates are adapted
+    atomic_bool                 client_active[MAX_CLIENTS];          // Set on join, cleared by the room's thread once the leave is done
+    int                         address_index[CLIENT_INDEX_SIZE];    // Open addressing table from source address to clients[] slot
+    struct room_table           rooms;
+    struct staged_worker        workers[MAX_ROOM_WORKERS];     // Fed room_events by the network thread
+    uint32_t                    worker_count;
+    struct staged_worker        senders[MAX_ROOM_WORKERS];     // Fed send_jobs, paired with workers[] by index when the send stage is enabled
+    struct send_backlog         backlogs[MAX_ROOM_WORKERS];    // Each owned by the sender of the same index
+    uint32_t                    sender_count;
+    uint32_t                    flush_cursor[MAX_ROOM_WORKERS];
+    uint64_t                    blocked_moves[MAX_ROOM_WORKERS];        // Per simulating thread, so counting needs no atomics
+    uint64_t                    compensated_moves[MAX_ROOM_WORKERS];    // Onto a cell the mover could not yet have seen taken, let through
+    struct send_queue           group_queues[MAX_ROOM_WORKERS];         // Snapshots for the multicast group, one per thread that sends for rooms
+    struct send_queue           control_queue;                          // Network thread only, pongs, challenges and zone messages on their way out
+    struct sockaddr_storage     group_addr;                             // Spectators' multicast group
+    socklen_t                   group_addr_len;                         // 0 when room snapshots are only unicast to players
+    struct packet_pool          pool;
+    struct receive_stats        stats;
+    struct rate_limiter         join_warning;
+    struct move_limiter         limiter;    // Per client move rate, off unless move_limiter_init was given one
+    struct snapshot_stats       snapshot_stats[MAX_ROOM_WORKERS];
+    int64_t                     next_snapshot_ns[MAX_ROOM_WORKERS];
+    bool                        snapshots_waiting[MAX_ROOM_WORKERS];    // Some viewer in the thread's rooms is still owed updates
+    uint32_t                    snapshot_budget;                        // Bytes per client per tick, 0 sends every move as it happens
+    struct send_rate_limits     rate_limits;                            // Off unless send_rate_limits_init was given an interval
+    struct send_rate_stats      rate_stats[MAX_ROOM_WORKERS];
+    uint64_t                    rejected_joins;
+    uint64_t                    pings_answered;
+    uint64_t                    stamped_moves;     // Moves that said what time the client saw
+    uint64_t                    clamped_stamps;    // Stamps in the future or too far back to rewind to
+    int64_t                     view_lag_us;       // Total of receive time minus stamp, over stamped moves
+    struct zone_cluster         cluster;           // Empty unless this server owns one zone of a larger world
+    struct capture_writer      *capture;           // Records every inbound datagram when not NULL
+    struct checkpoint          *checkpoint;        // Mirrors the client registry into a mapped file when not NULL
+    struct join_cookies        *cookies;           // New addresses must echo a cookie before they get a slot when not NULL
+    bool                        verbose;           // Print every datagram as it is handled
+    bool                        collisions;        // Refuse moves onto a cell another player in the room stands on
+};
+
+void     game_server_init(const struct p101_env *env, struct p101_error *err, struct server_state *server, uint32_t workers, bool senders);
+void     game_server_restore(const struct p101_env *env, struct server_state *server);
+uint8_t *game_server_snapshot(const struct p101_env *env, const struct server_state *server, size_t *length);
+void     game_server_adopt(const struct p101_env *env, struct server_state *server, const uint8_t *snapshot, size_t length);
+void     game_server_stop(const struct p101_env *env, struct server_state *server);
+void     game_server_destroy(const struct p101_env *env, struct server_state *server);
+void     game_server_handle_datagram(const struct p101_env *env, struct p101_error *err, void *arg, const struct sockaddr *addr, const uint8_t *data, size_t length, const struct receive_metadata *metadata);
+bool     game_server_has_pending_sends(const struct p101_env *env, const struct server_state *server);
+int      game_server_timeout_ms(const struct p101_env *env, const struct server_state *server);
+void     game_server_flush(const struct p101_env *env, struct server_state *server);
+void     game_server_drain(const struct p101_env *env, struct p101_error *err, struct server_state *server);
+void     game_server_print_stats(const struct p101_env *env, const struct server_state *server, bool timestamps);
+
+#endif    // UDP_GAME_GAME_SERVER_H
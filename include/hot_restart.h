@@ -0,0 +1,49 @@
+#ifndef UDP_GAME_HOT_RESTART_H
+#define UDP_GAME_HOT_RESTART_H
+
+#include "../include/metrics.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <p101_env/env.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HOT_RESTART_MAGIC 0x55474852U    // "UGHR"
+#define HOT_RESTART_VERSION 1
+#define HOT_RESTART_HEADER_SIZE (3 * sizeof(uint32_t))    // Magic, version, snapshot length
+#define HOT_RESTART_MAX_SNAPSHOT (1 << 24)
+#define HOT_RESTART_WAKE_INTERVAL_NS (NANOSECONDS_PER_SECOND / 20)
+
+// Both ends of an upgrade. A new server first tries to take the socket and snapshot from whoever
+// listens on path, then listens there itself so the next binary can take over from it.
+struct hot_restart
+{
+    const char *path;
+    int         listen_fd;
+    _Atomic int successor_fd;    // Set by the accept thread once a new server has connected
+    atomic_bool acknowledged;    // Set by the main thread once it has seen the request
+    pthread_t   thread;
+    pthread_t   main_thread;
+    bool        thread_started;
+    uint8_t    *snapshot;    // Game state from the predecessor, NULL on a fresh start
+    size_t      snapshot_length;
+};
+
+void hot_restart_init(const struct p101_env *env, struct hot_restart *restart, const char *path);
+bool hot_restart_inherit(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart, int *sockfd);
+void hot_restart_listen(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart);
+bool hot_restart_requested(const struct p101_env *env, struct hot_restart *restart);
+void hot_restart_hand_over(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart, int sockfd, const uint8_t *snapshot, size_t length);
+void hot_restart_close(const struct p101_env *env, struct hot_restart *restart);
+
+#endif    // UDP_GAME_HOT_RESTART_H
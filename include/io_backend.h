@@ -0,0 +1,61 @@
+#ifndef UDP_GAME_IO_BACKEND_H
+#define UDP_GAME_IO_BACKEND_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/packet_pool.h"
+#include "../include/send_queue.h"
+#include "../include/udp_offload.h"
+#include <errno.h>
+#include <p101_env/env.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define IO_RECEIVE_BATCH_SIZE 64    // Datagrams handled per wakeup before queued sends get a turn
+#define IO_WAIT_FOREVER (-1)        // wait timeout for a server with nothing scheduled
+
+enum io_backend_kind
+{
+    IO_BACKEND_SYSCALL,
+    IO_BACKEND_URING
+};
+
+typedef void (*io_receive_handler)(const struct p101_env *env, struct p101_error *err, void *arg, const struct sockaddr *addr, const uint8_t *data, size_t length, const struct receive_metadata *metadata);
+
+struct io_backend;
+
+// The server only talks to the network through these, so the syscall, io_uring and in-memory paths are interchangeable
+struct io_backend_ops
+{
+    const char *name;
+    void (*wait)(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+    void (*receive)(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+    enum send_queue_status (*flush)(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+    void (*destroy)(const struct p101_env *env, struct io_backend *backend);
+    void (*quiesce)(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);    // NULL if the backend never reads ahead of receive
+    bool (*settle)(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg, int timeout_ms);    // NULL if sends are done when flush returns
+};
+
+struct io_backend
+{
+    const struct io_backend_ops *ops;
+    int                          sockfd;
+    struct packet_pool          *pool;
+    struct udp_offload           offload;
+    uint8_t                     *gro_buffer;
+    bool                         readable;
+    void                        *state;    // Backend private data
+};
+
+void                   io_backend_create(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, enum io_backend_kind kind, int sockfd, struct packet_pool *pool, bool offload);
+void                   io_backend_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+void                   io_backend_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+enum send_queue_status io_backend_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+bool                   io_backend_settle(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg, int timeout_ms);
+void                   io_backend_quiesce(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+void                   io_backend_destroy(const struct p101_env *env, struct io_backend *backend);
+bool                   io_uring_backend_init(const struct p101_env *env, struct io_backend *backend);
+
+#endif    // UDP_GAME_IO_BACKEND_H
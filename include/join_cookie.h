@@ -0,0 +1,33 @@
+#ifndef UDP_GAME_JOIN_COOKIE_H
+#define UDP_GAME_JOIN_COOKIE_H
+
+#include "../include/network.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOIN_COOKIE_BUCKET_SECONDS 8    // A cookie is accepted in the bucket it was issued in and the next one
+
+// Stateless proof that a new client receives at the address it sends from. A cookie is a keyed
+// SipHash-2-4 of the address, port and time bucket, so nothing is stored until it comes back valid.
+struct join_cookies
+{
+    uint64_t key[2];    // Random per process, cookies do not outlive the server that issued them
+    uint64_t challenges;
+    uint64_t accepted;
+    uint64_t rejected;
+};
+
+void join_cookies_init(const struct p101_env *env, struct p101_error *err, struct join_cookies *cookies);
+void join_cookie_write_challenge(const struct p101_env *env, struct join_cookies *cookies, const struct sockaddr_in *client, const struct packet_header *header, uint8_t *buffer);
+bool join_cookie_verify(const struct p101_env *env, struct join_cookies *cookies, const struct sockaddr_in *client, const uint8_t *cookie);
+void join_cookies_print_stats(const struct p101_env *env, const struct join_cookies *cookies);
+
+#endif    // UDP_GAME_JOIN_COOKIE_H
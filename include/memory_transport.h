@@ -0,0 +1,80 @@
+#ifndef UDP_GAME_MEMORY_TRANSPORT_H
+#define UDP_GAME_MEMORY_TRANSPORT_H
+
+#include "../include/io_backend.h"
+#include "../include/metrics.h"
+#include "../include/packet_pool.h"
+#include "../include/send_queue.h"
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <p101_env/env.h>
+#include <p101_error/error.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEMORY_TRANSPORT_CAPACITY 16384    // Datagrams in flight at once, both directions together
+#define MEMORY_TRANSPORT_NONE INT64_MAX    // memory_transport_next_ns with nothing in flight
+#define PARTS_PER_MILLION 1000000
+
+// What the simulated path between the server and every client does to a datagram, the same both ways
+struct memory_link
+{
+    int64_t  latency_ns;     // One way
+    int64_t  jitter_ns;      // Up to this much more, drawn for each datagram
+    uint32_t loss_ppm;       // Datagrams in a million that are dropped
+    uint32_t reorder_ppm;    // Datagrams in a million held back long enough for later ones to overtake them
+};
+
+struct memory_datagram
+{
+    int64_t            deliver_ns;
+    uint64_t           order;    // Breaks ties on deliver_ns so equal times arrive in send order
+    struct sockaddr_in addr;     // The client's, whichever way the datagram goes
+    size_t             length;
+    uint8_t            data[PACKET_BUFFER_SIZE];
+};
+
+// Datagrams on their way in one direction, earliest delivery first
+struct memory_flight
+{
+    uint32_t *heap;    // Slot indexes ordered as a binary min heap
+    uint32_t  count;
+    uint64_t  sent;
+    uint64_t  delivered;
+    uint64_t  lost;
+    uint64_t  held_back;
+};
+
+typedef void (*memory_client_handler)(const struct p101_env *env, void *arg, const struct sockaddr_in *addr, const uint8_t *data, size_t length);
+
+// The network as an io_backend with no socket under it. The server sees the clients' datagrams come in
+// and its queues drain as they would on a real socket, but every datagram is a copy in memory that lands
+// after the link's latency on a clock the caller moves, so a run is repeatable for a given seed and runs
+// as fast as the game logic allows.
+struct memory_transport
+{
+    struct memory_link      link;
+    struct memory_datagram *slots;
+    uint32_t               *free_slots;
+    uint32_t                free_count;
+    struct memory_flight    to_server;
+    struct memory_flight    to_clients;
+    uint64_t                next_order;
+    uint64_t                overflows;    // Dropped because every slot was in flight
+    uint64_t                random;       // xorshift64 state
+    int64_t                 now_ns;       // The virtual clock, monotonic_clock_use can run the server on it
+};
+
+void     memory_transport_create(const struct p101_env *env, struct p101_error *err, struct memory_transport *transport, const struct memory_link *link, uint64_t seed);
+void     memory_transport_attach(const struct p101_env *env, struct memory_transport *transport, struct io_backend *backend, struct packet_pool *pool);
+void     memory_transport_send(const struct p101_env *env, struct memory_transport *transport, const struct sockaddr_in *from, const uint8_t *data, size_t length);
+void     memory_transport_advance(const struct p101_env *env, struct memory_transport *transport, int64_t until_ns, memory_client_handler handler, void *arg);
+int64_t  memory_transport_next_ns(const struct memory_transport *transport);
+uint64_t memory_transport_random(struct memory_transport *transport);
+void     memory_transport_print_stats(const struct p101_env *env, const struct memory_transport *transport);
+void     memory_transport_destroy(const struct p101_env *env, struct memory_transport *transport);
+
+#endif    // UDP_GAME_MEMORY_TRANSPORT_H
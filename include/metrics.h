@@ -0,0 +1,77 @@
+#ifndef UDP_GAME_METRICS_H
+#define UDP_GAME_METRICS_H
+
+#include <inttypes.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+#define MICROSECONDS_PER_SECOND 1000000LL
+#define MICROSECONDS_PER_MILLISECOND 1000
+#define NANOSECONDS_PER_MICROSECOND 1000
+#define NANOSECONDS_PER_MILLISECOND 1000000
+#define MILLISECONDS_PER_SECOND 1000
+#define WARNING_INTERVAL_SECONDS 1
+#define SEQUENCE_WINDOW 64    // Sequence numbers behind the newest that a tracker remembers seeing
+#define RTT_SMOOTHING 8       // Weight of an old round trip estimate against one new sample, as for TCP's SRTT
+
+struct latency_stats
+{
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+// Tracks one sender's sequence numbers, comparisons use serial arithmetic so wraparound is harmless
+struct sequence_tracker
+{
+    uint32_t expected;
+    bool     started;
+    uint64_t seen;          // Bit i set once expected - 1 - i has arrived, tells a late arrival from a repeat
+    uint64_t received;
+    uint64_t lost;          // Skipped when they were due, whether or not they turned up later
+    uint64_t late;          // Skipped ones that turned up after all
+    uint64_t duplicates;    // Repeats, and arrivals too old for the window to tell
+};
+
+// Allows one warning per interval and counts the ones it swallowed in between
+struct rate_limiter
+{
+    time_t   last;
+    uint64_t suppressed;
+};
+
+struct receive_stats
+{
+    struct latency_stats latency;
+    uint64_t             datagrams;
+    uint64_t             kernel_drops;
+    uint32_t             last_kernel_drop_count;
+    uint64_t             sequence_gaps;
+    uint64_t             late;
+    uint64_t             duplicates;
+    bool                 adopted_socket;    // The socket came from a predecessor, its first drop count is a baseline
+    struct rate_limiter  drop_warning;
+    struct rate_limiter  gap_warning;
+};
+
+void     latency_stats_init(const struct p101_env *env, struct latency_stats *stats);
+void     latency_stats_record(const struct p101_env *env, struct latency_stats *stats, int64_t elapsed_ns);
+void     latency_stats_print(const struct p101_env *env, const struct latency_stats *stats, const char *label);
+int64_t  timespec_diff_ns(const struct timespec *end, const struct timespec *start);
+int64_t  monotonic_now_ns(void);
+void     monotonic_clock_use(const int64_t *clock_ns);
+void     sequence_tracker_reset(const struct p101_env *env, struct sequence_tracker *tracker);
+uint32_t sequence_tracker_update(const struct p101_env *env, struct sequence_tracker *tracker, uint32_t sequence);
+bool     rate_limiter_allow(const struct p101_env *env, struct rate_limiter *limiter);
+void     receive_stats_init(const struct p101_env *env, struct receive_stats *stats);
+void     receive_stats_adopt_socket(const struct p101_env *env, struct receive_stats *stats);
+void     receive_stats_record_kernel_drops(const struct p101_env *env, struct receive_stats *stats, uint32_t drop_count);
+void     receive_stats_print(const struct p101_env *env, const struct receive_stats *stats);
+
+#endif    // UDP_GAME_METRICS_H
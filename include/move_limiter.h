@@ -0,0 +1,54 @@
+#ifndef UDP_GAME_MOVE_LIMITER_H
+#define UDP_GAME_MOVE_LIMITER_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/structs.h"
+#include <inttypes.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define MOVE_LIMIT_BURST 8    // Moves a client may send back to back before its rate applies
+
+enum move_verdict
+{
+    MOVE_PASS,    // Apply the move handed back now
+    MOVE_HELD     // Over the rate, the move waits to be released or folded into the next one
+};
+
+// A client's newest move past its rate. old_x and old_y stay those of the first move held, so
+// the release still starts where everyone last saw the client.
+struct held_move
+{
+    struct packet_header header;
+    struct coordinates   coordinates;
+    bool                 held;
+};
+
+// A token bucket per client, kept as the time its next move is due (GCRA) so a check is one
+// compare and one add on a single integer. Only the network thread touches it, so it needs no locks.
+struct move_limiter
+{
+    int64_t          interval_ns;    // Between moves at the allowed rate, 0 turns the limiter off
+    int64_t          burst_ns;
+    int64_t          due_ns[MAX_CLIENTS];
+    struct held_move held[MAX_CLIENTS];
+    int              held_clients[MAX_CLIENTS];    // Clients with a move held, each listed once
+    uint32_t         held_count;
+    uint64_t         deferred;     // Moves held because the client was over its rate
+    uint64_t         coalesced;    // Moves folded into one already held
+    uint64_t         dropped;      // Moves over the rate that were older than, or the same as, the one held
+};
+
+void              move_limiter_init(const struct p101_env *env, struct move_limiter *limiter, uint32_t moves_per_second);
+void              move_limiter_reset(const struct p101_env *env, struct move_limiter *limiter, int client_index);
+enum move_verdict move_limiter_admit(const struct p101_env *env, struct move_limiter *limiter, int client_index, int64_t now_ns, struct packet_header *header, struct coordinates *coordinates);
+bool              move_limiter_take(const struct p101_env *env, struct move_limiter *limiter, int client_index, struct packet_header *header, struct coordinates *coordinates);
+int               move_limiter_release(const struct p101_env *env, struct move_limiter *limiter, int64_t now_ns, struct packet_header *header, struct coordinates *coordinates);
+int               move_limiter_timeout_ms(const struct p101_env *env, const struct move_limiter *limiter, int64_t now_ns);
+void              move_limiter_print_stats(const struct p101_env *env, const struct move_limiter *limiter);
+
+#endif    // UDP_GAME_MOVE_LIMITER_H
@@ -6,17 +6,37 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <netdb.h>
+#include <netinet/udp.h>
 #include <p101_env/env.h>
 #include <p101_posix/sys/p101_socket.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #define EXIT_COORDINATE 1234
+#define REDIRECT_COORDINATE 4321      // new_x and new_y of a redirect, old_x and old_y carry the IPv4 address and port to use instead
+#define COOKIE_COORDINATE 4322        // new_x and new_y of a join challenge, old_x and old_y carry the cookie to send back
+#define PING_COORDINATE 4323          // new_x and new_y of a clock ping and its pong, a pong's old_x and old_y carry the server's clock
+#define SNAPSHOT_COORDINATE 4324      // new_x and new_y of the record that opens an adapted snapshot datagram, its sequence is the snapshot's
+#define ACK_COORDINATE 4325           // new_x and new_y of a snapshot ack, old_x and old_y carry the newest snapshot and how many arrived
+#define CORRECTION_COORDINATE 4326    // new_x and new_y of a refused move's answer, old_x and old_y carry the cell the mover is still on
 #define PORT_SIZE 5
-#define MAX_CLIENTS 10
+#define WORLD_COLUMNS 1024            // Cells across, kept below the sentinel coordinates above
+#define WORLD_ROWS 1024
+#define WORLD_CHUNK_COLUMNS 128       // The server keeps the world in chunks of this size and streams by chunk
+#define WORLD_CHUNK_ROWS 64
+#define WORLD_VIEW_RADIUS 1           // Chunks around a player's own that it is sent updates for
+#define MAX_CLIENTS 1024
+#define PACKET_HEADER_SIZE (2 * sizeof(uint32_t))
+#define COORDINATES_SIZE (4 * sizeof(uint32_t))
+#define POSITION_PACKET_SIZE (PACKET_HEADER_SIZE + COORDINATES_SIZE)
+#define JOIN_COOKIE_SIZE (2 * sizeof(uint32_t))    // Trailer after a position packet that answers a join challenge
+#define CLOCK_STAMP_SIZE (2 * sizeof(uint32_t))    // Trailer after a known client's move, the server time of the world it saw
+#define RECEIVE_CONTROL_SIZE (CMSG_SPACE(sizeof(struct timespec)) + CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int)))    // Room for timestamp, drop count and GRO segment size
 
 #ifndef SOCK_CLOEXEC
     #define SOCK_CLOEXEC 0
@@ -24,10 +44,29 @@
 
 void    socket_create(const struct p101_env *env, struct p101_error *err, int *sockfd, int domain);
 void    socket_bind(const struct p101_env *env, struct p101_error *err, int sockfd, in_port_t port, struct sockaddr_storage *addr);
+void    socket_set_nonblocking(const struct p101_env *env, struct p101_error *err, int sockfd);
+void    socket_share_port(const struct p101_env *env, struct p101_error *err, int sockfd);
+void    socket_join_group(const struct p101_env *env, struct p101_error *err, int sockfd, const struct sockaddr_storage *group, const struct sockaddr_storage *interface_addr);
+void    socket_set_group_source(const struct p101_env *env, struct p101_error *err, int sockfd, const struct sockaddr_storage *interface_addr);
+struct receive_metadata
+{
+    struct timespec rx_time;         // Kernel receive time, zero unless SO_TIMESTAMPNS is enabled
+    uint32_t        kernel_drops;    // Cumulative socket drop count from SO_RXQ_OVFL
+    bool            has_kernel_drops;
+    uint16_t        segment_size;    // Size of each coalesced datagram when UDP_GRO merged several, 0 otherwise
+};
+
+void    serialize_header_to_buffer(const struct p101_env *env, const struct packet_header *header, uint8_t *buffer);
+void    deserialize_header_from_buffer(const struct p101_env *env, struct packet_header *header, const uint8_t *buffer);
 void    serialize_position_to_buffer(const struct p101_env *env, const struct coordinates *coordinates, uint8_t *buffer);
 void    deserialize_position_from_buffer(const struct p101_env *env, struct coordinates *coordinates, const uint8_t *buffer);
+void    serialize_stamp_to_buffer(const struct p101_env *env, int64_t stamp_us, uint8_t *buffer);
+int64_t deserialize_stamp_from_buffer(const struct p101_env *env, const uint8_t *buffer);
 ssize_t socket_read_full(const struct p101_env *env, int sockfd, uint8_t *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t addrlen);
+ssize_t socket_read_message(const struct p101_env *env, int sockfd, uint8_t *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t *addrlen, struct receive_metadata *metadata);
+void    parse_receive_metadata(const struct p101_env *env, const struct msghdr *msg, struct receive_metadata *metadata);
 ssize_t socket_write_full(const struct p101_env *env, int sockfd, const uint8_t *buffer, size_t size, const struct sockaddr *addr, socklen_t addrlen);
 void    socket_close(const struct p101_env *env, struct p101_error *err, const struct context *context);
+bool    world_in_view(uint32_t viewer_x, uint32_t viewer_y, uint32_t x, uint32_t y);
 
 #endif    // UDP_GAME_NETWORK_H
@@ -0,0 +1,36 @@
+#ifndef UDP_GAME_OCCUPANCY_H
+#define UDP_GAME_OCCUPANCY_H
+
+#include <p101_env/env.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSSE3__)
+    #include <tmmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
+#define OCCUPANCY_COLUMNS 128    // One world chunk across, one 128 bit vector per row
+#define OCCUPANCY_ROWS 64        // One world chunk down
+#define OCCUPANCY_ROW_WORDS (OCCUPANCY_COLUMNS / 64)
+#define OCCUPANCY_ROW_ALIGNMENT 16
+
+// One bit per cell, set while at least one player stands there. Positions outside the grid
+// (the exit and redirect sentinels among them) are never recorded and always read as empty.
+struct occupancy_grid
+{
+    alignas(OCCUPANCY_ROW_ALIGNMENT) uint64_t rows[OCCUPANCY_ROWS][OCCUPANCY_ROW_WORDS];
+};
+
+void     occupancy_clear_all(const struct p101_env *env, struct occupancy_grid *grid);
+bool     occupancy_test(const struct p101_env *env, const struct occupancy_grid *grid, uint32_t x, uint32_t y);
+void     occupancy_set(const struct p101_env *env, struct occupancy_grid *grid, uint32_t x, uint32_t y);
+void     occupancy_clear(const struct p101_env *env, struct occupancy_grid *grid, uint32_t x, uint32_t y);
+uint32_t occupancy_count_rect(const struct p101_env *env, const struct occupancy_grid *grid, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1);
+uint32_t occupancy_count(const struct p101_env *env, const struct occupancy_grid *grid);
+
+#endif    // UDP_GAME_OCCUPANCY_H
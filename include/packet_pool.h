@@ -0,0 +1,45 @@
+#ifndef UDP_GAME_PACKET_POOL_H
+#define UDP_GAME_PACKET_POOL_H
+
+#include <p101_env/env.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CACHE_LINE_SIZE 64
+#define PACKET_BUFFER_SIZE 1472    // Largest UDP payload that fits in a 1500 byte Ethernet MTU
+#define PACKET_POOL_CAPACITY 2048
+#define PACKET_POOL_EMPTY UINT32_MAX
+
+struct packet_pool;
+
+// Buffers are cache line aligned so two threads working on neighbouring buffers never share a line.
+struct packet_buffer
+{
+    alignas(CACHE_LINE_SIZE) uint8_t data[PACKET_BUFFER_SIZE];
+    size_t              length;
+    atomic_uint         refcount;
+    _Atomic uint32_t    next;    // Free list link, only meaningful while the buffer is in the pool
+    uint32_t            index;
+    struct packet_pool *pool;
+};
+
+struct packet_pool
+{
+    struct packet_buffer *buffers;
+    _Atomic uint64_t      free_head;    // Low 32 bits hold the head index, high 32 bits an ABA tag
+    atomic_uint           in_use;
+    uint32_t              capacity;
+};
+
+void                  packet_pool_create(const struct p101_env *env, struct p101_error *err, struct packet_pool *pool, uint32_t capacity);
+void                  packet_pool_destroy(const struct p101_env *env, struct packet_pool *pool);
+struct packet_buffer *packet_pool_acquire(const struct p101_env *env, struct packet_pool *pool);
+void                  packet_buffer_retain(const struct p101_env *env, struct packet_buffer *buffer);
+void                  packet_buffer_release(const struct p101_env *env, struct packet_buffer *buffer);
+
+#endif    // UDP_GAME_PACKET_POOL_H
@@ -0,0 +1,36 @@
+#ifndef UDP_GAME_POSITION_HISTORY_H
+#define UDP_GAME_POSITION_HISTORY_H
+
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define POSITION_HISTORY_LENGTH 32               // Positions kept per player, a power of two
+#define POSITION_HISTORY_MAX_REWIND_US 500000    // Oldest view a client's move is judged against, older stamps are clamped
+
+#if (POSITION_HISTORY_LENGTH & (POSITION_HISTORY_LENGTH - 1)) != 0
+    #error "POSITION_HISTORY_LENGTH must be a power of two"
+#endif
+
+struct position_sample
+{
+    int64_t  time_us;    // Server clock when the player got there
+    uint32_t x;
+    uint32_t y;
+};
+
+// The last positions of one player, so a move can be judged against the world as its sender saw it.
+// Owned by the thread that simulates the player's room, like its coordinates.
+struct position_history
+{
+    struct position_sample samples[POSITION_HISTORY_LENGTH];
+    uint32_t               next;
+    uint32_t               count;
+};
+
+void position_history_reset(const struct p101_env *env, struct position_history *history);
+void position_history_record(const struct p101_env *env, struct position_history *history, int64_t time_us, uint32_t x, uint32_t y);
+bool position_history_at(const struct p101_env *env, const struct position_history *history, int64_t time_us, uint32_t *x, uint32_t *y);
+
+#endif    // UDP_GAME_POSITION_HISTORY_H
@@ -0,0 +1,59 @@
+#ifndef UDP_GAME_PRIORITY_ACCUMULATOR_H
+#define UDP_GAME_PRIORITY_ACCUMULATOR_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/packet_pool.h"
+#include "../include/room.h"
+#include "../include/structs.h"
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SNAPSHOT_TICK_NS (NANOSECONDS_PER_SECOND / 20)                                   // How often each client gets what its budget allows
+#define SNAPSHOT_DATAGRAM_OVERHEAD 28                                                  // IPv4 and UDP headers, counted against the budget with the payload
+#define SNAPSHOT_MAX_UPDATES ((uint32_t)(PACKET_BUFFER_SIZE / POSITION_PACKET_SIZE))    // Position packets packed back to back in one datagram
+#define SNAPSHOT_MIN_BUDGET (SNAPSHOT_DATAGRAM_OVERHEAD + POSITION_PACKET_SIZE)
+#define PRIORITY_ACCUMULATOR_SLOTS (2 * ROOM_CAPACITY)    // Room for every other member plus exits of members since replaced
+#define PRIORITY_MAX_WEIGHT 16                             // Added each tick for an entity on the viewer's own cell
+#define PRIORITY_FALLOFF_CELLS 16                          // Distance at which an entity gains half of that
+
+// The newest move of one entity that one viewer has not been sent yet
+struct pending_update
+{
+    struct packet_header header;
+    struct coordinates   coordinates;    // old_x and old_y stay where the viewer last saw the entity
+    int                  entity;
+    uint32_t             priority;
+    bool                 urgent;    // An exit goes out on the next tick whatever the budget
+};
+
+// What one viewer is owed. Every tick each waiting update gains priority by how close its entity is, the
+// best go out until the viewer's budget is spent, and the rest keep what they gained, so nothing waits for
+// ever and nearby players are heard of first. Owned by the thread simulating the viewer's room.
+struct priority_accumulator
+{
+    struct pending_update updates[PRIORITY_ACCUMULATOR_SLOTS];
+    uint32_t              count;
+};
+
+// Per thread that simulates rooms
+struct snapshot_stats
+{
+    uint64_t datagrams;
+    uint64_t updates;
+    uint64_t coalesced;    // Moves folded into an update still waiting for the same viewer
+    uint64_t deferred;     // Updates left for a later tick, counted once per tick they wait
+    uint64_t overflows;    // Sent right away because the viewer had no slot left
+};
+
+void     priority_accumulator_clear(const struct p101_env *env, struct priority_accumulator *accumulator);
+bool     priority_accumulator_push(const struct p101_env *env, struct priority_accumulator *accumulator, int entity, const struct packet_header *header, const struct coordinates *coordinates, bool urgent, struct snapshot_stats *stats);
+bool     priority_accumulator_reveal(const struct p101_env *env, struct priority_accumulator *accumulator, int entity, const struct packet_header *header, const struct coordinates *position);
+void     priority_accumulator_forget(const struct p101_env *env, struct priority_accumulator *accumulator, int entity);
+uint32_t priority_accumulator_take(const struct p101_env *env, struct priority_accumulator *accumulator, uint32_t viewer_x, uint32_t viewer_y, uint32_t max_updates, struct pending_update *taken);
+uint32_t snapshot_updates_for_budget(uint32_t budget);
+void     snapshot_stats_print(const struct p101_env *env, const struct snapshot_stats *stats, uint32_t count, uint32_t budget);
+
+#endif    // UDP_GAME_PRIORITY_ACCUMULATOR_H
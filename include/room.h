@@ -0,0 +1,47 @@
+#ifndef UDP_GAME_ROOM_H
+#define UDP_GAME_ROOM_H
+
+#include "../include/structs.h"
+#include "../include/world.h"
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_ROOMS 256
+#define ROOM_CAPACITY 16
+#define ROOM_NONE UINT32_MAX
+
+#if CHUNK_TABLE_SLOTS < ROOM_CAPACITY
+    #error "every member of a full room must be able to stand in a chunk of its own"
+#endif
+
+// The dispatcher (network thread) owns id, active and population and decides who gets in.
+// members[] belongs to the thread that simulates the room and changes only through queued
+// join and leave events, so both sides agree on membership without sharing a lock.
+struct room
+{
+    uint32_t           id;              // Network thread only, rewritten as soon as the slot is admitted to a new room
+    uint32_t           simulated_id;    // The id as the room's thread last took it from a join, what it stamps on packets
+    bool               active;
+    uint32_t           population;
+    uint32_t           member_count;
+    int                members[ROOM_CAPACITY];    // Indices into the server's clients[]
+    struct chunk_table chunks;                    // Chunks the members stand in, kept with members[] by the room's thread
+};
+
+struct room_table
+{
+    struct room rooms[MAX_ROOMS];
+    uint32_t    active;
+    uint32_t    peak_active;
+};
+
+void     room_table_init(const struct p101_env *env, struct room_table *table);
+uint32_t room_find(const struct p101_env *env, const struct room_table *table, uint32_t room_id);
+uint32_t room_admit(const struct p101_env *env, struct room_table *table, uint32_t room_id);
+void     room_release(const struct p101_env *env, struct room_table *table, uint32_t slot);
+void     room_add_member(const struct p101_env *env, struct room *room, int client_index);
+void     room_remove_member(const struct p101_env *env, struct room *room, int client_index);
+
+#endif    // UDP_GAME_ROOM_H
@@ -0,0 +1,31 @@
+#ifndef UDP_GAME_ROOM_WORKER_H
+#define UDP_GAME_ROOM_WORKER_H
+
+#include "../include/staged_worker.h"
+#include "../include/structs.h"
+#include <stdint.h>
+
+#define ROOM_WORKER_RING_CAPACITY 4096
+
+enum room_event_kind
+{
+    ROOM_EVENT_JOIN,
+    ROOM_EVENT_MOVE,
+    ROOM_EVENT_LEAVE,    // Quiet removal, the player moved on to another zone rather than quitting
+    ROOM_EVENT_GHOST,    // A neighbouring zone's player near the border, client_index is -1
+    ROOM_EVENT_ACK       // The client acked snapshots, coordinates old_x and old_y carry the ack
+};
+
+// One decoded update for a room, handed from the network thread to whoever simulates the room. A room
+// worker is a staged_worker fed these by the network thread.
+struct room_event
+{
+    enum room_event_kind kind;
+    int                  client_index;
+    uint32_t             room;
+    struct packet_header header;
+    struct coordinates   coordinates;
+    int64_t              view_us;    // Server time of the world the client saw when it moved, 0 to judge the move as of now
+};
+
+#endif    // UDP_GAME_ROOM_WORKER_H
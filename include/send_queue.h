@@ -0,0 +1,45 @@
+#ifndef UDP_GAME_SEND_QUEUE_H
+#define UDP_GAME_SEND_QUEUE_H
+
+#include "../include/packet_pool.h"
+#include "../include/udp_offload.h"
+#include <errno.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define SEND_QUEUE_DEPTH 16
+#define SEND_QUEUE_NO_ORIGIN (-1)    // Packets that do not carry a local client's position are never coalesced
+
+enum send_queue_status
+{
+    SEND_QUEUE_DRAINED,
+    SEND_QUEUE_BLOCKED
+};
+
+struct send_queue_entry
+{
+    struct packet_buffer *packet;
+    int                   origin;    // Client whose position the packet carries, used to coalesce stale updates
+};
+
+struct send_queue
+{
+    struct send_queue_entry entries[SEND_QUEUE_DEPTH];
+    uint32_t                head;
+    uint32_t                count;
+    uint64_t                sent;
+    uint64_t                segmented_sends;
+    uint64_t                coalesced;
+    uint64_t                dropped;
+    uint64_t                failed;
+};
+
+void                   send_queue_init(const struct p101_env *env, struct send_queue *queue);
+void                   send_queue_push(const struct p101_env *env, struct send_queue *queue, struct packet_buffer *packet, int origin);
+enum send_queue_status send_queue_flush(const struct p101_env *env, struct send_queue *queue, struct udp_offload *offload, int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+void                   send_queue_pop(const struct p101_env *env, struct send_queue *queue);
+void                   send_queue_clear(const struct p101_env *env, struct send_queue *queue);
+
+#endif    // UDP_GAME_SEND_QUEUE_H
@@ -0,0 +1,92 @@
+#ifndef UDP_GAME_SEND_RATE_H
+#define UDP_GAME_SEND_RATE_H
+
+#include "../include/metrics.h"
+#include "../include/network.h"
+#include "../include/priority_accumulator.h"
+#include "../include/structs.h"
+#include <inttypes.h>
+#include <p101_env/env.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SEND_RATE_HISTORY 64                                                                                // Send times kept for matching acks, snapshots further back get no RTT sample
+#define SEND_RATE_LOSS_SMOOTHING 32                                                                         // Weight of the old loss estimate against one sample per snapshot sent every tick
+#define SEND_RATE_LOSS_MIN_SMOOTHING 4                                                                      // And at most one per snapshot sent less often
+#define SEND_RATE_LOSS_HIGH_PPM 100000                                                                      // Smoothed loss above which the client's rate backs off
+#define SEND_RATE_LOSS_LOW_PPM 30000                                                                        // Smoothed loss below which, without queueing, it recovers
+#define SEND_RATE_QUEUE_SLACK_US 20000                                                                      // Round trips up to twice the shortest plus this are not queueing
+#define SEND_RATE_MIN_SETTLE_US 200000                                                                      // Shortest wait between two changes of one client's rate
+#define SEND_RATE_BUDGET_STEPS 8                                                                            // Recovery gives the budget back in this many steps
+#define SEND_RATE_MIN_BUDGET (SNAPSHOT_MIN_BUDGET + POSITION_PACKET_SIZE)                                   // One update and the sequence record
+#define SEND_RATE_FULL_BUDGET (SNAPSHOT_DATAGRAM_OVERHEAD + SNAPSHOT_MAX_UPDATES * POSITION_PACKET_SIZE)    // One datagram
+#define SNAPSHOT_ACK_INTERVAL_US 100000                                                                     // A client acks at most this often
+#define SEND_RATE_PPM 1000000
+#define SEND_RATE_PERCENT 100
+
+// The bounds every client's rate is kept within
+struct send_rate_limits
+{
+    int64_t  tick_ns;               // The room threads' snapshot tick, the shortest interval
+    uint32_t max_interval_ticks;    // 0 when rates are not adapted
+    uint32_t tick_budget;           // Bytes per snapshot at full rate, and the fewest any snapshot gets
+    uint32_t max_budget;            // At the longest interval, a full datagram unless tick_budget is more
+};
+
+// The server's view of the path to one client. Every snapshot datagram carries a sequence number, the client
+// acks the newest one now and then with a count of how many arrived, and from that the server learns the round
+// trip and the share lost. A client whose path drops packets or builds a queue is sent fewer, fuller snapshots,
+// then smaller ones again down to the per-tick size, and it gets its rate back while the path stays clean.
+// Owned by the thread simulating the client's room.
+struct send_rate
+{
+    int64_t  sent_us[SEND_RATE_HISTORY];    // When each recent snapshot went out, by sequence
+    uint32_t next_sequence;
+    uint32_t acked_sequence;                // Newest snapshot the client has acked
+    uint32_t acked_received;                // Snapshots the client had received by then
+    bool     acked;                         // Until the first ack the client is sent at full rate
+    int64_t  srtt_us;
+    int64_t  min_rtt_us;                    // The path without a queue, as near as we have seen
+    int64_t  loss_ppm;                      // Smoothed share of snapshots lost
+    uint32_t interval_ticks;                // A snapshot every this many ticks
+    uint32_t budget;                        // Bytes per snapshot
+    int64_t  next_snapshot_ns;
+    int64_t  settle_us;                     // The rate is left alone until then, so one loss event is answered once
+};
+
+// Per thread that simulates rooms
+struct send_rate_stats
+{
+    uint64_t acks;
+    uint64_t backoffs;
+    uint64_t recoveries;
+};
+
+// A client's side: which snapshots arrived, and when it last said so
+struct snapshot_acker
+{
+    uint32_t newest;
+    uint32_t received;
+    int64_t  last_ack_us;
+    bool     started;
+    bool     unacked;    // A snapshot arrived since the last ack
+};
+
+void     send_rate_limits_init(const struct p101_env *env, struct send_rate_limits *limits, uint32_t max_interval_ms, uint32_t tick_budget);
+void     send_rate_reset(const struct p101_env *env, struct send_rate *rate, const struct send_rate_limits *limits);
+bool     send_rate_due(const struct send_rate *rate, const struct send_rate_limits *limits, int64_t now_ns);
+void     send_rate_schedule(struct send_rate *rate, const struct send_rate_limits *limits, int64_t now_ns);
+uint32_t send_rate_update_budget(const struct send_rate *rate);
+uint32_t send_rate_next_sequence(const struct p101_env *env, struct send_rate *rate, int64_t now_us);
+void     send_rate_ack(const struct p101_env *env, struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats, uint32_t sequence, uint32_t received, int64_t now_us);
+void     send_rate_print_stats(const struct p101_env *env, const struct send_rate_limits *limits, const struct send_rate_stats *stats, uint32_t count, const struct send_rate *rates, const atomic_bool *active);
+void     snapshot_acker_reset(struct snapshot_acker *acker);
+bool     snapshot_acker_read(const struct p101_env *env, struct snapshot_acker *acker, const struct packet_header *header, const struct coordinates *coordinates);
+bool     snapshot_acker_ack_due(const struct snapshot_acker *acker, int64_t now_us);
+void     snapshot_acker_write_ack(const struct p101_env *env, struct snapshot_acker *acker, const struct packet_header *header, int64_t now_us, uint8_t *buffer);
+bool     is_ack(const struct coordinates *coordinates);
+
+#endif    // UDP_GAME_SEND_RATE_H
@@ -0,0 +1,21 @@
+#ifndef UDP_GAME_SEND_WORKER_H
+#define UDP_GAME_SEND_WORKER_H
+
+#include "../include/packet_pool.h"
+#include "../include/staged_worker.h"
+#include <stdint.h>
+
+#define SEND_WORKER_RING_CAPACITY 8192
+#define SEND_JOB_GROUP (-1)    // Recipient of a packet for the multicast group rather than one client
+
+// One encoded packet for one recipient. The job holds its own reference to the packet.
+// A job without a packet says the recipient has left and its queue can be dropped. A sender is the
+// last stage of the pipeline, a staged_worker fed these by exactly one room worker.
+struct send_job
+{
+    int                   recipient;    // Index into the server's clients[], or SEND_JOB_GROUP
+    int                   origin;       // Client whose position the packet carries, or SEND_QUEUE_NO_ORIGIN
+    struct packet_buffer *packet;
+};
+
+#endif    // UDP_GAME_SEND_WORKER_H
@@ -0,0 +1,18 @@
+#ifndef UDP_GAME_SOCKET_OPTIONS_H
+#define UDP_GAME_SOCKET_OPTIONS_H
+
+#include "../include/structs.h"
+#include <errno.h>
+#include <netinet/ip.h>
+#include <p101_env/env.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define DSCP_SHIFT 2    // DSCP occupies the upper six bits of the TOS/traffic class byte
+
+void socket_apply_options(const struct p101_env *env, struct p101_error *err, int sockfd, int domain, const struct socket_options *options);
+void socket_enable_drop_counter(const struct p101_env *env, int sockfd);
+
+#endif    // UDP_GAME_SOCKET_OPTIONS_H
@@ -0,0 +1,32 @@
+#ifndef UDP_GAME_SPSC_RING_H
+#define UDP_GAME_SPSC_RING_H
+
+#include "../include/packet_pool.h"
+#include <p101_env/env.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Bounded single-producer/single-consumer queue of fixed size elements.
+// Head and tail live on separate cache lines and each side caches the other's index, so the
+// shared lines are only touched when the cached view says the ring is full or empty.
+struct spsc_ring
+{
+    uint8_t *slots;
+    size_t   element_size;
+    uint32_t mask;
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t head;    // Written by the consumer only
+    uint32_t cached_tail;
+    alignas(CACHE_LINE_SIZE) _Atomic uint32_t tail;    // Written by the producer only
+    uint32_t cached_head;
+};
+
+void     spsc_ring_create(const struct p101_env *env, struct p101_error *err, struct spsc_ring *ring, uint32_t capacity, size_t element_size);
+void     spsc_ring_destroy(const struct p101_env *env, struct spsc_ring *ring);
+uint32_t spsc_ring_push_batch(const struct p101_env *env, struct spsc_ring *ring, const void *elements, uint32_t count);
+uint32_t spsc_ring_pop_batch(const struct p101_env *env, struct spsc_ring *ring, void *elements, uint32_t max);
+
+#endif    // UDP_GAME_SPSC_RING_H
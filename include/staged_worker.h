@@ -0,0 +1,54 @@
+#ifndef UDP_GAME_STAGED_WORKER_H
+#define UDP_GAME_STAGED_WORKER_H
+
+#include "../include/metrics.h"
+#include "../include/spsc_ring.h"
+#include <p101_env/env.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STAGED_WORKER_BATCH 64    // Items staged by the producer before they are published to the worker
+#define STAGED_WORKER_RETRY_NS 1000000    // How long a worker with blocked sends sleeps before retrying them
+
+// handle applies one item, flush sends what the items queued and returns true if some of it is still blocked
+struct staged_worker_ops
+{
+    void (*handle)(const struct p101_env *env, void *arg, uint32_t worker, const void *item);
+    bool (*flush)(const struct p101_env *env, void *arg, uint32_t worker);
+};
+
+// A thread fed by exactly one producer through a ring of fixed size items. The producer stages items
+// and hands them over a batch at a time, the thread sees them at the latest on the next wake.
+struct staged_worker
+{
+    pthread_t                       thread;
+    struct spsc_ring                ring;
+    sem_t                           wakeup;
+    atomic_bool                     running;
+    bool                            wake_pending;    // Producer only, coalesces wakeups to one per producer pass
+    uint8_t                        *staged;          // Producer only, STAGED_WORKER_BATCH items not yet visible to the worker
+    uint8_t                        *batch;           // Worker only, items taken off the ring
+    size_t                          item_size;
+    uint32_t                        staged_count;
+    uint32_t                        index;
+    uint64_t                        items;
+    uint64_t                        batches;    // Times the worker took items off its ring
+    uint64_t                        stalls;     // Times the producer found the ring full and had to wait
+    const struct p101_env          *env;
+    const struct staged_worker_ops *ops;
+    void                           *arg;
+};
+
+void staged_worker_start(const struct p101_env *env, struct p101_error *err, struct staged_worker *worker, uint32_t index, uint32_t capacity, size_t item_size, const struct staged_worker_ops *ops, void *arg);
+void staged_worker_post(const struct p101_env *env, struct staged_worker *worker, const void *item);
+void staged_worker_wake(const struct p101_env *env, struct staged_worker *worker);
+void staged_worker_stop(const struct p101_env *env, struct staged_worker *worker);
+
+#endif    // UDP_GAME_STAGED_WORKER_H
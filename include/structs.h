@@ -2,9 +2,11 @@
 #define UDP_GAME_STRUCTS_H
 
 #include <netinet/in.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #define MESSAGE_LENGTH 128
+#define MAX_ROOM_WORKERS 64
 
 struct arguments
 {
@@ -15,9 +17,51 @@ struct arguments
     const char *src_port_str;
     const char *dest_ip_address;
     const char *dest_port_str;
+    const char *rcvbuf_str;
+    const char *sndbuf_str;
+    const char *busy_poll_str;
+    const char *dscp_str;
+    const char *capture_path;
+    const char *checkpoint_path;
+    const char *restart_path;
+    const char *room_str;
+    const char *workers_str;
+    const char *zone_str;
+    const char *cluster_str;
+    const char *group_ip_address;
+    const char *group_port_str;
+    const char *move_limit_str;
+    const char *snapshot_budget_str;
+    const char *snapshot_interval_str;
+    const char *clients_str;
+    const char *duration_str;
+    const char *move_rate_str;
+    const char *latency_str;
+    const char *jitter_str;
+    const char *loss_str;
+    const char *reorder_str;
+    const char *seed_str;
+    bool        timestamps;
+    bool        zerocopy;
+    bool        offload;
+    bool        uring;
+    bool        unpaced;
+    bool        collisions;
+    bool        pipelined;
+    bool        cookies;
     char      **argv;
 };
 
+struct socket_options
+{
+    int  rcvbuf;       // SO_RCVBUF in bytes, 0 keeps the kernel default
+    int  sndbuf;       // SO_SNDBUF in bytes, 0 keeps the kernel default
+    int  busy_poll;    // SO_BUSY_POLL in microseconds, 0 disables busy polling
+    int  dscp;         // DSCP code point, -1 leaves IP_TOS/IPV6_TCLASS untouched
+    bool timestamps;
+    bool zerocopy;
+};
+
 struct settings
 {
     const char             *src_ip_address;
@@ -29,6 +73,15 @@ struct settings
     struct sockaddr_storage dest_addr;
     socklen_t               src_addr_len;
     socklen_t               dest_addr_len;
+    struct sockaddr_storage group_addr;        // Multicast group that room snapshots go to
+    socklen_t               group_addr_len;    // 0 when multicast is off
+    struct socket_options   options;
+    uint32_t                room;
+    uint32_t                workers;
+    uint32_t                zone;
+    uint32_t                move_limit;           // Moves per second per client, 0 when unlimited
+    uint32_t                snapshot_budget;      // Bytes of updates per client per tick, 0 sends every move at once
+    uint32_t                snapshot_interval;    // Longest wait in ms between snapshots to a client on a bad path, 0 when rates are not adapted
 };
 
 struct context
@@ -39,6 +92,12 @@ struct context
     char             *exit_message;
 };
 
+struct packet_header
+{
+    uint32_t sequence;    // Incremented by the sender for every datagram, used to detect loss and reordering
+    uint32_t room;        // Room the sender plays in, only read when the server first sees the sender
+};
+
 struct coordinates
 {
     uint32_t old_x;
@@ -49,8 +108,11 @@ struct coordinates
 
 struct client_info
 {
-    char               client_ip[INET6_ADDRSTRLEN];
-    in_port_t          client_port;
-    struct coordinates coordinates;
+    char                    client_ip[INET6_ADDRSTRLEN];
+    in_port_t               client_port;
+    struct sockaddr_storage addr;
+    socklen_t               addr_len;
+    struct coordinates      coordinates;
+    uint32_t                room;    // Slot in the server's room table
 };
 #endif    // UDP_GAME_STRUCTS_H
@@ -0,0 +1,28 @@
+#ifndef UDP_GAME_UDP_OFFLOAD_H
+#define UDP_GAME_UDP_OFFLOAD_H
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#define UDP_GSO_MAX_SEGMENTS 64       // Kernel limit on segments per GSO send (UDP_MAX_SEGMENTS)
+#define UDP_GRO_BUFFER_SIZE 65535    // A coalesced GRO read can carry up to a full IP datagram
+
+struct udp_offload
+{
+    bool gso;
+    bool gro;
+};
+
+void    udp_offload_enable(const struct p101_env *env, int sockfd, struct udp_offload *offload, bool enable);
+ssize_t udp_offload_send_segments(const struct p101_env *env, struct udp_offload *offload, int sockfd, struct iovec *iov, size_t iov_count, uint16_t segment_size, const struct sockaddr *addr, socklen_t addrlen);
+bool    udp_offload_send_unsupported(int error_number);
+
+#endif    // UDP_GAME_UDP_OFFLOAD_H
@@ -0,0 +1,43 @@
+#ifndef UDP_GAME_WORLD_H
+#define UDP_GAME_WORLD_H
+
+#include "../include/network.h"
+#include "../include/occupancy.h"
+#include <p101_env/env.h>
+#include <stdalign.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if OCCUPANCY_COLUMNS != WORLD_CHUNK_COLUMNS || OCCUPANCY_ROWS != WORLD_CHUNK_ROWS
+    #error "a chunk's occupancy grid must cover exactly one chunk"
+#endif
+
+#define CHUNK_TABLE_SLOTS 16    // A room loads at most one chunk per member
+
+// One chunk of one room, in memory only while a player stands in it
+struct world_chunk
+{
+    struct occupancy_grid occupancy;    // Chunk local cells
+    uint32_t              column;       // Chunk coordinates, world cell divided by the chunk size
+    uint32_t              row;
+    uint32_t              population;    // Players in the chunk, it is unloaded when this drops to zero
+};
+
+// The loaded chunks of one room. Owned by the thread that simulates the room, like its members.
+struct chunk_table
+{
+    struct world_chunk *chunks[CHUNK_TABLE_SLOTS];
+    uint32_t            loaded;
+    uint64_t            loads;
+    uint64_t            unloads;
+};
+
+bool     chunk_table_enter(const struct p101_env *env, struct chunk_table *table, uint32_t x, uint32_t y);
+void     chunk_table_leave(const struct p101_env *env, struct chunk_table *table, uint32_t x, uint32_t y, bool clear_cell);
+bool     chunk_table_occupied(const struct p101_env *env, const struct chunk_table *table, uint32_t x, uint32_t y);
+uint32_t chunk_table_count(const struct p101_env *env, const struct chunk_table *table);
+void     chunk_table_clear(const struct p101_env *env, struct chunk_table *table);
+
+#endif    // UDP_GAME_WORLD_H
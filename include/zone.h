@@ -0,0 +1,62 @@
+#ifndef UDP_GAME_ZONE_H
+#define UDP_GAME_ZONE_H
+
+#include "../include/convert.h"
+#include "../include/network.h"
+#include <arpa/inet.h>
+#include <p101_env/env.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_ZONES 16
+#define ZONE_NONE UINT32_MAX
+#define ZONE_WORLD_WIDTH WORLD_COLUMNS    // Zones split the world into vertical strips
+#define ZONE_BORDER_WIDTH 4               // Columns next to a boundary whose moves are replicated to the neighbouring zone
+#define ZONE_MESSAGE_MAGIC 0x5A4F4E45U
+#define ZONE_MESSAGE_HEADER_SIZE (4 * sizeof(uint32_t))    // Magic, type, client address, client port
+#define ZONE_MESSAGE_SIZE (ZONE_MESSAGE_HEADER_SIZE + POSITION_PACKET_SIZE)
+
+enum zone_message_type
+{
+    ZONE_MESSAGE_FORWARD = 1,    // A client datagram for the zone that owns its position, also how a handoff starts
+    ZONE_MESSAGE_GHOST,          // A move near the border, shown to the receiver's players in the same room
+    ZONE_MESSAGE_CLAIM           // The sender admitted this client, anyone else still holding it lets go
+};
+
+// A decoded server to server datagram, packet points into the receive buffer
+struct zone_message
+{
+    enum zone_message_type type;
+    struct sockaddr_in     client;
+    const uint8_t         *packet;
+};
+
+// Static partition of the world between server processes. Every node is given the same list,
+// so every node computes the same owner for a position without asking anyone.
+struct zone_cluster
+{
+    struct sockaddr_in nodes[MAX_ZONES];    // Client facing address of each zone server, peers talk on the same socket
+    uint32_t           count;               // 0 when this server runs the whole world alone
+    uint32_t           self;
+    uint64_t           handoffs_out;
+    uint64_t           handoffs_in;
+    uint64_t           forwarded;
+    uint64_t           ghosts_out;
+    uint64_t           ghosts_in;
+    uint64_t           redirects;
+    uint64_t           send_failures;
+};
+
+void     zone_cluster_init(const struct p101_env *env, struct p101_error *err, struct zone_cluster *cluster, const char *nodes_str, uint32_t self);
+uint32_t zone_owner(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t x);
+uint32_t zone_find_node(const struct p101_env *env, const struct zone_cluster *cluster, const struct sockaddr_in *addr);
+bool     zone_near_border(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t x, uint32_t neighbour);
+bool     zone_decode(const struct p101_env *env, struct zone_message *message, const uint8_t *data, size_t length);
+void     zone_write_message(const struct p101_env *env, enum zone_message_type type, const struct sockaddr_in *client, const uint8_t *packet, uint8_t *buffer);
+void     zone_write_redirect(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t zone, uint8_t *buffer);
+void     zone_cluster_print_stats(const struct p101_env *env, const struct zone_cluster *cluster);
+
+#endif    // UDP_GAME_ZONE_H
@@ -0,0 +1,264 @@
+#include "../include/capture.h"
+
+#define UINT32_BITS 32
+
+static void     put_u16(uint8_t **cursor, uint16_t value);
+static void     put_u32(uint8_t **cursor, uint32_t value);
+static uint16_t get_u16(const uint8_t **cursor);
+static uint32_t get_u32(const uint8_t **cursor);
+
+void capture_writer_open(const struct p101_env *env, struct p101_error *err, struct capture_writer *writer, const char *path)
+{
+    uint8_t  header[CAPTURE_FILE_HEADER_SIZE];
+    uint8_t *cursor;
+
+    P101_TRACE(env);
+
+    memset(writer, 0, sizeof(*writer));
+
+    writer->file = fopen(path, "wb");
+    if(writer->file == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "could not open capture file for writing", EXIT_FAILURE);
+        goto done;
+    }
+
+    // A large stream buffer keeps capture to roughly one write syscall per megabyte of traffic
+    setvbuf(writer->file, NULL, _IOFBF, CAPTURE_STREAM_BUFFER_SIZE);
+
+    memcpy(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+    cursor = header + CAPTURE_MAGIC_SIZE;
+    put_u32(&cursor, CAPTURE_VERSION);
+
+    if(fwrite(header, sizeof(header), 1, writer->file) != 1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not write capture file header", EXIT_FAILURE);
+        fclose(writer->file);
+        writer->file = NULL;
+        goto done;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &writer->start);
+
+done:
+    return;
+}
+
+bool capture_write(const struct p101_env *env, struct capture_writer *writer, const struct sockaddr *addr, const uint8_t *data, size_t length)
+{
+    uint8_t         header[CAPTURE_RECORD_HEADER_SIZE];
+    uint8_t        *cursor;
+    struct timespec now;
+    uint64_t        timestamp_ns;
+
+    P101_TRACE(env);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    timestamp_ns = (uint64_t)timespec_diff_ns(&now, &writer->start);
+
+    // Fields are stored big endian like the game packets, so a capture replays on any host
+    memset(header, 0, sizeof(header));
+    cursor = header;
+    put_u32(&cursor, (uint32_t)(timestamp_ns >> UINT32_BITS));
+    put_u32(&cursor, (uint32_t)timestamp_ns);
+    put_u16(&cursor, (uint16_t)addr->sa_family);
+
+    if(addr->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *addr6;
+
+        addr6 = (const struct sockaddr_in6 *)(const void *)addr;
+        memcpy(cursor, &addr6->sin6_port, sizeof(in_port_t));
+        memcpy(cursor + sizeof(in_port_t), &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+    }
+    else
+    {
+        const struct sockaddr_in *addr4;
+
+        addr4 = (const struct sockaddr_in *)(const void *)addr;
+        memcpy(cursor, &addr4->sin_port, sizeof(in_port_t));
+        memcpy(cursor + sizeof(in_port_t), &addr4->sin_addr, sizeof(addr4->sin_addr));
+    }
+    cursor += sizeof(in_port_t) + CAPTURE_ADDRESS_SIZE;
+    put_u32(&cursor, (uint32_t)length);
+
+    if(fwrite(header, sizeof(header), 1, writer->file) != 1 || (length > 0 && fwrite(data, length, 1, writer->file) != 1))
+    {
+        return false;
+    }
+
+    writer->records++;
+    writer->bytes += sizeof(header) + length;
+
+    return true;
+}
+
+void capture_writer_close(const struct p101_env *env, struct capture_writer *writer)
+{
+    P101_TRACE(env);
+
+    if(writer->file == NULL)
+    {
+        return;
+    }
+
+    if(fclose(writer->file) != 0)
+    {
+        perror("capture fclose");
+    }
+
+    writer->file = NULL;
+    printf("Captured %" PRIu64 " datagrams (%" PRIu64 " bytes)\n", writer->records, writer->bytes);
+}
+
+void capture_reader_open(const struct p101_env *env, struct p101_error *err, struct capture_reader *reader, const char *path)
+{
+    uint8_t        header[CAPTURE_FILE_HEADER_SIZE];
+    const uint8_t *cursor;
+
+    P101_TRACE(env);
+
+    memset(reader, 0, sizeof(*reader));
+
+    reader->file = fopen(path, "rb");
+    if(reader->file == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "could not open capture file for reading", EXIT_FAILURE);
+        goto done;
+    }
+
+    setvbuf(reader->file, NULL, _IOFBF, CAPTURE_STREAM_BUFFER_SIZE);
+
+    if(fread(header, sizeof(header), 1, reader->file) != 1 || memcmp(header, CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE) != 0)
+    {
+        P101_ERROR_RAISE_USER(err, "not a capture file", EXIT_FAILURE);
+        goto close_file;
+    }
+
+    cursor = header + CAPTURE_MAGIC_SIZE;
+    if(get_u32(&cursor) != CAPTURE_VERSION)
+    {
+        P101_ERROR_RAISE_USER(err, "unsupported capture file version", EXIT_FAILURE);
+        goto close_file;
+    }
+
+    goto done;
+
+close_file:
+    fclose(reader->file);
+    reader->file = NULL;
+
+done:
+    return;
+}
+
+bool capture_read(const struct p101_env *env, struct p101_error *err, struct capture_reader *reader, struct capture_record *record, uint8_t *payload, size_t capacity)
+{
+    uint8_t        header[CAPTURE_RECORD_HEADER_SIZE];
+    const uint8_t *cursor;
+    uint16_t       family;
+    uint32_t       high;
+
+    P101_TRACE(env);
+
+    if(fread(header, sizeof(header), 1, reader->file) != 1)
+    {
+        if(ferror(reader->file))
+        {
+            P101_ERROR_RAISE_USER(err, "capture file read failed", EXIT_FAILURE);
+        }
+        return false;
+    }
+
+    cursor               = header;
+    high                 = get_u32(&cursor);
+    record->timestamp_ns = ((uint64_t)high << UINT32_BITS) | get_u32(&cursor);
+    family               = get_u16(&cursor);
+
+    memset(&record->addr, 0, sizeof(record->addr));
+    if(family == AF_INET6)
+    {
+        struct sockaddr_in6 *addr6;
+
+        addr6              = (struct sockaddr_in6 *)&record->addr;
+        addr6->sin6_family = AF_INET6;
+        memcpy(&addr6->sin6_port, cursor, sizeof(in_port_t));
+        memcpy(&addr6->sin6_addr, cursor + sizeof(in_port_t), sizeof(addr6->sin6_addr));
+        record->addr_len = sizeof(*addr6);
+    }
+    else
+    {
+        struct sockaddr_in *addr4;
+
+        addr4             = (struct sockaddr_in *)&record->addr;
+        addr4->sin_family = AF_INET;
+        memcpy(&addr4->sin_port, cursor, sizeof(in_port_t));
+        memcpy(&addr4->sin_addr, cursor + sizeof(in_port_t), sizeof(addr4->sin_addr));
+        record->addr_len = sizeof(*addr4);
+    }
+    cursor += sizeof(in_port_t) + CAPTURE_ADDRESS_SIZE;
+    record->length = get_u32(&cursor);
+
+    if(record->length > capacity)
+    {
+        P101_ERROR_RAISE_USER(err, "capture record larger than the replay buffer", EXIT_FAILURE);
+        return false;
+    }
+
+    if(record->length > 0 && fread(payload, record->length, 1, reader->file) != 1)
+    {
+        P101_ERROR_RAISE_USER(err, "capture file truncated", EXIT_FAILURE);
+        return false;
+    }
+
+    reader->records++;
+
+    return true;
+}
+
+void capture_reader_close(const struct p101_env *env, struct capture_reader *reader)
+{
+    P101_TRACE(env);
+
+    if(reader->file != NULL)
+    {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+}
+
+static void put_u16(uint8_t **cursor, uint16_t value)
+{
+    uint16_t net;
+
+    net = htons(value);
+    memcpy(*cursor, &net, sizeof(net));
+    *cursor += sizeof(net);
+}
+
+static void put_u32(uint8_t **cursor, uint32_t value)
+{
+    uint32_t net;
+
+    net = htonl(value);
+    memcpy(*cursor, &net, sizeof(net));
+    *cursor += sizeof(net);
+}
+
+static uint16_t get_u16(const uint8_t **cursor)
+{
+    uint16_t net;
+
+    memcpy(&net, *cursor, sizeof(net));
+    *cursor += sizeof(net);
+    return ntohs(net);
+}
+
+static uint32_t get_u32(const uint8_t **cursor)
+{
+    uint32_t net;
+
+    memcpy(&net, *cursor, sizeof(net));
+    *cursor += sizeof(net);
+    return ntohl(net);
+}
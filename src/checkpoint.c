@@ -0,0 +1,156 @@
+#include "../include/checkpoint.h"
+
+static bool region_is_valid(const struct checkpoint_region *region);
+static void flush_region(struct checkpoint *checkpoint, int flags);
+
+void checkpoint_open(const struct p101_env *env, struct p101_error *err, struct checkpoint *checkpoint, const char *path)
+{
+    struct stat status;
+    void       *mapping;
+
+    P101_TRACE(env);
+
+    memset(checkpoint, 0, sizeof(*checkpoint));
+
+    checkpoint->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if(checkpoint->fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not open checkpoint file", EXIT_FAILURE);
+        goto done;
+    }
+
+    if(fstat(checkpoint->fd, &status) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not stat checkpoint file", EXIT_FAILURE);
+        goto close_file;
+    }
+
+    if((size_t)status.st_size != sizeof(struct checkpoint_region) && ftruncate(checkpoint->fd, (off_t)sizeof(struct checkpoint_region)) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not size checkpoint file", EXIT_FAILURE);
+        goto close_file;
+    }
+
+    // Mapping is the whole load, pages are only read when the restore walks the entries
+    mapping = mmap(NULL, sizeof(struct checkpoint_region), PROT_READ | PROT_WRITE, MAP_SHARED, checkpoint->fd, 0);
+    if(mapping == MAP_FAILED)
+    {
+        P101_ERROR_RAISE_USER(err, "could not map checkpoint file", EXIT_FAILURE);
+        goto close_file;
+    }
+    checkpoint->region = (struct checkpoint_region *)mapping;
+
+    if((size_t)status.st_size == sizeof(struct checkpoint_region) && region_is_valid(checkpoint->region))
+    {
+        checkpoint->restored = true;
+        printf("Checkpoint generation %" PRIu64 " from %" PRIu64 " found\n", checkpoint->region->generation, checkpoint->region->saved_at);
+    }
+    else
+    {
+        if(status.st_size != 0)
+        {
+            fprintf(stderr, "Warning: checkpoint file has an unknown layout, starting with an empty world\n");
+        }
+
+        memset(checkpoint->region, 0, sizeof(*checkpoint->region));
+        checkpoint->region->magic       = CHECKPOINT_MAGIC;
+        checkpoint->region->version     = CHECKPOINT_VERSION;
+        checkpoint->region->entry_count = MAX_CLIENTS;
+        checkpoint->region->entry_size  = sizeof(struct checkpoint_entry);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &checkpoint->last_sync);
+    goto done;
+
+close_file:
+    close(checkpoint->fd);
+    checkpoint->fd = -1;
+
+done:
+    return;
+}
+
+void checkpoint_record_join(const struct p101_env *env, struct checkpoint *checkpoint, int client_index, const struct sockaddr_in *addr, uint32_t room_id, const struct coordinates *coordinates)
+{
+    struct checkpoint_entry *entry;
+
+    P101_TRACE(env);
+
+    entry              = &checkpoint->region->entries[client_index];
+    entry->room_id     = room_id;
+    entry->address     = addr->sin_addr.s_addr;
+    entry->port        = addr->sin_port;
+    entry->coordinates = *coordinates;
+
+    // Flag last, a crash part way through leaves an inactive slot rather than half a client
+    atomic_store_explicit(&entry->active, 1, memory_order_release);
+}
+
+void checkpoint_record_move(const struct p101_env *env, struct checkpoint *checkpoint, int client_index, const struct coordinates *coordinates)
+{
+    P101_TRACE(env);
+
+    checkpoint->region->entries[client_index].coordinates = *coordinates;
+}
+
+void checkpoint_record_leave(const struct p101_env *env, struct checkpoint *checkpoint, int client_index)
+{
+    P101_TRACE(env);
+
+    atomic_store_explicit(&checkpoint->region->entries[client_index].active, 0, memory_order_relaxed);
+}
+
+// Called once per receive batch. The entries are already in the page cache, this only asks the
+// kernel to start writing them out every so often so a machine crash loses at most one interval.
+void checkpoint_sync(const struct p101_env *env, struct checkpoint *checkpoint)
+{
+    struct timespec now;
+
+    P101_TRACE(env);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(timespec_diff_ns(&now, &checkpoint->last_sync) < CHECKPOINT_SYNC_INTERVAL_NS)
+    {
+        return;
+    }
+
+    checkpoint->last_sync = now;
+    flush_region(checkpoint, MS_ASYNC);
+}
+
+void checkpoint_close(const struct p101_env *env, struct checkpoint *checkpoint)
+{
+    P101_TRACE(env);
+
+    if(checkpoint->region != NULL)
+    {
+        flush_region(checkpoint, MS_SYNC);
+        munmap(checkpoint->region, sizeof(*checkpoint->region));
+        checkpoint->region = NULL;
+    }
+
+    if(checkpoint->fd != -1)
+    {
+        close(checkpoint->fd);
+        checkpoint->fd = -1;
+    }
+}
+
+static bool region_is_valid(const struct checkpoint_region *region)
+{
+    return region->magic == CHECKPOINT_MAGIC && region->version == CHECKPOINT_VERSION && region->entry_count == MAX_CLIENTS && region->entry_size == sizeof(struct checkpoint_entry);
+}
+
+static void flush_region(struct checkpoint *checkpoint, int flags)
+{
+    struct timespec wall;
+
+    clock_gettime(CLOCK_REALTIME, &wall);
+    checkpoint->region->generation++;
+    checkpoint->region->saved_at = (uint64_t)wall.tv_sec;
+
+    if(msync(checkpoint->region, sizeof(*checkpoint->region), flags) == -1)
+    {
+        perror("checkpoint msync failed");
+    }
+}
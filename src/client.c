@@ -1,6 +1,10 @@
+#include "../include/clock_sync.h"
 #include "../include/convert.h"
 #include "../include/display.h"
+#include "../include/metrics.h"
 #include "../include/network.h"
+#include "../include/send_rate.h"
+#include "../include/socket_options.h"
 #include <ncurses.h>
 #include <p101_c/p101_string.h>
 #include <stdio.h>
@@ -13,27 +17,38 @@
 #define WINDOW_X_LENGTH 100
 
 #define UNKNOWN_OPTION_MESSAGE_LEN 24
-#define REQUIRED_ARGS_NUM 9
+#define CLIENT_DATAGRAM_SIZE 1472    // Largest datagram the server sends, a snapshot of position packets back to back
 
 static void           parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
 static void           check_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
 static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct context *context);
+static bool           from_server(const struct sockaddr_storage *from, const struct sockaddr_storage *server);
 
 int main(int argc, char *argv[])
 {
-    WINDOW            *w;
-    const char        *player = ".";
-    int                ch;
-    int                ret_val;
-    struct p101_env   *env;
-    struct p101_error *error;
-    struct arguments   arguments;
-    struct context     context;
-    struct coordinates coordinates      = {0};
-    struct coordinates read_coordinates = {0};
-    uint8_t            buffer[sizeof(coordinates.old_x) + sizeof(coordinates.old_y) + sizeof(coordinates.new_x) + sizeof(coordinates.new_y)];
-    fd_set             readfds;
-    int                maxfd;
+    WINDOW               *w;
+    const char           *player = ".";
+    int                   ch;
+    int                   ret_val;
+    struct p101_env      *env;
+    struct p101_error    *error;
+    struct arguments      arguments;
+    struct context        context;
+    struct coordinates    coordinates      = {0};
+    struct coordinates    read_coordinates = {0};
+    struct packet_header  header           = {0};
+    struct packet_header  read_header      = {0};
+    struct viewport       view;
+    struct clock_sync     sync;
+    struct snapshot_acker acker;
+    struct latency_stats  receive_latency;
+    bool                  spectating;
+    bool                  joined;
+    uint8_t               buffer[POSITION_PACKET_SIZE + CLOCK_STAMP_SIZE];
+    uint8_t               datagram[CLIENT_DATAGRAM_SIZE];
+    fd_set                readfds;
+    int                   maxfd;
+    size_t                length;
 
     error = p101_error_create(false);
     if(error == NULL)
@@ -71,13 +86,52 @@ int main(int argc, char *argv[])
         goto free_env;
     }
 
-    socket_bind(env, error, context.settings.sockfd, context.settings.src_port, &context.settings.src_addr);
+    // A spectator binds the group's port and joins the group, the server's snapshots arrive there instead of at an address of its own
+    spectating = context.settings.group_addr_len != 0;
+    if(spectating)
+    {
+        struct sockaddr_storage group_bind_addr;
+
+        socket_share_port(env, error, context.settings.sockfd);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_socket;
+        }
+
+        group_bind_addr = context.settings.group_addr;
+        socket_bind(env, error, context.settings.sockfd, ntohs(((struct sockaddr_in *)&group_bind_addr)->sin_port), &group_bind_addr);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_socket;
+        }
+
+        socket_join_group(env, error, context.settings.sockfd, &context.settings.group_addr, &context.settings.src_addr);
+    }
+    else
+    {
+        socket_bind(env, error, context.settings.sockfd, context.settings.src_port, &context.settings.src_addr);
+    }
+
     if(p101_error_has_error(error))
     {
         ret_val = EXIT_FAILURE;
         goto close_socket;
     }
 
+    socket_apply_options(env, error, context.settings.sockfd, context.settings.src_addr.ss_family, &context.settings.options);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto close_socket;
+    }
+
+    clock_sync_reset(&sync);
+    snapshot_acker_reset(&acker);
+    latency_stats_init(env, &receive_latency);
+    joined            = false;
+    header.room       = context.settings.room;
     coordinates.old_x = INITIAL_X;
     coordinates.old_y = INITIAL_Y;
     coordinates.new_x = INITIAL_X;
@@ -86,10 +140,27 @@ int main(int argc, char *argv[])
     initscr();                                             // initialize Ncurses
     w = newwin(WINDOW_Y_LENGTH, WINDOW_X_LENGTH, 1, 1);    // create a new window
     setup_window(w, &coordinates, player);
+    viewport_init(&view, WINDOW_X_LENGTH - 2, WINDOW_Y_LENGTH - 2);    // The border takes a row and a column on each side
+    if(spectating)
+    {
+        // The arrows steer a camera in the middle of the window rather than a character
+        coordinates.new_x = view.origin_x + view.columns / 2;
+        coordinates.new_y = view.origin_y + view.rows / 2;
+        viewport_draw(w, &view, NULL, player);
+    }
     while(1)    // get the input
     {
         struct timeval timeout;
 
+        // Once we have joined, keep our idea of the server's clock fresh so every move can say what time we saw
+        if(joined && clock_sync_ping_due(&sync, clock_now_us()))
+        {
+            header.sequence++;
+            clock_sync_write_ping(env, &sync, &header, &coordinates, clock_now_us(), buffer);
+            socket_write_full(env, context.settings.sockfd, buffer, POSITION_PACKET_SIZE, (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);
+            memset(buffer, 0, sizeof(buffer));
+        }
+
         // Clear the socket set
         FD_ZERO(&readfds);
 
@@ -111,21 +182,108 @@ int main(int argc, char *argv[])
         // If activity is on the socket (reading)
         if(FD_ISSET(context.settings.sockfd, &readfds))
         {
-            ssize_t bytes_read;
-            bytes_read = socket_read_full(env, context.settings.sockfd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&context.settings.src_addr, context.settings.dest_addr_len);
-            if(bytes_read > 0)
+            struct receive_metadata metadata;
+            struct sockaddr_storage from;
+            socklen_t               addr_len;
+            ssize_t                 bytes_read;
+
+            // The server may pack several position packets into one datagram
+            memset(&from, 0, sizeof(from));
+            addr_len   = sizeof(from);
+            bytes_read = socket_read_message(env, context.settings.sockfd, datagram, sizeof(datagram), MSG_DONTWAIT, (struct sockaddr *)&from, &addr_len, &metadata);
+            for(size_t offset = 0; bytes_read > 0 && offset + POSITION_PACKET_SIZE <= (size_t)bytes_read; offset += POSITION_PACKET_SIZE)
             {
-                deserialize_position_from_buffer(env, &read_coordinates, buffer);
-                mvwprintw(w, (int)read_coordinates.old_y, (int)read_coordinates.old_x, "%s", " ");
-                if(read_coordinates.new_x == EXIT_COORDINATE && read_coordinates.new_y == EXIT_COORDINATE)
+                const uint8_t *record;
+
+                record = datagram + offset;
+                deserialize_header_from_buffer(env, &read_header, record);
+                deserialize_position_from_buffer(env, &read_coordinates, record + PACKET_HEADER_SIZE);
+                if(spectating)
+                {
+                    // The group carries every room, and a spectator sees all of the world
+                    if(read_header.room == context.settings.room)
+                    {
+                        viewport_apply(&view, &read_coordinates);
+                        viewport_draw(w, &view, NULL, player);
+                    }
+                    continue;
+                }
+                if(snapshot_acker_read(env, &acker, &read_header, &read_coordinates))
+                {
+                    continue;
+                }
+                if(read_coordinates.new_x == REDIRECT_COORDINATE && read_coordinates.new_y == REDIRECT_COORDINATE)
+                {
+                    // We walked into another server's zone, it gets our moves from now on. Only the server we
+                    // play on may send us elsewhere, anyone else could take the session wherever they liked.
+                    if(!from_server(&from, &context.settings.dest_addr))
+                    {
+                        continue;
+                    }
+
+                    if(context.settings.dest_addr.ss_family == AF_INET)
+                    {
+                        struct sockaddr_in *dest;
+
+                        dest                  = (struct sockaddr_in *)&context.settings.dest_addr;
+                        dest->sin_addr.s_addr = htonl(read_coordinates.old_x);
+                        dest->sin_port        = htons((in_port_t)read_coordinates.old_y);
+                    }
+                    clock_sync_reset(&sync);         // The new server keeps a clock of its own
+                    snapshot_acker_reset(&acker);    // And numbers its snapshots afresh
+                    continue;
+                }
+                if(is_ping(&read_coordinates))
+                {
+                    clock_sync_read_pong(env, &sync, record, clock_now_us());
+                    continue;
+                }
+                if(read_coordinates.new_x == CORRECTION_COORDINATE && read_coordinates.new_y == CORRECTION_COORDINATE)
                 {
-                    mvwprintw(w, (int)read_coordinates.old_y, (int)read_coordinates.old_x, "%s", " ");
+                    // Someone stood where we stepped, the server kept us on our old cell
+                    coordinates.old_x = read_coordinates.old_x;
+                    coordinates.old_y = read_coordinates.old_y;
+                    coordinates.new_x = read_coordinates.old_x;
+                    coordinates.new_y = read_coordinates.old_y;
+                    viewport_follow(&view, coordinates.new_x, coordinates.new_y);
+                    viewport_draw(w, &view, &coordinates, player);
+                    continue;
                 }
-                else
+                if(read_coordinates.new_x == COOKIE_COORDINATE && read_coordinates.new_y == COOKIE_COORDINATE)
                 {
-                    mvwprintw(w, (int)read_coordinates.new_y, (int)read_coordinates.new_x, "%s", player);
+                    uint8_t  answer[POSITION_PACKET_SIZE + JOIN_COOKIE_SIZE];
+                    uint32_t cookie[2];
+
+                    // The server wants proof we receive at this address before it lets us in, send our position again with its cookie
+                    cookie[0] = htonl(read_coordinates.old_x);
+                    cookie[1] = htonl(read_coordinates.old_y);
+                    header.sequence++;
+                    serialize_header_to_buffer(env, &header, answer);
+                    serialize_position_to_buffer(env, &coordinates, answer + PACKET_HEADER_SIZE);
+                    memcpy(answer + POSITION_PACKET_SIZE, cookie, sizeof(cookie));
+                    socket_write_full(env, context.settings.sockfd, answer, sizeof(answer), (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);
+                    continue;
                 }
-                wrefresh(w);
+                viewport_apply(&view, &read_coordinates);                                // An exit lands outside the world and just removes the player
+                viewport_forget_distant(&view, coordinates.new_x, coordinates.new_y);    // A player walking out of our view is not heard of again
+                viewport_draw(w, &view, &coordinates, player);
+            }
+
+            // With -t the kernel stamped the datagram, how long it waited for us shows how far behind we run
+            if(bytes_read > 0 && metadata.rx_time.tv_sec != 0)
+            {
+                struct timespec now;
+
+                clock_gettime(CLOCK_REALTIME, &now);
+                latency_stats_record(env, &receive_latency, timespec_diff_ns(&now, &metadata.rx_time));
+            }
+
+            // Tell the server what arrived, so it can send less or less often when our path is losing packets
+            if(snapshot_acker_ack_due(&acker, clock_now_us()))
+            {
+                header.sequence++;
+                snapshot_acker_write_ack(env, &acker, &header, clock_now_us(), buffer);
+                socket_write_full(env, context.settings.sockfd, buffer, POSITION_PACKET_SIZE, (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);
                 memset(buffer, 0, sizeof(buffer));
             }
         }
@@ -147,16 +305,14 @@ int main(int argc, char *argv[])
                         coordinates.old_x = coordinates.new_x;
                         coordinates.old_y = coordinates.new_y;
                         coordinates.new_y--;
-                        mvwprintw(w, (int)coordinates.new_y + 1, (int)coordinates.new_x, "%s", " ");    // replace old character position with space
                     }
                     break;
                 case KEY_DOWN:
-                    if(coordinates.new_y != WINDOW_Y_LENGTH - 2)
+                    if(coordinates.new_y != WORLD_ROWS - 2)
                     {
                         coordinates.old_x = coordinates.new_x;
                         coordinates.old_y = coordinates.new_y;
                         coordinates.new_y++;
-                        mvwprintw(w, (int)coordinates.new_y - 1, (int)coordinates.new_x, "%s", " ");    // replace old character position with space
                     }
                     break;
                 case KEY_LEFT:
@@ -165,38 +321,73 @@ int main(int argc, char *argv[])
                         coordinates.old_x = coordinates.new_x;
                         coordinates.old_y = coordinates.new_y;
                         coordinates.new_x--;
-                        mvwprintw(w, (int)coordinates.new_y, (int)coordinates.new_x + 1, "%s", " ");    // replace old character position with space
                     }
                     break;
                 case KEY_RIGHT:
-                    if(coordinates.new_x != WINDOW_X_LENGTH - 2)
+                    if(coordinates.new_x != WORLD_COLUMNS - 2)
                     {
                         coordinates.old_x = coordinates.new_x;
                         coordinates.old_y = coordinates.new_y;
                         coordinates.new_x++;
-                        mvwprintw(w, (int)coordinates.new_y, (int)coordinates.new_x - 1, "%s", " ");    // replace old character position with space
                     }
                     break;
                 default:
                     break;
             }
-            mvwprintw(w, (int)coordinates.new_y, (int)coordinates.new_x, "%s", player);                                                                                 // update the characters position
-            wrefresh(w);                                                                                                                                                // update the terminal screen
-            serialize_position_to_buffer(env, &coordinates, buffer);                                                                                                    // Serialize the coordinates struct
-            socket_write_full(env, context.settings.sockfd, buffer, sizeof(buffer), (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);    // Send updated coordinates to server
+
+            if(spectating)
+            {
+                viewport_center(&view, coordinates.new_x, coordinates.new_y);
+                viewport_draw(w, &view, NULL, player);
+                continue;
+            }
+
+            // Whoever we last heard of outside our new view is no longer kept up to date by the server
+            if(coordinates.old_x / WORLD_CHUNK_COLUMNS != coordinates.new_x / WORLD_CHUNK_COLUMNS || coordinates.old_y / WORLD_CHUNK_ROWS != coordinates.new_y / WORLD_CHUNK_ROWS)
+            {
+                viewport_forget_distant(&view, coordinates.new_x, coordinates.new_y);
+            }
+            viewport_follow(&view, coordinates.new_x, coordinates.new_y);
+            viewport_draw(w, &view, &coordinates, player);                                   // Redraw around the character's new position
+            header.sequence++;
+            serialize_header_to_buffer(env, &header, buffer);                                // Stamp the packet with the next sequence number
+            serialize_position_to_buffer(env, &coordinates, buffer + PACKET_HEADER_SIZE);    // Serialize the coordinates struct
+            length = POSITION_PACKET_SIZE;
+            if(sync.synced)
+            {
+                // Tell the server when the world we moved in was current, so it judges the move against that
+                serialize_stamp_to_buffer(env, clock_sync_view_time(&sync, clock_now_us()), buffer + POSITION_PACKET_SIZE);
+                length += CLOCK_STAMP_SIZE;
+            }
+            socket_write_full(env, context.settings.sockfd, buffer, length, (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);    // Send updated coordinates to server
             memset(buffer, 0, sizeof(buffer));
+            joined = true;
         }
     }
     delwin(w);
     endwin();
 
+    if(context.arguments->timestamps)
+    {
+        latency_stats_print(env, &receive_latency, "Kernel receive to drawn");
+    }
+
+    // A spectator never joined, there is nobody to tell it is leaving
+    if(spectating)
+    {
+        ret_val = EXIT_SUCCESS;
+        goto close_socket;
+    }
+
     // write the exit coords to server
     coordinates.old_x = coordinates.new_x;
     coordinates.old_y = coordinates.new_y;
     coordinates.new_x = EXIT_COORDINATE;
     coordinates.new_y = EXIT_COORDINATE;
-    serialize_position_to_buffer(env, &coordinates, buffer);
-    socket_write_full(env, context.settings.sockfd, buffer, sizeof(buffer), (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);
+    header.sequence++;
+    serialize_header_to_buffer(env, &header, buffer);
+    serialize_position_to_buffer(env, &coordinates, buffer + PACKET_HEADER_SIZE);
+    socket_write_full(env, context.settings.sockfd, buffer, POSITION_PACKET_SIZE, (struct sockaddr *)&context.settings.dest_addr, context.settings.dest_addr_len);
 
     ret_val = EXIT_SUCCESS;
 
@@ -228,7 +419,7 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
     context->arguments->program_name = context->arguments->argv[0];
     opterr                           = 0;
 
-    while((opt = getopt(context->arguments->argc, context->arguments->argv, "hA:P:a:p:")) != -1)
+    while((opt = getopt(context->arguments->argc, context->arguments->argv, "hA:P:a:p:R:M:m:r:s:b:d:tz")) != -1)
     {
         switch(opt)
         {
@@ -253,6 +444,51 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
                 printf("dest port: %s\n", optarg);
                 break;
             }
+            case 'R':    // Room argument
+            {
+                context->arguments->room_str = optarg;
+                break;
+            }
+            case 'M':    // Multicast group address argument
+            {
+                context->arguments->group_ip_address = optarg;
+                break;
+            }
+            case 'm':    // Multicast group port argument
+            {
+                context->arguments->group_port_str = optarg;
+                break;
+            }
+            case 'r':    // Receive buffer size argument
+            {
+                context->arguments->rcvbuf_str = optarg;
+                break;
+            }
+            case 's':    // Send buffer size argument
+            {
+                context->arguments->sndbuf_str = optarg;
+                break;
+            }
+            case 'b':    // Busy poll argument
+            {
+                context->arguments->busy_poll_str = optarg;
+                break;
+            }
+            case 'd':    // DSCP argument
+            {
+                context->arguments->dscp_str = optarg;
+                break;
+            }
+            case 't':    // Kernel receive timestamps argument
+            {
+                context->arguments->timestamps = true;
+                break;
+            }
+            case 'z':    // Zero copy argument
+            {
+                context->arguments->zerocopy = true;
+                break;
+            }
             case 'h':    // Help argument
             {
                 goto usage;
@@ -273,7 +509,7 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
         }
     }
 
-    if(optind > REQUIRED_ARGS_NUM)
+    if(optind < context->arguments->argc)
     {
         context->exit_message = p101_strdup(env, err, "Too many arguments.");
         goto usage;
@@ -295,6 +531,13 @@ static void check_arguments(struct p101_env *env, struct p101_error *err, struct
         goto usage;
     }
 
+    // A spectator only needs the interface to join the group on
+    if(context->arguments->group_ip_address != NULL)
+    {
+        context->settings.src_ip_address = context->arguments->src_ip_address;
+        return;
+    }
+
     if(context->arguments->src_port_str == NULL)
     {
         context->exit_message = p101_strdup(env, err, "<source port> must be passed.");
@@ -332,13 +575,22 @@ static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct
         fprintf(stderr, "%s\n", context->exit_message);
     }
 
-    fprintf(stderr, "Usage: %s [-h] -a <source ip_address> -p <source port> -A <destination ip address> -P <destination port>\n", context->arguments->program_name);
+    fprintf(stderr, "Usage: %s [-h] -a <source ip_address> -p <source port> -A <destination ip address> -P <destination port> [-R <room>] [-M <group> -m <port>] [-r <bytes>] [-s <bytes>] [-b <usec>] [-d <dscp>] [-t] [-z]\n", context->arguments->program_name);
     fputs("Options:\n", stderr);
     fputs("  -h Display this help message\n", stderr);
     fputs("  -a <source ip_address>  Option 'a' (required) with an IP Address.\n", stderr);
     fputs("  -p <source port>        Option 'p' (required) with a port.\n", stderr);
     fputs("  -a <destination ip_address>  Option 'A' (required) with an IP Address.\n", stderr);
     fputs("  -p <destination port>        Option 'P' (required) with a port.\n", stderr);
+    fputs("  -R <room>                    Option 'R' (optional) room to join, defaults to 0.\n", stderr);
+    fputs("  -M <group>                   Option 'M' (optional) watch the room as a spectator through this multicast group, no source port or destination needed.\n", stderr);
+    fputs("  -m <port>                    Option 'm' (optional) port of the multicast group, required with -M.\n", stderr);
+    fputs("  -r <bytes>                   Option 'r' (optional) socket receive buffer size.\n", stderr);
+    fputs("  -s <bytes>                   Option 's' (optional) socket send buffer size.\n", stderr);
+    fputs("  -b <usec>                    Option 'b' (optional) busy poll timeout in microseconds.\n", stderr);
+    fputs("  -d <dscp>                    Option 'd' (optional) DSCP code point for outgoing packets.\n", stderr);
+    fputs("  -t                           Option 't' (optional) enable kernel receive timestamps and report how long datagrams wait to be drawn.\n", stderr);
+    fputs("  -z                           Option 'z' (optional) enable SO_ZEROCOPY on the socket.\n", stderr);
 
     free(context->exit_message);
     free(env);
@@ -348,3 +600,34 @@ static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct
     printf("Exit code: %d\n", context->exit_code);
     exit(context->exit_code);
 }
+
+// Whether a datagram's source is the server we send to, address and port both
+static bool from_server(const struct sockaddr_storage *from, const struct sockaddr_storage *server)
+{
+    if(from->ss_family != server->ss_family)
+    {
+        return false;
+    }
+
+    if(from->ss_family == AF_INET)
+    {
+        const struct sockaddr_in *from_in;
+        const struct sockaddr_in *server_in;
+
+        from_in   = (const struct sockaddr_in *)from;
+        server_in = (const struct sockaddr_in *)server;
+        return from_in->sin_addr.s_addr == server_in->sin_addr.s_addr && from_in->sin_port == server_in->sin_port;
+    }
+
+    if(from->ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *from_in6;
+        const struct sockaddr_in6 *server_in6;
+
+        from_in6   = (const struct sockaddr_in6 *)from;
+        server_in6 = (const struct sockaddr_in6 *)server;
+        return memcmp(&from_in6->sin6_addr, &server_in6->sin6_addr, sizeof(from_in6->sin6_addr)) == 0 && from_in6->sin6_port == server_in6->sin6_port;
+    }
+
+    return false;
+}
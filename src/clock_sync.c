@@ -0,0 +1,127 @@
+#include "../include/clock_sync.h"
+
+static void pick_offset(struct clock_sync *sync);
+
+int64_t clock_now_us(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * MICROSECONDS_PER_SECOND + now.tv_nsec / NANOSECONDS_PER_MICROSECOND;
+}
+
+// Starts over, for a new server whose clock has nothing to do with the last one's
+void clock_sync_reset(struct clock_sync *sync)
+{
+    memset(sync, 0, sizeof(*sync));
+}
+
+// Pings come faster until the first pong, and a lost ping is simply replaced by the next one
+bool clock_sync_ping_due(const struct clock_sync *sync, int64_t now_us)
+{
+    return now_us - sync->last_ping_us >= (sync->synced ? CLOCK_PING_INTERVAL_US : CLOCK_FIRST_PING_INTERVAL_US);
+}
+
+// A ping is a position packet with the ping sentinel, the header identifies it when the pong comes back
+void clock_sync_write_ping(const struct p101_env *env, struct clock_sync *sync, const struct packet_header *header, const struct coordinates *coordinates, int64_t now_us, uint8_t *buffer)
+{
+    struct coordinates ping;
+
+    P101_TRACE(env);
+
+    ping.old_x = coordinates->new_x;
+    ping.old_y = coordinates->new_y;
+    ping.new_x = PING_COORDINATE;
+    ping.new_y = PING_COORDINATE;
+    serialize_header_to_buffer(env, header, buffer);
+    serialize_position_to_buffer(env, &ping, buffer + PACKET_HEADER_SIZE);
+
+    sync->ping_sequence = header->sequence;
+    sync->ping_sent_us  = now_us;
+    sync->last_ping_us  = now_us;
+}
+
+// Takes a pong. Returns false if it is not the answer to the ping still outstanding.
+bool clock_sync_read_pong(const struct p101_env *env, struct clock_sync *sync, const uint8_t *packet, int64_t now_us)
+{
+    struct packet_header header;
+    struct clock_sample *sample;
+    int64_t              server_us;
+
+    P101_TRACE(env);
+
+    deserialize_header_from_buffer(env, &header, packet);
+    if(sync->ping_sent_us == 0 || header.sequence != sync->ping_sequence)
+    {
+        return false;
+    }
+
+    // The server read its clock somewhere between our send and this receive, take the middle
+    server_us          = deserialize_stamp_from_buffer(env, packet + PACKET_HEADER_SIZE);
+    sample             = &sync->samples[sync->next_sample];
+    sample->rtt_us     = now_us - sync->ping_sent_us;
+    sample->offset_us  = server_us - (sync->ping_sent_us + sample->rtt_us / 2);
+    sync->next_sample  = (sync->next_sample + 1) % CLOCK_SYNC_SAMPLES;
+    sync->ping_sent_us = 0;
+    if(sync->sample_count < CLOCK_SYNC_SAMPLES)
+    {
+        sync->sample_count++;
+    }
+
+    if(sync->synced)
+    {
+        sync->rtt_us += (sample->rtt_us - sync->rtt_us) / RTT_SMOOTHING;
+    }
+    else
+    {
+        sync->rtt_us = sample->rtt_us;
+        sync->synced = true;
+    }
+
+    pick_offset(sync);
+    return true;
+}
+
+// The server time of the world as we see it now. What we draw left the server half a round trip ago.
+int64_t clock_sync_view_time(const struct clock_sync *sync, int64_t now_us)
+{
+    return now_us + sync->offset_us - sync->rtt_us / 2;
+}
+
+// Echoes the ping's header with the server's clock where the ping had the client's position. The pong
+// is the size of the ping, so it is no use for amplification. buffer holds POSITION_PACKET_SIZE bytes.
+void clock_write_pong(const struct p101_env *env, const struct packet_header *header, int64_t now_us, uint8_t *buffer)
+{
+    struct coordinates pong;
+
+    P101_TRACE(env);
+
+    pong.old_x = 0;
+    pong.old_y = 0;
+    pong.new_x = PING_COORDINATE;
+    pong.new_y = PING_COORDINATE;
+    serialize_header_to_buffer(env, header, buffer);
+    serialize_position_to_buffer(env, &pong, buffer + PACKET_HEADER_SIZE);
+    serialize_stamp_to_buffer(env, now_us, buffer + PACKET_HEADER_SIZE);    // old_x and old_y
+}
+
+bool is_ping(const struct coordinates *coordinates)
+{
+    return coordinates->new_x == PING_COORDINATE && coordinates->new_y == PING_COORDINATE;
+}
+
+static void pick_offset(struct clock_sync *sync)
+{
+    const struct clock_sample *best;
+
+    best = &sync->samples[0];
+    for(uint32_t i = 1; i < sync->sample_count; i++)
+    {
+        if(sync->samples[i].rtt_us < best->rtt_us)
+        {
+            best = &sync->samples[i];
+        }
+    }
+
+    sync->offset_us = best->offset_us;
+}
@@ -4,13 +4,70 @@ void convert_client_args(const struct p101_env *env, struct p101_error *err, str
 {
     P101_TRACE(env);
 
-    context->settings.src_port = parse_in_port_t(env, err, context->arguments->src_port_str);
+    convert_address(env, err, context->settings.src_ip_address, &context->settings.src_addr, &context->settings.src_addr_len);
+    if(p101_error_has_error(err))
+    {
+        goto done;
+    }
+
+    // A spectator only listens to the group, it has no port of its own and never talks to the server
+    if(context->settings.dest_ip_address != NULL)
+    {
+        context->settings.src_port = parse_in_port_t(env, err, context->arguments->src_port_str);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+
+        context->settings.dest_port = parse_in_port_t(env, err, context->arguments->dest_port_str);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+
+        convert_address(env, err, context->settings.dest_ip_address, &context->settings.dest_addr, &context->settings.dest_addr_len);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+
+        get_address_to_server(env, err, &context->settings.dest_addr, context->settings.dest_port);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->room_str != NULL)
+    {
+        context->settings.room = (uint32_t)parse_int_option(env, err, context->arguments->room_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    convert_group_args(env, err, context);
+    if(p101_error_has_error(err))
+    {
+        goto done;
+    }
+
+    convert_socket_options(env, err, context);
     if(p101_error_has_error(err))
     {
         goto done;
     }
 
-    context->settings.dest_port = parse_in_port_t(env, err, context->arguments->dest_port_str);
+done:
+    return;
+}
+
+void convert_server_args(const struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    P101_TRACE(env);
+
+    context->settings.src_port = parse_in_port_t(env, err, context->arguments->src_port_str);
     if(p101_error_has_error(err))
     {
         goto done;
@@ -22,13 +79,73 @@ void convert_client_args(const struct p101_env *env, struct p101_error *err, str
         goto done;
     }
 
-    convert_address(env, err, context->settings.dest_ip_address, &context->settings.dest_addr, &context->settings.dest_addr_len);
+    if(context->arguments->workers_str != NULL)
+    {
+        context->settings.workers = (uint32_t)parse_int_option(env, err, context->arguments->workers_str, MAX_ROOM_WORKERS);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    // Each sender is fed by one room worker, without workers there is nothing to split off
+    if(context->arguments->pipelined && context->settings.workers == 0)
+    {
+        P101_ERROR_RAISE_USER(err, "-P needs room worker threads, pass -w", EXIT_FAILURE);
+        goto done;
+    }
+
+    if(context->arguments->move_limit_str != NULL)
+    {
+        context->settings.move_limit = (uint32_t)parse_int_option(env, err, context->arguments->move_limit_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->snapshot_budget_str != NULL)
+    {
+        context->settings.snapshot_budget = (uint32_t)parse_int_option(env, err, context->arguments->snapshot_budget_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->snapshot_interval_str != NULL)
+    {
+        context->settings.snapshot_interval = (uint32_t)parse_int_option(env, err, context->arguments->snapshot_interval_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    // Rates are adapted by spacing out and shrinking snapshots, without a budget there are none
+    if(context->settings.snapshot_interval != 0 && context->settings.snapshot_budget == 0)
+    {
+        P101_ERROR_RAISE_USER(err, "-A needs a snapshot budget, pass -B", EXIT_FAILURE);
+        goto done;
+    }
+
+    // Checked against the node list once the cluster is set up
+    if(context->arguments->zone_str != NULL)
+    {
+        context->settings.zone = (uint32_t)parse_int_option(env, err, context->arguments->zone_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    convert_group_args(env, err, context);
     if(p101_error_has_error(err))
     {
         goto done;
     }
 
-    get_address_to_server(env, err, &context->settings.dest_addr, context->settings.dest_port);
+    convert_socket_options(env, err, context);
     if(p101_error_has_error(err))
     {
         goto done;
@@ -38,22 +155,97 @@ done:
     return;
 }
 
-void convert_server_args(const struct p101_env *env, struct p101_error *err, struct context *context)
+// The group comes as an address and a port, like every other endpoint on the command line. Clients
+// are tracked by IPv4 address, so the group is an IPv4 multicast address as well.
+void convert_group_args(const struct p101_env *env, struct p101_error *err, struct context *context)
 {
+    in_port_t port;
+
     P101_TRACE(env);
 
-    context->settings.src_port = parse_in_port_t(env, err, context->arguments->src_port_str);
+    if(context->arguments->group_ip_address == NULL && context->arguments->group_port_str == NULL)
+    {
+        goto done;
+    }
+
+    if(context->arguments->group_ip_address == NULL || context->arguments->group_port_str == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "-M and -m must be passed together", EXIT_FAILURE);
+        goto done;
+    }
+
+    port = parse_in_port_t(env, err, context->arguments->group_port_str);
     if(p101_error_has_error(err))
     {
         goto done;
     }
 
-    convert_address(env, err, context->settings.src_ip_address, &context->settings.src_addr, &context->settings.src_addr_len);
+    convert_address(env, err, context->arguments->group_ip_address, &context->settings.group_addr, &context->settings.group_addr_len);
     if(p101_error_has_error(err))
     {
         goto done;
     }
 
+    if(context->settings.group_addr.ss_family != AF_INET || !IN_MULTICAST(ntohl(((struct sockaddr_in *)&context->settings.group_addr)->sin_addr.s_addr)))
+    {
+        P101_ERROR_RAISE_USER(err, "Group address is not an IPv4 multicast address", EXIT_FAILURE);
+        context->settings.group_addr_len = 0;
+        goto done;
+    }
+
+    get_address_to_server(env, err, &context->settings.group_addr, port);
+
+done:
+    return;
+}
+
+void convert_socket_options(const struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    struct socket_options *options;
+
+    P101_TRACE(env);
+
+    options             = &context->settings.options;
+    options->dscp       = -1;
+    options->timestamps = context->arguments->timestamps;
+    options->zerocopy   = context->arguments->zerocopy;
+
+    if(context->arguments->rcvbuf_str != NULL)
+    {
+        options->rcvbuf = parse_int_option(env, err, context->arguments->rcvbuf_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->sndbuf_str != NULL)
+    {
+        options->sndbuf = parse_int_option(env, err, context->arguments->sndbuf_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->busy_poll_str != NULL)
+    {
+        options->busy_poll = parse_int_option(env, err, context->arguments->busy_poll_str, INT_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
+    if(context->arguments->dscp_str != NULL)
+    {
+        options->dscp = parse_int_option(env, err, context->arguments->dscp_str, DSCP_MAX);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+    }
+
 done:
     return;
 }
@@ -93,6 +285,41 @@ done:
     return (in_port_t)parsed_value;
 }
 
+int parse_int_option(const struct p101_env *env, struct p101_error *err, const char *value_str, int max)
+{
+    char     *endptr;
+    uintmax_t parsed_value;
+
+    P101_TRACE(env);
+
+    errno        = 0;
+    parsed_value = strtoumax(value_str, &endptr, BASE_TEN);
+
+    if(errno != 0)
+    {
+        P101_ERROR_RAISE_USER(err, "Couldn't parse option value", EXIT_FAILURE);
+        parsed_value = 0;
+        goto done;
+    }
+
+    if(*endptr != '\0' || *value_str == '-')
+    {
+        P101_ERROR_RAISE_USER(err, "Invalid characters in option value", EXIT_FAILURE);
+        parsed_value = 0;
+        goto done;
+    }
+
+    if(parsed_value > (uintmax_t)max)
+    {
+        P101_ERROR_RAISE_USER(err, "Option value out of range.", EXIT_FAILURE);
+        parsed_value = 0;
+        goto done;
+    }
+
+done:
+    return (int)parsed_value;
+}
+
 void convert_address(const struct p101_env *env, struct p101_error *err, const char *ip_address, struct sockaddr_storage *addr, socklen_t *addr_len)
 {
     P101_TRACE(env);
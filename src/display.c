@@ -1,5 +1,9 @@
 #include "../include/display.h"
 
+static uint32_t follow_axis(uint32_t origin, uint32_t position, uint32_t size, uint32_t margin, uint32_t world_size);
+static uint32_t clamp_origin(int64_t origin, uint32_t size, uint32_t world_size);
+static bool     in_window(const struct viewport *view, uint32_t x, uint32_t y);
+
 void setup_window(WINDOW *w, const struct coordinates *coordinates, const char *player)
 {
     box(w, 0, 0);       // sets default borders for the window
@@ -11,3 +15,132 @@ void setup_window(WINDOW *w, const struct coordinates *coordinates, const char *
     mvwprintw(w, (int)coordinates->new_y, (int)coordinates->new_x, "%s", player);    // Set the position of the characte to (7,5)
     wrefresh(w);                                                                     // update the terminal screen
 }
+
+// The first and last row and column of the world are its walls, so the window starts on cell (1, 1)
+// and a world that fits in the window looks exactly like the old fixed screen
+void viewport_init(struct viewport *view, uint32_t columns, uint32_t rows)
+{
+    memset(view, 0, sizeof(*view));
+    view->columns  = columns;
+    view->rows     = rows;
+    view->origin_x = 1;
+    view->origin_y = 1;
+}
+
+// Scrolls the window to keep (x, y) away from its borders. Returns true if it moved.
+bool viewport_follow(struct viewport *view, uint32_t x, uint32_t y)
+{
+    uint32_t origin_x;
+    uint32_t origin_y;
+
+    origin_x = follow_axis(view->origin_x, x, view->columns, VIEWPORT_SCROLL_MARGIN_X, WORLD_COLUMNS);
+    origin_y = follow_axis(view->origin_y, y, view->rows, VIEWPORT_SCROLL_MARGIN_Y, WORLD_ROWS);
+    if(origin_x == view->origin_x && origin_y == view->origin_y)
+    {
+        return false;
+    }
+
+    view->origin_x = origin_x;
+    view->origin_y = origin_y;
+    return true;
+}
+
+// Puts (x, y) in the middle of the window, as far as the walls allow. Spectators steer the window this way.
+void viewport_center(struct viewport *view, uint32_t x, uint32_t y)
+{
+    view->origin_x = clamp_origin((int64_t)x - view->columns / 2, view->columns, WORLD_COLUMNS);
+    view->origin_y = clamp_origin((int64_t)y - view->rows / 2, view->rows, WORLD_ROWS);
+}
+
+// Moves a remembered player from the old end of a move to the new one. An exit or a player we
+// have not heard of before simply drops out of or joins the list.
+void viewport_apply(struct viewport *view, const struct coordinates *coordinates)
+{
+    for(uint32_t i = 0; i < view->cell_count; i++)
+    {
+        if(view->cells[i].new_x == coordinates->old_x && view->cells[i].new_y == coordinates->old_y)
+        {
+            view->cells[i] = view->cells[--view->cell_count];
+            break;
+        }
+    }
+
+    if(coordinates->new_x < WORLD_COLUMNS && coordinates->new_y < WORLD_ROWS && view->cell_count < VIEWPORT_MAX_CELLS)
+    {
+        view->cells[view->cell_count++] = *coordinates;
+    }
+}
+
+// The server stops sending moves of players outside our view, so whatever it last told us about
+// them goes stale and is dropped when we change chunk
+void viewport_forget_distant(struct viewport *view, uint32_t x, uint32_t y)
+{
+    uint32_t i;
+
+    i = 0;
+    while(i < view->cell_count)
+    {
+        if(world_in_view(x, y, view->cells[i].new_x, view->cells[i].new_y))
+        {
+            i++;
+            continue;
+        }
+
+        view->cells[i] = view->cells[--view->cell_count];
+    }
+}
+
+void viewport_draw(WINDOW *w, const struct viewport *view, const struct coordinates *coordinates, const char *player)
+{
+    werase(w);
+    box(w, 0, 0);
+
+    for(uint32_t i = 0; i < view->cell_count; i++)
+    {
+        if(in_window(view, view->cells[i].new_x, view->cells[i].new_y))
+        {
+            mvwprintw(w, (int)(view->cells[i].new_y - view->origin_y + 1), (int)(view->cells[i].new_x - view->origin_x + 1), "%s", player);
+        }
+    }
+
+    // A spectator has no character of its own
+    if(coordinates != NULL)
+    {
+        mvwprintw(w, (int)(coordinates->new_y - view->origin_y + 1), (int)(coordinates->new_x - view->origin_x + 1), "%s", player);
+    }
+    wrefresh(w);
+}
+
+static uint32_t follow_axis(uint32_t origin, uint32_t position, uint32_t size, uint32_t margin, uint32_t world_size)
+{
+    if(position < origin + margin)
+    {
+        return clamp_origin((int64_t)position - margin, size, world_size);
+    }
+
+    if(position + margin >= origin + size)
+    {
+        return clamp_origin((int64_t)position + margin + 1 - size, size, world_size);
+    }
+
+    return origin;
+}
+
+// The window never scrolls past the walls
+static uint32_t clamp_origin(int64_t origin, uint32_t size, uint32_t world_size)
+{
+    int64_t last_origin;
+
+    last_origin = (int64_t)world_size - 1 - size;
+    if(origin > last_origin)
+    {
+        origin = last_origin;
+    }
+
+    return origin < 1 ? 1 : (uint32_t)origin;
+}
+
+static bool in_window(const struct viewport *view, uint32_t x, uint32_t y)
+{
+    return x >= view->origin_x && x < view->origin_x + view->columns && y >= view->origin_y && y < view->origin_y + view->rows;
+}
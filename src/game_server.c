@@ -0,0 +1,2058 @@
+#include "../include/game_server.h"
+
+#define ADDRESS_HASH_MULTIPLIER 0x9E3779B1U
+#define PORT_SHIFT 16
+#define SNAPSHOT_RECORD_WORDS 10    // Slot, address, port, room id, four coordinates, expected sequence, started
+#define SNAPSHOT_RECORD_SIZE (SNAPSHOT_RECORD_WORDS * sizeof(uint32_t))
+#define DRAIN_ATTEMPTS 50
+#define DRAIN_WAIT_MS 20    // Longest a single drain attempt waits for the socket or for send completions
+
+static void     handle_client_packet(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const uint8_t *packet, const uint8_t *trailer, bool forwarded);
+static void     handle_zone_message(const struct p101_env *env, struct server_state *server, const uint8_t *data, size_t length);
+static int64_t  read_view_time(const struct p101_env *env, struct server_state *server, const uint8_t *stamp);
+static bool     route_move(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, int client_index, const struct packet_header *header, const struct coordinates *coordinates, const uint8_t *packet, int64_t view_us);
+static void     release_held_moves(const struct p101_env *env, struct server_state *server);
+static void     apply_move(const struct p101_env *env, struct server_state *server, int client_index, const struct packet_header *header, const struct coordinates *coordinates, const uint8_t *packet, int64_t view_us);
+static void     hand_off(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const uint8_t *packet, uint32_t owner);
+static void     send_to_other_zones(const struct p101_env *env, struct server_state *server, enum zone_message_type type, const struct sockaddr_in *client_addr, const uint8_t *packet);
+static void     replicate_border(const struct p101_env *env, struct server_state *server, const struct coordinates *coordinates, const uint8_t *packet);
+static bool     send_control(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *addr, const uint8_t *data, size_t length);
+static void     receive_ghost(const struct p101_env *env, struct server_state *server, const uint8_t *packet);
+static int      join_client(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const struct packet_header *header, const struct coordinates *coordinates);
+static void     forget_client(const struct p101_env *env, struct server_state *server, int client_index);
+static void     release_client(const struct p101_env *env, struct server_state *server, int client_index);
+static bool     is_exit(const struct coordinates *coordinates);
+static void     dispatch_event(const struct p101_env *env, struct server_state *server, const struct room_event *event);
+static void     process_room_event(const struct p101_env *env, void *arg, uint32_t worker, const void *item);
+static bool     flush_room_queues(const struct p101_env *env, void *arg, uint32_t worker);
+static bool     wake_sender(const struct p101_env *env, void *arg, uint32_t worker);
+static void     deliver_send(const struct p101_env *env, void *arg, uint32_t worker, const void *item);
+static bool     flush_sender_queues(const struct p101_env *env, void *arg, uint32_t worker);
+static bool     flush_group_queue(const struct p101_env *env, struct server_state *server, uint32_t worker);
+static void     push_group_packet(const struct p101_env *env, struct server_state *server, uint32_t worker, struct packet_buffer *packet, int origin);
+static void     unlist_recipient(struct send_backlog *backlog, int client_index);
+static void     track_sequence(const struct p101_env *env, struct server_state *server, int client_index, uint32_t sequence);
+static uint32_t address_hash(const struct sockaddr_in *addr);
+static bool     same_address(const struct client_info *client, const struct sockaddr_in *addr);
+static int      check_existing_client_address(const struct p101_env *env, const struct server_state *server, const struct sockaddr_in *client_addr);
+static void     index_client(const struct p101_env *env, struct server_state *server, int client_index);
+static void     unindex_client(const struct p101_env *env, struct server_state *server, int client_index);
+static int      add_client(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, uint32_t room);
+static void     occupy_slot(const struct p101_env *env, struct server_state *server, int client_index, const struct sockaddr_in *client_addr, uint32_t room);
+static bool     readmit_client(const struct p101_env *env, struct server_state *server, int client_index, const struct sockaddr_in *client_addr, uint32_t room_id, const struct coordinates *coordinates);
+static void     place_client(const struct p101_env *env, struct server_state *server, struct room *room, const struct coordinates *coordinates, int client_index);
+static void     vacate_cell(const struct p101_env *env, const struct server_state *server, struct room *room, const struct coordinates *cell);
+static bool     changed_chunk(const struct coordinates *coordinates);
+static void     stream_view(const struct p101_env *env, struct server_state *server, const struct room *room, const struct coordinates *previous, int client_index);
+static bool     blocked_by_player(const struct p101_env *env, const struct server_state *server, const struct room *room, const struct coordinates *coordinates, int client_index);
+static bool     taken_after_view(const struct p101_env *env, const struct server_state *server, const struct room *room, const struct coordinates *coordinates, int client_index, int64_t view_us);
+static void     correct_client(const struct p101_env *env, struct server_state *server, const struct room *room, const struct packet_header *header, int client_index);
+static void     remove_client(const struct p101_env *env, struct server_state *server, struct room *room, int client_index);
+static void     broadcast_coordinates(const struct p101_env *env, struct server_state *server, const struct room *room, const struct packet_header *header, const struct coordinates *coordinates, int client_index);
+static void     queue_packet(const struct p101_env *env, struct server_state *server, const struct room *room, int recipient, struct packet_buffer *packet, int origin);
+static void     owe_update(const struct p101_env *env, struct server_state *server, const struct room *room, int viewer, int entity, const struct packet_header *header, const struct coordinates *coordinates, struct packet_buffer *packet);
+static bool     send_snapshots(const struct p101_env *env, struct server_state *server, uint32_t worker);
+static void     pack_snapshot(const struct p101_env *env, struct server_state *server, const struct room *room, int viewer, const struct pending_update *updates, uint32_t count);
+static uint32_t room_thread(const struct server_state *server, const struct room *room);
+
+static const struct staged_worker_ops room_ops   = {process_room_event, flush_room_queues};
+static const struct staged_worker_ops staged_ops = {process_room_event, wake_sender};
+static const struct staged_worker_ops sender_ops = {deliver_send, flush_sender_queues};
+
+void game_server_init(const struct p101_env *env, struct p101_error *err, struct server_state *server, uint32_t workers, bool senders)
+{
+    P101_TRACE(env);
+
+    memset(server, 0, sizeof(*server));
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        send_queue_init(env, &server->queues[i]);
+        sequence_tracker_reset(env, &server->sequences[i]);
+        atomic_init(&server->client_active[i], false);
+    }
+
+    for(uint32_t i = 0; i < MAX_ROOM_WORKERS; i++)
+    {
+        send_queue_init(env, &server->group_queues[i]);
+    }
+    send_queue_init(env, &server->control_queue);
+
+    for(int i = 0; i < CLIENT_INDEX_SIZE; i++)
+    {
+        server->address_index[i] = CLIENT_INDEX_EMPTY;
+    }
+
+    room_table_init(env, &server->rooms);
+    receive_stats_init(env, &server->stats);
+
+    packet_pool_create(env, err, &server->pool, PACKET_POOL_CAPACITY);
+    if(p101_error_has_error(err))
+    {
+        goto done;
+    }
+
+    // Senders first, a room worker may hand over packets as soon as it runs
+    for(uint32_t i = 0; senders && i < workers; i++)
+    {
+        staged_worker_start(env, err, &server->senders[i], i, SEND_WORKER_RING_CAPACITY, sizeof(struct send_job), &sender_ops, server);
+        if(p101_error_has_error(err))
+        {
+            game_server_stop(env, server);
+            packet_pool_destroy(env, &server->pool);
+            goto done;
+        }
+        server->sender_count++;
+    }
+
+    // Rooms are pinned to workers by slot, so all events for one room are applied in order by one thread
+    for(uint32_t i = 0; i < workers; i++)
+    {
+        staged_worker_start(env, err, &server->workers[i], i, ROOM_WORKER_RING_CAPACITY, sizeof(struct room_event), senders ? &staged_ops : &room_ops, server);
+        if(p101_error_has_error(err))
+        {
+            game_server_stop(env, server);
+            packet_pool_destroy(env, &server->pool);
+            goto done;
+        }
+        server->worker_count++;
+    }
+
+done:
+    return;
+}
+
+// Brings back every client the checkpoint knew about into the same clients[] slot, so the first
+// datagram after a restart is treated as a move from a known player rather than a fresh join.
+void game_server_restore(const struct p101_env *env, struct server_state *server)
+{
+    uint32_t restored;
+    uint32_t dropped;
+
+    P101_TRACE(env);
+
+    restored = 0;
+    dropped  = 0;
+
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        struct checkpoint_entry *entry;
+        struct sockaddr_in       client_addr;
+
+        // Pairs with the release in checkpoint_record_join, an entry seen active is seen whole
+        entry = &server->checkpoint->region->entries[i];
+        if(atomic_load_explicit(&entry->active, memory_order_acquire) == 0)
+        {
+            continue;
+        }
+
+        memset(&client_addr, 0, sizeof(client_addr));
+        client_addr.sin_family      = AF_INET;
+        client_addr.sin_addr.s_addr = entry->address;
+        client_addr.sin_port        = entry->port;
+
+        // Settings may have changed between runs, a client that no longer fits is dropped from the file too
+        if(!readmit_client(env, server, i, &client_addr, entry->room_id, &entry->coordinates))
+        {
+            atomic_store_explicit(&entry->active, 0, memory_order_relaxed);
+            dropped++;
+            continue;
+        }
+        restored++;
+    }
+
+    printf("Restored %u clients from checkpoint, %u dropped\n", restored, dropped);
+}
+
+// One record per client, every field a big endian word. Only valid once game_server_stop has
+// returned, until then the room threads may still be moving clients and finishing leaves.
+uint8_t *game_server_snapshot(const struct p101_env *env, const struct server_state *server, size_t *length)
+{
+    uint8_t *snapshot;
+    size_t   offset;
+
+    P101_TRACE(env);
+
+    *length  = 0;
+    snapshot = (uint8_t *)malloc((size_t)MAX_CLIENTS * SNAPSHOT_RECORD_SIZE);
+    if(snapshot == NULL)
+    {
+        return NULL;
+    }
+
+    offset = 0;
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        const struct client_info *client;
+        const struct sockaddr_in *client_addr;
+        uint32_t                  record[SNAPSHOT_RECORD_WORDS];
+
+        if(!atomic_load_explicit(&server->client_active[i], memory_order_acquire))
+        {
+            continue;
+        }
+
+        client      = &server->clients[i];
+        client_addr = (const struct sockaddr_in *)(const void *)&client->addr;
+        record[0]   = (uint32_t)i;
+        record[1]   = ntohl(client_addr->sin_addr.s_addr);
+        record[2]   = ntohs(client_addr->sin_port);
+        record[3]   = server->rooms.rooms[client->room].id;
+        record[4]   = client->coordinates.old_x;
+        record[5]   = client->coordinates.old_y;
+        record[6]   = client->coordinates.new_x;
+        record[7]   = client->coordinates.new_y;
+        record[8]   = server->sequences[i].expected;
+        record[9]   = server->sequences[i].started ? 1 : 0;
+
+        for(uint32_t w = 0; w < SNAPSHOT_RECORD_WORDS; w++)
+        {
+            uint32_t net_word;
+
+            net_word = htonl(record[w]);
+            memcpy(snapshot + offset, &net_word, sizeof(net_word));
+            offset += sizeof(net_word);
+        }
+    }
+
+    *length = offset;
+    return snapshot;
+}
+
+// Takes over the clients of the server this one replaced, each in the slot it had there
+void game_server_adopt(const struct p101_env *env, struct server_state *server, const uint8_t *snapshot, size_t length)
+{
+    uint32_t adopted;
+    uint32_t dropped;
+
+    P101_TRACE(env);
+
+    adopted = 0;
+    dropped = 0;
+
+    for(size_t offset = 0; offset + SNAPSHOT_RECORD_SIZE <= length; offset += SNAPSHOT_RECORD_SIZE)
+    {
+        struct sockaddr_in client_addr;
+        struct coordinates coordinates;
+        uint32_t           record[SNAPSHOT_RECORD_WORDS];
+        int                client_index;
+
+        for(uint32_t w = 0; w < SNAPSHOT_RECORD_WORDS; w++)
+        {
+            uint32_t net_word;
+
+            memcpy(&net_word, snapshot + offset + w * sizeof(net_word), sizeof(net_word));
+            record[w] = ntohl(net_word);
+        }
+
+        memset(&client_addr, 0, sizeof(client_addr));
+        client_addr.sin_family      = AF_INET;
+        client_addr.sin_addr.s_addr = htonl(record[1]);
+        client_addr.sin_port        = htons((uint16_t)record[2]);
+        coordinates.old_x           = record[4];
+        coordinates.old_y           = record[5];
+        coordinates.new_x           = record[6];
+        coordinates.new_y           = record[7];
+        client_index                = (int)record[0];
+
+        if(record[0] >= MAX_CLIENTS || atomic_load_explicit(&server->client_active[client_index], memory_order_relaxed) || !readmit_client(env, server, client_index, &client_addr, record[3], &coordinates))
+        {
+            dropped++;
+            continue;
+        }
+
+        // Carry the sequence position over so the handover does not show up as a gap
+        sequence_tracker_reset(env, &server->sequences[client_index]);
+        server->sequences[client_index].expected = record[8];
+        server->sequences[client_index].started  = record[9] != 0;
+        if(server->checkpoint != NULL)
+        {
+            checkpoint_record_join(env, server->checkpoint, client_index, &client_addr, record[3], &coordinates);
+        }
+        adopted++;
+    }
+
+    printf("Adopted %u clients from the previous server, %u dropped\n", adopted, dropped);
+}
+
+void game_server_stop(const struct p101_env *env, struct server_state *server)
+{
+    P101_TRACE(env);
+
+    for(uint32_t i = 0; i < server->worker_count; i++)
+    {
+        staged_worker_stop(env, &server->workers[i]);
+    }
+
+    // Only now can nothing more be staged for the senders
+    for(uint32_t i = 0; i < server->sender_count; i++)
+    {
+        staged_worker_stop(env, &server->senders[i]);
+    }
+}
+
+void game_server_destroy(const struct p101_env *env, struct server_state *server)
+{
+    P101_TRACE(env);
+
+    game_server_stop(env, server);
+
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        send_queue_clear(env, &server->queues[i]);
+    }
+
+    for(uint32_t i = 0; i < MAX_ROOM_WORKERS; i++)
+    {
+        send_queue_clear(env, &server->group_queues[i]);
+    }
+    send_queue_clear(env, &server->control_queue);
+
+    for(uint32_t r = 0; r < MAX_ROOMS; r++)
+    {
+        chunk_table_clear(env, &server->rooms.rooms[r].chunks);
+    }
+
+    packet_pool_destroy(env, &server->pool);
+}
+
+void game_server_handle_datagram(const struct p101_env *env, struct p101_error *err, void *arg, const struct sockaddr *addr, const uint8_t *data, size_t length, const struct receive_metadata *metadata)
+{
+    struct server_state      *server;
+    const struct sockaddr_in *client_addr;
+
+    P101_TRACE(env);
+
+    (void)err;
+    server      = (struct server_state *)arg;
+    client_addr = (const struct sockaddr_in *)(const void *)addr;
+    server->stats.datagrams++;
+
+    // Record before anything can reject the datagram, so a replay sees exactly what arrived
+    if(server->capture != NULL && !capture_write(env, server->capture, addr, data, length))
+    {
+        perror("capture write failed, capture stopped");
+        capture_writer_close(env, server->capture);
+        server->capture = NULL;
+    }
+
+    if(metadata->has_kernel_drops)
+    {
+        receive_stats_record_kernel_drops(env, &server->stats, metadata->kernel_drops);
+    }
+
+    // The other zone servers share the game socket and are told apart by their address
+    if(server->cluster.count > 0 && zone_find_node(env, &server->cluster, client_addr) != ZONE_NONE)
+    {
+        handle_zone_message(env, server, data, length);
+        return;
+    }
+
+    if(length < POSITION_PACKET_SIZE)
+    {
+        fprintf(stderr, "Ignoring %zu byte runt datagram\n", length);
+        return;
+    }
+
+    // A join answering a challenge carries the cookie right after the position, a known client's move its clock stamp
+    handle_client_packet(env, server, client_addr, data, length >= POSITION_PACKET_SIZE + CLOCK_STAMP_SIZE ? data + POSITION_PACKET_SIZE : NULL, false);
+
+    if(metadata->rx_time.tv_sec != 0)
+    {
+        struct timespec now;
+
+        clock_gettime(CLOCK_REALTIME, &now);
+        latency_stats_record(env, &server->stats.latency, timespec_diff_ns(&now, &metadata->rx_time));
+    }
+}
+
+bool game_server_has_pending_sends(const struct p101_env *env, const struct server_state *server)
+{
+    P101_TRACE(env);
+
+    // Workers send for their own rooms, the network thread never has anything queued
+    if(server->worker_count > 0)
+    {
+        return false;
+    }
+
+    if(server->group_queues[0].count > 0)
+    {
+        return true;
+    }
+
+    for(uint32_t r = 0; r < MAX_ROOMS; r++)
+    {
+        const struct room *room;
+
+        room = &server->rooms.rooms[r];
+        for(uint32_t m = 0; m < room->member_count; m++)
+        {
+            if(server->queues[room->members[m]].count > 0)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// How long the network thread may wait for datagrams before game_server_flush has work of its own
+int game_server_timeout_ms(const struct p101_env *env, const struct server_state *server)
+{
+    int     timeout_ms;
+    int64_t now_ns;
+
+    P101_TRACE(env);
+
+    now_ns     = monotonic_now_ns();
+    timeout_ms = move_limiter_timeout_ms(env, &server->limiter, now_ns);
+
+    // Without workers the network thread sends the snapshots too, it has to be back for the next tick
+    if(server->worker_count == 0 && server->snapshots_waiting[0])
+    {
+        int tick_ms;
+
+        tick_ms = server->next_snapshot_ns[0] > now_ns ? (int)((server->next_snapshot_ns[0] - now_ns + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND) : 0;
+        if(timeout_ms == -1 || tick_ms < timeout_ms)
+        {
+            timeout_ms = tick_ms;
+        }
+    }
+
+    return timeout_ms == -1 ? IO_WAIT_FOREVER : timeout_ms;
+}
+
+void game_server_flush(const struct p101_env *env, struct server_state *server)
+{
+    P101_TRACE(env);
+
+    if(server->checkpoint != NULL)
+    {
+        checkpoint_sync(env, server->checkpoint);
+    }
+
+    if(server->limiter.held_count > 0)
+    {
+        release_held_moves(env, server);
+    }
+
+    if(server->worker_count == 0)
+    {
+        flush_room_queues(env, server, 0);
+        return;
+    }
+
+    // One wakeup per worker per receive batch, not one per event
+    for(uint32_t i = 0; i < server->worker_count; i++)
+    {
+        staged_worker_wake(env, &server->workers[i]);
+    }
+}
+
+// Sends whatever the room threads left queued when they stopped and waits for the backend to finish
+// them. Every wait is bounded and the attempts are counted, so a stuck socket cannot hold up a restart forever.
+void game_server_drain(const struct p101_env *env, struct p101_error *err, struct server_state *server)
+{
+    uint32_t threads;
+
+    P101_TRACE(env);
+
+    threads = server->worker_count == 0 ? 1 : server->worker_count;
+    for(uint32_t attempt = 0; attempt < DRAIN_ATTEMPTS && !p101_error_has_error(err); attempt++)
+    {
+        bool blocked;
+
+        blocked = false;
+        for(uint32_t w = 0; w < threads; w++)
+        {
+            blocked = (server->sender_count > 0 ? flush_sender_queues(env, server, w) : flush_room_queues(env, server, w)) || blocked;
+        }
+
+        // Completions free the backend's send slots, so this is also what unblocks the queues there
+        if(!io_backend_settle(env, err, &server->backend, game_server_handle_datagram, server, DRAIN_WAIT_MS))
+        {
+            continue;
+        }
+
+        if(!blocked)
+        {
+            return;
+        }
+
+        // Nothing in flight and still blocked, the socket buffer is full
+        io_backend_wait(env, err, &server->backend, true, DRAIN_WAIT_MS);
+    }
+
+    fprintf(stderr, "Warning: gave up draining send queues after %d attempts\n", DRAIN_ATTEMPTS);
+}
+
+void game_server_print_stats(const struct p101_env *env, const struct server_state *server, bool timestamps)
+{
+    uint64_t loads;
+    uint64_t unloads;
+    uint32_t loaded;
+
+    P101_TRACE(env);
+
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        const struct send_queue *queue;
+
+        queue = &server->queues[i];
+        if(queue->sent + queue->coalesced + queue->dropped + queue->failed > 0)
+        {
+            printf("Send queue %d: %" PRIu64 " sent (%" PRIu64 " GSO batches), %" PRIu64 " coalesced, %" PRIu64 " dropped, %" PRIu64 " failed\n", i, queue->sent, queue->segmented_sends, queue->coalesced, queue->dropped, queue->failed);
+        }
+    }
+
+    if(server->group_addr_len != 0)
+    {
+        uint64_t sent;
+        uint64_t coalesced;
+        uint64_t dropped;
+        uint64_t failed;
+
+        sent      = 0;
+        coalesced = 0;
+        dropped   = 0;
+        failed    = 0;
+        for(uint32_t i = 0; i < MAX_ROOM_WORKERS; i++)
+        {
+            sent      += server->group_queues[i].sent;
+            coalesced += server->group_queues[i].coalesced;
+            dropped   += server->group_queues[i].dropped;
+            failed    += server->group_queues[i].failed;
+        }
+
+        printf("Multicast group: %" PRIu64 " sent, %" PRIu64 " coalesced, %" PRIu64 " dropped, %" PRIu64 " failed\n", sent, coalesced, dropped, failed);
+    }
+
+    if(server->control_queue.sent + server->control_queue.dropped + server->control_queue.failed > 0)
+    {
+        printf("Control datagrams: %" PRIu64 " sent, %" PRIu64 " dropped, %" PRIu64 " failed\n", server->control_queue.sent, server->control_queue.dropped, server->control_queue.failed);
+    }
+
+    printf("Rooms: %u active, %u peak, %" PRIu64 " joins rejected\n", server->rooms.active, server->rooms.peak_active, server->rejected_joins);
+
+    for(uint32_t i = 0; i < server->worker_count; i++)
+    {
+        printf("Room worker %u: %" PRIu64 " events in %" PRIu64 " batches, %" PRIu64 " inbox stalls\n", i, server->workers[i].items, server->workers[i].batches, server->workers[i].stalls);
+    }
+
+    for(uint32_t i = 0; i < server->sender_count; i++)
+    {
+        printf("Send worker %u: %" PRIu64 " packets in %" PRIu64 " batches, %" PRIu64 " stalls\n", i, server->senders[i].items, server->senders[i].batches, server->senders[i].stalls);
+    }
+
+    if(server->collisions)
+    {
+        uint64_t blocked;
+        uint64_t compensated;
+        uint32_t occupied;
+
+        blocked     = 0;
+        compensated = 0;
+        occupied    = 0;
+        for(uint32_t i = 0; i < MAX_ROOM_WORKERS; i++)
+        {
+            blocked     += server->blocked_moves[i];
+            compensated += server->compensated_moves[i];
+        }
+
+        for(uint32_t r = 0; r < MAX_ROOMS; r++)
+        {
+            occupied += chunk_table_count(env, &server->rooms.rooms[r].chunks);
+        }
+
+        printf("Collisions: %" PRIu64 " moves blocked, %" PRIu64 " let through by lag compensation, %u cells occupied\n", blocked, compensated, occupied);
+    }
+
+    if(server->pings_answered > 0 || server->stamped_moves > 0)
+    {
+        double mean_lag_ms;
+
+        mean_lag_ms = server->stamped_moves > 0 ? (double)server->view_lag_us / (double)server->stamped_moves / MICROSECONDS_PER_MILLISECOND : 0.0;
+        printf("Clock: %" PRIu64 " pings answered, %" PRIu64 " moves stamped, %" PRIu64 " stamps clamped, %.3f ms mean view lag\n", server->pings_answered, server->stamped_moves, server->clamped_stamps, mean_lag_ms);
+    }
+
+    loaded  = 0;
+    loads   = 0;
+    unloads = 0;
+    for(uint32_t r = 0; r < MAX_ROOMS; r++)
+    {
+        loaded  += server->rooms.rooms[r].chunks.loaded;
+        loads   += server->rooms.rooms[r].chunks.loads;
+        unloads += server->rooms.rooms[r].chunks.unloads;
+    }
+    printf("World: %u chunks loaded, %" PRIu64 " loads, %" PRIu64 " unloads\n", loaded, loads, unloads);
+
+    if(server->cookies != NULL)
+    {
+        join_cookies_print_stats(env, server->cookies);
+    }
+
+    move_limiter_print_stats(env, &server->limiter);
+    snapshot_stats_print(env, server->snapshot_stats, MAX_ROOM_WORKERS, server->snapshot_budget);
+    send_rate_print_stats(env, &server->rate_limits, server->rate_stats, MAX_ROOM_WORKERS, server->rates, server->client_active);
+
+    zone_cluster_print_stats(env, &server->cluster);
+    receive_stats_print(env, &server->stats);
+
+    if(timestamps)
+    {
+        latency_stats_print(env, &server->stats.latency, "Kernel receive to broadcast queued");
+    }
+}
+
+// A datagram in the client format, straight from the client or forwarded by the zone it was sending to
+static void handle_client_packet(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const uint8_t *packet, const uint8_t *trailer, bool forwarded)
+{
+    struct packet_header header;
+    struct coordinates   coordinates;
+    int                  client_index;
+    int64_t              view_us;
+
+    P101_TRACE(env);
+
+    deserialize_header_from_buffer(env, &header, packet);
+    deserialize_position_from_buffer(env, &coordinates, packet + PACKET_HEADER_SIZE);
+    client_index = check_existing_client_address(env, server, client_addr);
+    if(server->verbose)
+    {
+        char client_ip[INET6_ADDRSTRLEN];
+
+        inet_ntop(AF_INET, &client_addr->sin_addr, client_ip, INET_ADDRSTRLEN);
+        printf("Bytes read: %zu\nold X: %d\nold Y: %d\nnew x: %d\nnew y: %d\n", (size_t)POSITION_PACKET_SIZE, (int)coordinates.old_x, (int)coordinates.old_y, (int)coordinates.new_x, (int)coordinates.new_y);
+        printf("Client ip: %s\n", client_ip);
+        printf("client index: %d room: %u\n", client_index, header.room);
+    }
+
+    if(client_index == -1)
+    {
+        // A client that was just handed off can quit before it sees the redirect, let whoever has it know
+        if(server->cluster.count > 0 && is_exit(&coordinates))
+        {
+            if(!forwarded)
+            {
+                send_to_other_zones(env, server, ZONE_MESSAGE_FORWARD, client_addr, packet);
+            }
+            return;
+        }
+
+        // Only players get their pings answered and their acks heard
+        if(is_ping(&coordinates) || is_ack(&coordinates))
+        {
+            return;
+        }
+
+        // Nothing is handed off or allocated for an address that has not shown it can receive, peers vouch for what they forward
+        if(server->cookies != NULL && !forwarded && (trailer == NULL || !join_cookie_verify(env, server->cookies, client_addr, trailer)))
+        {
+            uint8_t challenge[POSITION_PACKET_SIZE];
+
+            join_cookie_write_challenge(env, server->cookies, client_addr, &header, challenge);
+            send_control(env, server, client_addr, challenge, sizeof(challenge));
+            return;
+        }
+
+        if(server->cluster.count > 0)
+        {
+            uint32_t owner;
+
+            owner = zone_owner(env, &server->cluster, coordinates.new_x);
+            if(owner != server->cluster.self)
+            {
+                hand_off(env, server, client_addr, packet, owner);
+                return;
+            }
+        }
+
+        client_index = join_client(env, server, client_addr, &header, &coordinates);
+        if(client_index == -1 || server->cluster.count == 0)
+        {
+            return;
+        }
+
+        // Whoever held the client before lets go, even if its handoff and our redirect crossed on the wire
+        send_to_other_zones(env, server, ZONE_MESSAGE_CLAIM, client_addr, packet);
+        if(forwarded)
+        {
+            server->cluster.handoffs_in++;
+            apply_move(env, server, client_index, &header, &coordinates, packet, 0);
+        }
+        return;
+    }
+
+    track_sequence(env, server, client_index, header.sequence);
+
+    if(is_ping(&coordinates))
+    {
+        uint8_t pong[POSITION_PACKET_SIZE];
+
+        clock_write_pong(env, &header, clock_now_us(), pong);
+        send_control(env, server, client_addr, pong, sizeof(pong));
+        server->pings_answered++;
+        return;
+    }
+
+    // The rate belongs to the room's thread, and an ack is never a move whether rates are adapted or not
+    if(is_ack(&coordinates))
+    {
+        if(server->rate_limits.max_interval_ticks != 0)
+        {
+            struct room_event event;
+
+            memset(&event, 0, sizeof(event));
+            event.kind         = ROOM_EVENT_ACK;
+            event.client_index = client_index;
+            event.room         = server->clients[client_index].room;
+            event.header       = header;
+            event.coordinates  = coordinates;
+            dispatch_event(env, server, &event);
+        }
+        return;
+    }
+
+    view_us = trailer != NULL ? read_view_time(env, server, trailer) : 0;
+
+    if(server->limiter.interval_ns != 0)
+    {
+        struct packet_header held_header;
+        struct coordinates   held_coordinates;
+        uint8_t              encoded[POSITION_PACKET_SIZE];
+
+        // An exit is never held back, and whatever the client had held goes first so everyone sees the cell it leaves from
+        if(is_exit(&coordinates))
+        {
+            if(move_limiter_take(env, &server->limiter, client_index, &held_header, &held_coordinates))
+            {
+                serialize_header_to_buffer(env, &held_header, encoded);
+                serialize_position_to_buffer(env, &held_coordinates, encoded + PACKET_HEADER_SIZE);
+                if(!route_move(env, server, client_addr, client_index, &held_header, &held_coordinates, encoded, 0))
+                {
+                    return;
+                }
+            }
+        }
+        else
+        {
+            // The limiter may hand back a different move, one that folds this one into what it held. Moves it held
+            // back are judged as of when they are let through.
+            if(move_limiter_admit(env, &server->limiter, client_index, monotonic_now_ns(), &header, &coordinates) == MOVE_HELD)
+            {
+                return;
+            }
+
+            serialize_header_to_buffer(env, &header, encoded);
+            serialize_position_to_buffer(env, &coordinates, encoded + PACKET_HEADER_SIZE);
+            route_move(env, server, client_addr, client_index, &header, &coordinates, encoded, view_us);
+            return;
+        }
+    }
+
+    route_move(env, server, client_addr, client_index, &header, &coordinates, packet, view_us);
+}
+
+// The server time a move's sender saw the world at, kept within the position histories so a client cannot
+// reach further back, or ahead of the server, by lying about its clock
+static int64_t read_view_time(const struct p101_env *env, struct server_state *server, const uint8_t *stamp)
+{
+    int64_t view_us;
+    int64_t now_us;
+
+    P101_TRACE(env);
+
+    view_us = deserialize_stamp_from_buffer(env, stamp);
+    now_us  = clock_now_us();
+    server->stamped_moves++;
+    if(view_us > now_us || view_us < now_us - POSITION_HISTORY_MAX_REWIND_US)
+    {
+        view_us = view_us > now_us ? now_us : now_us - POSITION_HISTORY_MAX_REWIND_US;
+        server->clamped_stamps++;
+    }
+
+    server->view_lag_us += now_us - view_us;
+    return view_us;
+}
+
+// Hands a known client to the zone that owns its new position, or applies the move here. Returns
+// false if the client was handed off.
+static bool route_move(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, int client_index, const struct packet_header *header, const struct coordinates *coordinates, const uint8_t *packet, int64_t view_us)
+{
+    P101_TRACE(env);
+
+    if(server->cluster.count > 0 && !is_exit(coordinates))
+    {
+        uint32_t owner;
+
+        owner = zone_owner(env, &server->cluster, coordinates->new_x);
+        if(owner != server->cluster.self)
+        {
+            hand_off(env, server, client_addr, packet, owner);
+            release_client(env, server, client_index);
+            server->cluster.handoffs_out++;
+            return false;
+        }
+    }
+
+    apply_move(env, server, client_index, header, coordinates, packet, view_us);
+    return true;
+}
+
+// Applies the moves the limiter held back whose clients are within their rate again
+static void release_held_moves(const struct p101_env *env, struct server_state *server)
+{
+    struct packet_header header;
+    struct coordinates   coordinates;
+    uint8_t              encoded[POSITION_PACKET_SIZE];
+    int64_t              now_ns;
+    int                  client_index;
+
+    P101_TRACE(env);
+
+    now_ns = monotonic_now_ns();
+    while((client_index = move_limiter_release(env, &server->limiter, now_ns, &header, &coordinates)) != -1)
+    {
+        serialize_header_to_buffer(env, &header, encoded);
+        serialize_position_to_buffer(env, &coordinates, encoded + PACKET_HEADER_SIZE);
+        route_move(env, server, (const struct sockaddr_in *)&server->clients[client_index].addr, client_index, &header, &coordinates, encoded, 0);
+    }
+}
+
+static void handle_zone_message(const struct p101_env *env, struct server_state *server, const uint8_t *data, size_t length)
+{
+    struct zone_message message;
+
+    P101_TRACE(env);
+
+    if(!zone_decode(env, &message, data, length))
+    {
+        fprintf(stderr, "Ignoring %zu byte malformed zone message\n", length);
+        return;
+    }
+
+    switch(message.type)
+    {
+        case ZONE_MESSAGE_FORWARD:
+        {
+            handle_client_packet(env, server, &message.client, message.packet, NULL, true);
+            break;
+        }
+        case ZONE_MESSAGE_GHOST:
+        {
+            receive_ghost(env, server, message.packet);
+            break;
+        }
+        case ZONE_MESSAGE_CLAIM:
+        {
+            int client_index;
+
+            client_index = check_existing_client_address(env, server, &message.client);
+            if(client_index != -1)
+            {
+                release_client(env, server, client_index);
+            }
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+static void apply_move(const struct p101_env *env, struct server_state *server, int client_index, const struct packet_header *header, const struct coordinates *coordinates, const uint8_t *packet, int64_t view_us)
+{
+    struct room_event event;
+
+    P101_TRACE(env);
+
+    event.kind         = ROOM_EVENT_MOVE;
+    event.client_index = client_index;
+    event.room         = server->clients[client_index].room;
+    event.header       = *header;
+    event.coordinates  = *coordinates;
+    event.view_us      = view_us;
+
+    if(server->cluster.count > 0)
+    {
+        replicate_border(env, server, coordinates, packet);
+    }
+
+    // Exit coords: forget the address now, the room's thread finishes the leave after broadcasting it
+    if(is_exit(coordinates))
+    {
+        forget_client(env, server, client_index);
+    }
+
+    dispatch_event(env, server, &event);
+}
+
+// Passes the datagram to the zone that owns its position and points the client there for the next one
+static void hand_off(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const uint8_t *packet, uint32_t owner)
+{
+    uint8_t message[ZONE_MESSAGE_SIZE];
+    uint8_t redirect[POSITION_PACKET_SIZE];
+
+    P101_TRACE(env);
+
+    // Best effort like every other datagram, a lost forward looks like one lost move to the client
+    zone_write_message(env, ZONE_MESSAGE_FORWARD, client_addr, packet, message);
+    if(!send_control(env, server, &server->cluster.nodes[owner], message, sizeof(message)))
+    {
+        server->cluster.send_failures++;
+    }
+
+    zone_write_redirect(env, &server->cluster, owner, redirect);
+    if(send_control(env, server, client_addr, redirect, sizeof(redirect)))
+    {
+        server->cluster.redirects++;
+    }
+    else
+    {
+        server->cluster.send_failures++;
+    }
+    server->cluster.forwarded++;
+}
+
+static void send_to_other_zones(const struct p101_env *env, struct server_state *server, enum zone_message_type type, const struct sockaddr_in *client_addr, const uint8_t *packet)
+{
+    uint8_t message[ZONE_MESSAGE_SIZE];
+
+    P101_TRACE(env);
+
+    zone_write_message(env, type, client_addr, packet, message);
+    for(uint32_t zone = 0; zone < server->cluster.count; zone++)
+    {
+        if(zone != server->cluster.self && !send_control(env, server, &server->cluster.nodes[zone], message, sizeof(message)))
+        {
+            server->cluster.send_failures++;
+        }
+    }
+}
+
+// Shows moves near a boundary to the zone on the other side. The old position counts as well,
+// otherwise the neighbour's players would keep a stale dot when someone walks away from the border.
+static void replicate_border(const struct p101_env *env, struct server_state *server, const struct coordinates *coordinates, const uint8_t *packet)
+{
+    const struct zone_cluster *cluster;
+    uint8_t                    message[ZONE_MESSAGE_SIZE];
+    uint32_t                   first;
+
+    P101_TRACE(env);
+
+    cluster = &server->cluster;
+    first   = cluster->self == 0 ? 0 : cluster->self - 1;
+    zone_write_message(env, ZONE_MESSAGE_GHOST, NULL, packet, message);
+
+    for(uint32_t neighbour = first; neighbour <= cluster->self + 1 && neighbour < cluster->count; neighbour++)
+    {
+        if(neighbour == cluster->self)
+        {
+            continue;
+        }
+
+        if(zone_near_border(env, cluster, coordinates->old_x, neighbour) || (!is_exit(coordinates) && zone_near_border(env, cluster, coordinates->new_x, neighbour)))
+        {
+            if(!send_control(env, server, &cluster->nodes[neighbour], message, sizeof(message)))
+            {
+                server->cluster.send_failures++;
+                continue;
+            }
+            server->cluster.ghosts_out++;
+        }
+    }
+}
+
+// Pongs, cookie challenges, redirects and zone messages leave from the network thread through the
+// backend, so replay and simulation see them like any other send. The client queues belong to the
+// room threads, so these go through a queue of their own, flushed straight away to one destination.
+// Returns false if the datagram could not be handed to the backend, it is then dropped.
+static bool send_control(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *addr, const uint8_t *data, size_t length)
+{
+    struct packet_buffer  *packet;
+    enum send_queue_status status;
+    uint64_t               failed;
+
+    P101_TRACE(env);
+
+    packet = packet_pool_acquire(env, &server->pool);
+    if(packet == NULL)
+    {
+        server->control_queue.dropped++;
+        return false;
+    }
+
+    memcpy(packet->data, data, length);
+    packet->length = length;
+    send_queue_push(env, &server->control_queue, packet, SEND_QUEUE_NO_ORIGIN);
+    packet_buffer_release(env, packet);
+
+    failed = server->control_queue.failed;
+    status = io_backend_flush(env, &server->backend, &server->control_queue, (const struct sockaddr *)addr, sizeof(*addr));
+    if(status == SEND_QUEUE_BLOCKED)
+    {
+        // The next one may be for someone else, so nothing waits here for the socket
+        server->control_queue.dropped += server->control_queue.count;
+        send_queue_clear(env, &server->control_queue);
+        return false;
+    }
+
+    return server->control_queue.failed == failed;
+}
+
+static void receive_ghost(const struct p101_env *env, struct server_state *server, const uint8_t *packet)
+{
+    struct room_event event;
+
+    P101_TRACE(env);
+
+    deserialize_header_from_buffer(env, &event.header, packet);
+    deserialize_position_from_buffer(env, &event.coordinates, packet + PACKET_HEADER_SIZE);
+
+    // Nobody here plays in that room, nothing to show
+    event.room = room_find(env, &server->rooms, event.header.room);
+    if(event.room == ROOM_NONE)
+    {
+        return;
+    }
+
+    event.kind         = ROOM_EVENT_GHOST;
+    event.client_index = -1;
+    event.view_us      = 0;
+    server->cluster.ghosts_in++;
+    dispatch_event(env, server, &event);
+}
+
+static int join_client(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, const struct packet_header *header, const struct coordinates *coordinates)
+{
+    struct room_event event;
+    uint32_t          room;
+    int               client_index;
+
+    P101_TRACE(env);
+
+    room         = room_admit(env, &server->rooms, header->room);
+    client_index = -1;
+    if(room != ROOM_NONE)
+    {
+        client_index = add_client(env, server, client_addr, room);
+        if(client_index == -1)
+        {
+            room_release(env, &server->rooms, room);
+        }
+    }
+
+    if(client_index == -1)
+    {
+        server->rejected_joins++;
+        if(rate_limiter_allow(env, &server->join_warning))
+        {
+            fprintf(stderr, "Warning: rejected join for room %u, room or server full (%" PRIu64 " warnings suppressed)\n", header->room, server->join_warning.suppressed);
+            server->join_warning.suppressed = 0;
+        }
+        return -1;
+    }
+
+    sequence_tracker_reset(env, &server->sequences[client_index]);
+    track_sequence(env, server, client_index, header->sequence);
+    if(server->checkpoint != NULL)
+    {
+        checkpoint_record_join(env, server->checkpoint, client_index, client_addr, header->room, coordinates);
+    }
+
+    event.kind         = ROOM_EVENT_JOIN;
+    event.client_index = client_index;
+    event.room         = room;
+    event.header       = *header;
+    event.coordinates  = *coordinates;
+    event.view_us      = 0;
+    dispatch_event(env, server, &event);
+
+    return client_index;
+}
+
+// Drops everything the network thread knows about the client, its room's thread still has to finish with it
+static void forget_client(const struct p101_env *env, struct server_state *server, int client_index)
+{
+    P101_TRACE(env);
+
+    unindex_client(env, server, client_index);
+    sequence_tracker_reset(env, &server->sequences[client_index]);
+    move_limiter_reset(env, &server->limiter, client_index);
+    room_release(env, &server->rooms, server->clients[client_index].room);
+    if(server->checkpoint != NULL)
+    {
+        checkpoint_record_leave(env, server->checkpoint, client_index);
+    }
+}
+
+// The client now belongs to another zone, take it out of its room without telling the room it quit
+static void release_client(const struct p101_env *env, struct server_state *server, int client_index)
+{
+    struct room_event event;
+
+    P101_TRACE(env);
+
+    memset(&event, 0, sizeof(event));
+    event.kind         = ROOM_EVENT_LEAVE;
+    event.client_index = client_index;
+    event.room         = server->clients[client_index].room;
+    forget_client(env, server, client_index);
+    dispatch_event(env, server, &event);
+}
+
+static bool is_exit(const struct coordinates *coordinates)
+{
+    return coordinates->new_x == EXIT_COORDINATE && coordinates->new_y == EXIT_COORDINATE;
+}
+
+static void dispatch_event(const struct p101_env *env, struct server_state *server, const struct room_event *event)
+{
+    P101_TRACE(env);
+
+    if(server->worker_count == 0)
+    {
+        process_room_event(env, server, 0, event);
+        return;
+    }
+
+    staged_worker_post(env, &server->workers[event->room % server->worker_count], event);
+}
+
+static void process_room_event(const struct p101_env *env, void *arg, uint32_t worker, const void *item)
+{
+    const struct room_event *event;
+    struct server_state     *server;
+    struct room             *room;
+
+    P101_TRACE(env);
+
+    event  = (const struct room_event *)item;
+    server = (struct server_state *)arg;
+    room   = &server->rooms.rooms[event->room];
+
+    switch(event->kind)
+    {
+        case ROOM_EVENT_JOIN:
+        {
+            // Every join carries the id the slot was admitted for, and the old room's leaves are all ahead of it
+            room->simulated_id = event->header.room;
+            position_history_reset(env, &server->histories[event->client_index]);
+            send_rate_reset(env, &server->rates[event->client_index], &server->rate_limits);
+            place_client(env, server, room, &event->coordinates, event->client_index);
+            stream_view(env, server, room, NULL, event->client_index);
+            room_add_member(env, room, event->client_index);
+            break;
+        }
+        case ROOM_EVENT_MOVE:
+        {
+            struct coordinates previous;
+
+            // A player who got to the cell only after the mover's view of it is not in the mover's way
+            if(server->collisions && blocked_by_player(env, server, room, &event->coordinates, event->client_index))
+            {
+                if(!taken_after_view(env, server, room, &event->coordinates, event->client_index, event->view_us))
+                {
+                    server->blocked_moves[worker]++;
+                    correct_client(env, server, room, &event->header, event->client_index);
+                    break;
+                }
+                server->compensated_moves[worker]++;
+            }
+
+            // Onto the new cell before off the old one, a player walking within a chunk keeps it loaded
+            previous = server->clients[event->client_index].coordinates;
+            place_client(env, server, room, &event->coordinates, event->client_index);
+            vacate_cell(env, server, room, &previous);
+
+            // Only a move the room took is worth restoring. The slot is not handed out again before this
+            // thread has finished the client's leave, so the write cannot land on a newer client's entry.
+            if(server->checkpoint != NULL && !is_exit(&event->coordinates))
+            {
+                checkpoint_record_move(env, server->checkpoint, event->client_index, &event->coordinates);
+            }
+            broadcast_coordinates(env, server, room, &event->header, &event->coordinates, event->client_index);
+
+            if(changed_chunk(&event->coordinates))
+            {
+                stream_view(env, server, room, &event->coordinates, event->client_index);
+            }
+
+            // Remove if exit coords
+            if(is_exit(&event->coordinates))
+            {
+                remove_client(env, server, room, event->client_index);
+            }
+            break;
+        }
+        case ROOM_EVENT_LEAVE:
+        {
+            remove_client(env, server, room, event->client_index);
+            break;
+        }
+        case ROOM_EVENT_GHOST:
+        {
+            broadcast_coordinates(env, server, room, &event->header, &event->coordinates, SEND_QUEUE_NO_ORIGIN);
+            break;
+        }
+        case ROOM_EVENT_ACK:
+        {
+            send_rate_ack(env, &server->rates[event->client_index], &server->rate_limits, &server->rate_stats[worker], event->coordinates.old_x, event->coordinates.old_y, monotonic_now_ns() / NANOSECONDS_PER_MICROSECOND);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+}
+
+// Flushes the queues of every member of the rooms this thread simulates. Returns true if a send blocked.
+static bool flush_room_queues(const struct p101_env *env, void *arg, uint32_t worker)
+{
+    struct server_state *server;
+    uint32_t             stride;
+    uint32_t            *cursor;
+    bool                 waiting;
+
+    P101_TRACE(env);
+
+    server  = (struct server_state *)arg;
+    stride  = server->worker_count == 0 ? 1 : server->worker_count;
+    cursor  = &server->flush_cursor[worker];
+    waiting = send_snapshots(env, server, worker);
+
+    // One send here stands in for every spectator, so it goes ahead of the players' queues
+    if(flush_group_queue(env, server, worker))
+    {
+        return true;
+    }
+
+    // Rotate the starting room so a backlog never lets the same queues win the socket buffer every time
+    for(uint32_t n = 0; n < MAX_ROOMS; n++)
+    {
+        const struct room *room;
+        uint32_t           r;
+
+        r = (*cursor + n) % MAX_ROOMS;
+        if(r % stride != worker)
+        {
+            continue;
+        }
+
+        room = &server->rooms.rooms[r];
+        for(uint32_t m = 0; m < room->member_count; m++)
+        {
+            const struct client_info *client;
+            struct send_queue        *queue;
+            enum send_queue_status    status;
+            int                       i;
+
+            i      = room->members[m];
+            client = &server->clients[i];
+            queue  = &server->queues[i];
+
+            if(queue->count == 0)
+            {
+                continue;
+            }
+
+            // Workers bypass the backend and use plain non-blocking sends, it is only safe to drive from the network thread
+            if(server->worker_count == 0)
+            {
+                status = io_backend_flush(env, &server->backend, queue, (const struct sockaddr *)&client->addr, client->addr_len);
+            }
+            else
+            {
+                status = send_queue_flush(env, queue, NULL, server->backend.sockfd, (const struct sockaddr *)&client->addr, client->addr_len);
+            }
+
+            if(status == SEND_QUEUE_BLOCKED)
+            {
+                *cursor = r;
+                return true;
+            }
+        }
+    }
+
+    // Updates still owed bring the worker back like blocked sends do, in time for the next tick
+    *cursor = (*cursor + 1) % MAX_ROOMS;
+    return waiting;
+}
+
+// A room worker's flush with a send stage: publish what the pass encoded and let the sender transmit it
+static bool wake_sender(const struct p101_env *env, void *arg, uint32_t worker)
+{
+    struct server_state *server;
+    bool                 waiting;
+
+    P101_TRACE(env);
+
+    server  = (struct server_state *)arg;
+    waiting = send_snapshots(env, server, worker);
+    staged_worker_wake(env, &server->senders[worker]);
+
+    return waiting;
+}
+
+static void deliver_send(const struct p101_env *env, void *arg, uint32_t worker, const void *item)
+{
+    const struct send_job *job;
+    struct server_state   *server;
+    struct send_backlog   *backlog;
+
+    P101_TRACE(env);
+
+    job     = (const struct send_job *)item;
+    server  = (struct server_state *)arg;
+    backlog = &server->backlogs[worker];
+
+    if(job->recipient == SEND_JOB_GROUP)
+    {
+        push_group_packet(env, server, worker, job->packet, job->origin);
+        packet_buffer_release(env, job->packet);
+        return;
+    }
+
+    if(job->packet == NULL)
+    {
+        unlist_recipient(backlog, job->recipient);
+        send_queue_clear(env, &server->queues[job->recipient]);
+        atomic_store_explicit(&server->client_active[job->recipient], false, memory_order_release);
+        return;
+    }
+
+    send_queue_push(env, &server->queues[job->recipient], job->packet, job->origin);
+    packet_buffer_release(env, job->packet);
+
+    if(!backlog->listed[job->recipient])
+    {
+        backlog->listed[job->recipient]    = true;
+        backlog->clients[backlog->count++] = job->recipient;
+    }
+}
+
+// Sends for every recipient with something queued. Returns true if a send blocked.
+static bool flush_sender_queues(const struct p101_env *env, void *arg, uint32_t worker)
+{
+    struct server_state *server;
+    struct send_backlog *backlog;
+    uint32_t             kept;
+    bool                 blocked;
+
+    P101_TRACE(env);
+
+    server  = (struct server_state *)arg;
+    backlog = &server->backlogs[worker];
+    kept    = 0;
+    blocked = flush_group_queue(env, server, worker);
+
+    for(uint32_t n = 0; n < backlog->count; n++)
+    {
+        const struct client_info *client;
+        int                       i;
+
+        i      = backlog->clients[n];
+        client = &server->clients[i];
+
+        // Once one send blocks the socket buffer is full, the rest keep their place for the retry
+        if(!blocked && send_queue_flush(env, &server->queues[i], NULL, server->backend.sockfd, (const struct sockaddr *)&client->addr, client->addr_len) == SEND_QUEUE_DRAINED)
+        {
+            backlog->listed[i] = false;
+            continue;
+        }
+
+        blocked                  = true;
+        backlog->clients[kept++] = i;
+    }
+
+    backlog->count = kept;
+    return blocked;
+}
+
+// Returns true if the send blocked, like the flushes that call it
+static bool flush_group_queue(const struct p101_env *env, struct server_state *server, uint32_t worker)
+{
+    struct send_queue *queue;
+
+    P101_TRACE(env);
+
+    queue = &server->group_queues[worker];
+    if(queue->count == 0)
+    {
+        return false;
+    }
+
+    if(server->worker_count == 0)
+    {
+        return io_backend_flush(env, &server->backend, queue, (const struct sockaddr *)&server->group_addr, server->group_addr_len) == SEND_QUEUE_BLOCKED;
+    }
+
+    return send_queue_flush(env, queue, NULL, server->backend.sockfd, (const struct sockaddr *)&server->group_addr, server->group_addr_len) == SEND_QUEUE_BLOCKED;
+}
+
+// One group queue carries the moves of every room a thread owns, so it fills long before the next
+// flush comes round. Sending it when full keeps one room's moves from pushing out another's.
+static void push_group_packet(const struct p101_env *env, struct server_state *server, uint32_t worker, struct packet_buffer *packet, int origin)
+{
+    P101_TRACE(env);
+
+    if(server->group_queues[worker].count == SEND_QUEUE_DEPTH)
+    {
+        flush_group_queue(env, server, worker);
+    }
+
+    send_queue_push(env, &server->group_queues[worker], packet, origin);
+}
+
+static void unlist_recipient(struct send_backlog *backlog, int client_index)
+{
+    if(!backlog->listed[client_index])
+    {
+        return;
+    }
+
+    backlog->listed[client_index] = false;
+    for(uint32_t n = 0; n < backlog->count; n++)
+    {
+        if(backlog->clients[n] == client_index)
+        {
+            backlog->clients[n] = backlog->clients[--backlog->count];
+            break;
+        }
+    }
+}
+
+static void track_sequence(const struct p101_env *env, struct server_state *server, int client_index, uint32_t sequence)
+{
+    struct sequence_tracker *tracker;
+    uint64_t                 late;
+    uint64_t                 duplicates;
+    uint32_t                 gap;
+
+    P101_TRACE(env);
+
+    tracker    = &server->sequences[client_index];
+    late       = tracker->late;
+    duplicates = tracker->duplicates;
+    gap        = sequence_tracker_update(env, tracker, sequence);
+
+    server->stats.sequence_gaps += gap;
+    server->stats.late += tracker->late - late;
+    server->stats.duplicates += tracker->duplicates - duplicates;
+
+    if(gap == 0)
+    {
+        return;
+    }
+
+    if(rate_limiter_allow(env, &server->stats.gap_warning))
+    {
+        fprintf(stderr, "Warning: client %s:%u skipped %u sequence numbers, %" PRIu64 " lost from this client (%" PRIu64 " warnings suppressed)\n", server->clients[client_index].client_ip, server->clients[client_index].client_port, gap, tracker->lost - tracker->late, server->stats.gap_warning.suppressed);
+        server->stats.gap_warning.suppressed = 0;
+    }
+}
+
+static uint32_t address_hash(const struct sockaddr_in *addr)
+{
+    uint32_t key;
+
+    key = addr->sin_addr.s_addr ^ ((uint32_t)addr->sin_port << PORT_SHIFT) ^ addr->sin_port;
+
+    // Fibonacci hashing, the high bits of the product are the well mixed ones
+    return (key * ADDRESS_HASH_MULTIPLIER) >> (32 - CLIENT_INDEX_BITS);
+}
+
+static bool same_address(const struct client_info *client, const struct sockaddr_in *addr)
+{
+    const struct sockaddr_in *known;
+
+    known = (const struct sockaddr_in *)(const void *)&client->addr;
+    return known->sin_addr.s_addr == addr->sin_addr.s_addr && known->sin_port == addr->sin_port;
+}
+
+static int check_existing_client_address(const struct p101_env *env, const struct server_state *server, const struct sockaddr_in *client_addr)
+{
+    uint32_t slot;
+
+    P101_TRACE(env);
+
+    for(slot = address_hash(client_addr);; slot = (slot + 1) & (CLIENT_INDEX_SIZE - 1))
+    {
+        int client_index;
+
+        client_index = server->address_index[slot];
+        if(client_index == CLIENT_INDEX_EMPTY)
+        {
+            return -1;
+        }
+
+        if(same_address(&server->clients[client_index], client_addr))
+        {
+            return client_index;
+        }
+    }
+}
+
+static void index_client(const struct p101_env *env, struct server_state *server, int client_index)
+{
+    uint32_t slot;
+
+    P101_TRACE(env);
+
+    slot = address_hash((const struct sockaddr_in *)(const void *)&server->clients[client_index].addr);
+    while(server->address_index[slot] != CLIENT_INDEX_EMPTY)
+    {
+        slot = (slot + 1) & (CLIENT_INDEX_SIZE - 1);
+    }
+
+    server->address_index[slot] = client_index;
+}
+
+static void unindex_client(const struct p101_env *env, struct server_state *server, int client_index)
+{
+    uint32_t hole;
+    uint32_t next;
+
+    P101_TRACE(env);
+
+    hole = address_hash((const struct sockaddr_in *)(const void *)&server->clients[client_index].addr);
+    while(server->address_index[hole] != client_index)
+    {
+        hole = (hole + 1) & (CLIENT_INDEX_SIZE - 1);
+    }
+
+    // Backward shift deletion: pull later entries of the probe chain into the hole so lookups never need tombstones
+    for(next = (hole + 1) & (CLIENT_INDEX_SIZE - 1); server->address_index[next] != CLIENT_INDEX_EMPTY; next = (next + 1) & (CLIENT_INDEX_SIZE - 1))
+    {
+        uint32_t home;
+
+        home = address_hash((const struct sockaddr_in *)(const void *)&server->clients[server->address_index[next]].addr);
+        if(((next - home) & (CLIENT_INDEX_SIZE - 1)) >= ((next - hole) & (CLIENT_INDEX_SIZE - 1)))
+        {
+            server->address_index[hole] = server->address_index[next];
+            hole                        = next;
+        }
+    }
+
+    server->address_index[hole] = CLIENT_INDEX_EMPTY;
+}
+
+static int add_client(const struct p101_env *env, struct server_state *server, const struct sockaddr_in *client_addr, uint32_t room)
+{
+    P101_TRACE(env);
+
+    for(int i = 0; i < MAX_CLIENTS; i++)
+    {
+        // A slot stays taken until the room's thread has finished with the previous occupant
+        if(atomic_load_explicit(&server->client_active[i], memory_order_acquire))
+        {
+            continue;
+        }
+
+        occupy_slot(env, server, i, client_addr, room);
+        return i;
+    }
+
+    return -1;
+}
+
+static void occupy_slot(const struct p101_env *env, struct server_state *server, int client_index, const struct sockaddr_in *client_addr, uint32_t room)
+{
+    struct client_info *client;
+
+    P101_TRACE(env);
+
+    client = &server->clients[client_index];
+    inet_ntop(AF_INET, &client_addr->sin_addr, client->client_ip, INET_ADDRSTRLEN);
+    client->client_port = ntohs(client_addr->sin_port);
+    client->room        = room;
+
+    // Keep the source address as is, it is both the lookup key and the destination for every send
+    memset(&client->addr, 0, sizeof(client->addr));
+    memcpy(&client->addr, client_addr, sizeof(*client_addr));
+    client->addr_len = sizeof(*client_addr);
+
+    atomic_store_explicit(&server->client_active[client_index], true, memory_order_relaxed);
+    index_client(env, server, client_index);
+}
+
+// Puts a client from an earlier run back into the slot it had, false if it no longer fits
+static bool readmit_client(const struct p101_env *env, struct server_state *server, int client_index, const struct sockaddr_in *client_addr, uint32_t room_id, const struct coordinates *coordinates)
+{
+    struct room_event event;
+    uint32_t          room;
+
+    P101_TRACE(env);
+
+    room = room_admit(env, &server->rooms, room_id);
+    if(room == ROOM_NONE || check_existing_client_address(env, server, client_addr) != -1)
+    {
+        if(room != ROOM_NONE)
+        {
+            room_release(env, &server->rooms, room);
+        }
+        return false;
+    }
+
+    occupy_slot(env, server, client_index, client_addr, room);
+
+    memset(&event, 0, sizeof(event));
+    event.kind         = ROOM_EVENT_JOIN;
+    event.client_index = client_index;
+    event.room         = room;
+    event.header.room  = room_id;
+    event.coordinates  = *coordinates;
+    dispatch_event(env, server, &event);
+
+    return true;
+}
+
+// Puts the client on its new cell and marks the cell in the room's chunks. A mover vacates the old
+// cell right after, so the chunks and clients[] only disagree within one event.
+static void place_client(const struct p101_env *env, struct server_state *server, struct room *room, const struct coordinates *coordinates, int client_index)
+{
+    P101_TRACE(env);
+
+    server->clients[client_index].coordinates = *coordinates;
+    chunk_table_enter(env, &room->chunks, coordinates->new_x, coordinates->new_y);
+    if(!is_exit(coordinates))
+    {
+        position_history_record(env, &server->histories[client_index], clock_now_us(), coordinates->new_x, coordinates->new_y);
+    }
+}
+
+// Takes one player off cell, whose bit stays set if a member still stands on it. The player has
+// already moved on or left the room, so a mover that stayed put counts as one of those members.
+// Players may share a cell (everyone spawns on the same one), and the scan is bounded by ROOM_CAPACITY.
+static void vacate_cell(const struct p101_env *env, const struct server_state *server, struct room *room, const struct coordinates *cell)
+{
+    P101_TRACE(env);
+
+    for(uint32_t m = 0; m < room->member_count; m++)
+    {
+        const struct coordinates *other;
+
+        other = &server->clients[room->members[m]].coordinates;
+        if(other->new_x == cell->new_x && other->new_y == cell->new_y)
+        {
+            chunk_table_leave(env, &room->chunks, cell->new_x, cell->new_y, false);
+            return;
+        }
+    }
+
+    chunk_table_leave(env, &room->chunks, cell->new_x, cell->new_y, true);
+}
+
+// One bit test against the chunk holding the cell, standing still or leaving is never blocked
+static bool blocked_by_player(const struct p101_env *env, const struct server_state *server, const struct room *room, const struct coordinates *coordinates, int client_index)
+{
+    const struct coordinates *current;
+
+    P101_TRACE(env);
+
+    current = &server->clients[client_index].coordinates;
+    if(is_exit(coordinates) || (coordinates->new_x == current->new_x && coordinates->new_y == current->new_y))
+    {
+        return false;
+    }
+
+    return chunk_table_occupied(env, &room->chunks, coordinates->new_x, coordinates->new_y);
+}
+
+// Rewinds everyone on the cell the mover wants to its view time. True if none of them stood there
+// then, so the mover could not have seen the cell taken. A move without a view time is judged as of now.
+static bool taken_after_view(const struct p101_env *env, const struct server_state *server, const struct room *room, const struct coordinates *coordinates, int client_index, int64_t view_us)
+{
+    P101_TRACE(env);
+
+    if(view_us == 0)
+    {
+        return false;
+    }
+
+    for(uint32_t m = 0; m < room->member_count; m++)
+    {
+        const struct coordinates *other;
+        uint32_t                  then_x;
+        uint32_t                  then_y;
+
+        other = &server->clients[room->members[m]].coordinates;
+        if(room->members[m] == client_index || other->new_x != coordinates->new_x || other->new_y != coordinates->new_y)
+        {
+            continue;
+        }
+
+        if(position_history_at(env, &server->histories[room->members[m]], view_us, &then_x, &then_y) && then_x == coordinates->new_x && then_y == coordinates->new_y)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// The mover has already drawn itself on the cell it was refused, tell it where the room still has it
+static void correct_client(const struct p101_env *env, struct server_state *server, const struct room *room, const struct packet_header *header, int client_index)
+{
+    const struct coordinates *current;
+    struct coordinates        correction;
+    struct packet_buffer     *packet;
+
+    P101_TRACE(env);
+
+    current          = &server->clients[client_index].coordinates;
+    correction.old_x = current->new_x;
+    correction.old_y = current->new_y;
+    correction.new_x = CORRECTION_COORDINATE;
+    correction.new_y = CORRECTION_COORDINATE;
+
+    packet = packet_pool_acquire(env, &server->pool);
+    if(packet == NULL)
+    {
+        fprintf(stderr, "Packet pool exhausted, dropping correction in room %u\n", room->simulated_id);
+        return;
+    }
+
+    serialize_header_to_buffer(env, header, packet->data);
+    serialize_position_to_buffer(env, &correction, packet->data + PACKET_HEADER_SIZE);
+    packet->length = POSITION_PACKET_SIZE;
+
+    // Under the mover's own origin, so only the latest of several refused moves is sent
+    queue_packet(env, server, room, client_index, packet, client_index);
+    packet_buffer_release(env, packet);
+}
+
+static void remove_client(const struct p101_env *env, struct server_state *server, struct room *room, int client_index)
+{
+    struct client_info *client;
+
+    P101_TRACE(env);
+
+    client = &server->clients[client_index];
+    printf("Removed client address %s\n", client->client_ip);
+    room_remove_member(env, room, client_index);
+    vacate_cell(env, server, room, &client->coordinates);
+    memset(&client->coordinates, 0, sizeof(struct coordinates));
+
+    // The leaver is owed nothing now, and nobody is owed its moves any more, only its exit
+    if(server->snapshot_budget != 0)
+    {
+        priority_accumulator_clear(env, &server->accumulators[client_index]);
+        for(uint32_t m = 0; m < room->member_count; m++)
+        {
+            priority_accumulator_forget(env, &server->accumulators[room->members[m]], client_index);
+        }
+    }
+
+    // The queue belongs to the sender, which frees the slot once it has dropped what is left in it
+    if(server->sender_count > 0)
+    {
+        queue_packet(env, server, room, client_index, NULL, SEND_QUEUE_NO_ORIGIN);
+        return;
+    }
+
+    send_queue_clear(env, &server->queues[client_index]);
+
+    // The address and name belong to the network thread, it overwrites them when the slot is reused
+    atomic_store_explicit(&server->client_active[client_index], false, memory_order_release);
+}
+
+// client_index is the sender, who does not need its own move back, or SEND_QUEUE_NO_ORIGIN to send to every member
+static void broadcast_coordinates(const struct p101_env *env, struct server_state *server, const struct room *room, const struct packet_header *header, const struct coordinates *coordinates, int client_index)
+{
+    struct packet_buffer *snapshot;
+
+    P101_TRACE(env);
+
+    // Encode once, every recipient queue holds a reference to the same buffer
+    snapshot = packet_pool_acquire(env, &server->pool);
+    if(snapshot == NULL)
+    {
+        fprintf(stderr, "Packet pool exhausted, dropping broadcast in room %u\n", room->simulated_id);
+        return;
+    }
+    serialize_header_to_buffer(env, header, snapshot->data);
+    serialize_position_to_buffer(env, coordinates, snapshot->data + PACKET_HEADER_SIZE);
+    snapshot->length = POSITION_PACKET_SIZE;
+
+    // Only members of the sender's room who can see either end of the move hear about it, so the cost
+    // follows the crowd around the sender rather than the size of the world
+    for(uint32_t m = 0; m < room->member_count; m++)
+    {
+        const struct coordinates *viewer;
+
+        viewer = &server->clients[room->members[m]].coordinates;
+        if(room->members[m] == client_index || !(world_in_view(viewer->new_x, viewer->new_y, coordinates->old_x, coordinates->old_y) || world_in_view(viewer->new_x, viewer->new_y, coordinates->new_x, coordinates->new_y)))
+        {
+            continue;
+        }
+
+        // With a budget a player's move is owed to each viewer and goes out with the next snapshot it wins a place in
+        if(server->snapshot_budget != 0 && client_index != SEND_QUEUE_NO_ORIGIN)
+        {
+            owe_update(env, server, room, room->members[m], client_index, header, coordinates, snapshot);
+            continue;
+        }
+
+        queue_packet(env, server, room, room->members[m], snapshot, client_index);
+    }
+
+    // Spectators get every move of every room once, through the group. A ghost is multicast by the
+    // zone that owns the player, sending it here as well would show it twice.
+    if(server->group_addr_len != 0 && client_index != SEND_QUEUE_NO_ORIGIN)
+    {
+        queue_packet(env, server, room, SEND_JOB_GROUP, snapshot, client_index);
+    }
+
+    packet_buffer_release(env, snapshot);
+}
+
+static bool changed_chunk(const struct coordinates *coordinates)
+{
+    return coordinates->old_x / WORLD_CHUNK_COLUMNS != coordinates->new_x / WORLD_CHUNK_COLUMNS || coordinates->old_y / WORLD_CHUNK_ROWS != coordinates->new_y / WORLD_CHUNK_ROWS;
+}
+
+// Sends the client where every member that just came into its view stands, as a move that starts and
+// ends on the same cell. previous is the move that changed the client's chunk, or NULL on join when
+// everything in view is new. Members that fall out of view are dropped by the client itself.
+static void stream_view(const struct p101_env *env, struct server_state *server, const struct room *room, const struct coordinates *previous, int client_index)
+{
+    const struct coordinates *viewer;
+    struct packet_header      header;
+
+    P101_TRACE(env);
+
+    viewer          = &server->clients[client_index].coordinates;
+    header.sequence = 0;
+    header.room     = room->simulated_id;
+
+    for(uint32_t m = 0; m < room->member_count; m++)
+    {
+        const struct coordinates *other;
+        struct coordinates        position;
+        struct packet_buffer     *packet;
+
+        other = &server->clients[room->members[m]].coordinates;
+        if(room->members[m] == client_index || !world_in_view(viewer->new_x, viewer->new_y, other->new_x, other->new_y))
+        {
+            continue;
+        }
+
+        if(previous != NULL && world_in_view(previous->old_x, previous->old_y, other->new_x, other->new_y))
+        {
+            continue;
+        }
+
+        position.old_x = other->new_x;
+        position.old_y = other->new_y;
+        position.new_x = other->new_x;
+        position.new_y = other->new_y;
+        if(server->snapshot_budget != 0 && priority_accumulator_reveal(env, &server->accumulators[client_index], room->members[m], &header, &position))
+        {
+            server->snapshots_waiting[room_thread(server, room)] = true;
+            continue;
+        }
+
+        packet = packet_pool_acquire(env, &server->pool);
+        if(packet == NULL)
+        {
+            fprintf(stderr, "Packet pool exhausted, dropping view update in room %u\n", room->simulated_id);
+            return;
+        }
+
+        serialize_header_to_buffer(env, &header, packet->data);
+        serialize_position_to_buffer(env, &position, packet->data + PACKET_HEADER_SIZE);
+        packet->length = POSITION_PACKET_SIZE;
+
+        // Queued as if the other member had moved, so a real move of theirs coalesces with it
+        queue_packet(env, server, room, client_index, packet, room->members[m]);
+        packet_buffer_release(env, packet);
+    }
+}
+
+// Straight into the recipient's queue, or with a send stage over to the sender that owns the queue
+static void queue_packet(const struct p101_env *env, struct server_state *server, const struct room *room, int recipient, struct packet_buffer *packet, int origin)
+{
+    struct send_job job;
+
+    P101_TRACE(env);
+
+    if(server->sender_count == 0 && recipient == SEND_JOB_GROUP)
+    {
+        push_group_packet(env, server, room_thread(server, room), packet, origin);
+        return;
+    }
+
+    if(server->sender_count == 0)
+    {
+        send_queue_push(env, &server->queues[recipient], packet, origin);
+        return;
+    }
+
+    if(packet != NULL)
+    {
+        packet_buffer_retain(env, packet);
+    }
+
+    job.recipient = recipient;
+    job.origin    = origin;
+    job.packet    = packet;
+    staged_worker_post(env, &server->senders[room_thread(server, room)], &job);
+}
+
+// An exit jumps the queue on the next tick. A viewer with no slot left gets the move right away, as
+// if there were no budget.
+static void owe_update(const struct p101_env *env, struct server_state *server, const struct room *room, int viewer, int entity, const struct packet_header *header, const struct coordinates *coordinates, struct packet_buffer *packet)
+{
+    uint32_t thread;
+
+    P101_TRACE(env);
+
+    thread = room_thread(server, room);
+    if(!priority_accumulator_push(env, &server->accumulators[viewer], entity, header, coordinates, is_exit(coordinates), &server->snapshot_stats[thread]))
+    {
+        server->snapshot_stats[thread].overflows++;
+        queue_packet(env, server, room, viewer, packet, entity);
+        return;
+    }
+
+    server->snapshots_waiting[thread] = true;
+}
+
+// Once a tick, every viewer in the thread's rooms gets the updates it is owed that fit its budget, the most
+// important first. With adapted rates a viewer is only due every few ticks, and gets what fits its own budget.
+// Returns true while some viewer is still owed updates.
+static bool send_snapshots(const struct p101_env *env, struct server_state *server, uint32_t worker)
+{
+    struct pending_update taken[PRIORITY_ACCUMULATOR_SLOTS];
+    uint32_t              stride;
+    uint32_t              max_updates;
+    int64_t               now_ns;
+    bool                  adapted;
+    bool                  waiting;
+
+    P101_TRACE(env);
+
+    if(!server->snapshots_waiting[worker])
+    {
+        return false;
+    }
+
+    now_ns = monotonic_now_ns();
+    if(now_ns < server->next_snapshot_ns[worker])
+    {
+        return true;
+    }
+
+    server->next_snapshot_ns[worker] = now_ns + SNAPSHOT_TICK_NS;
+    stride                           = server->worker_count == 0 ? 1 : server->worker_count;
+    max_updates                      = snapshot_updates_for_budget(server->snapshot_budget);
+    adapted                          = server->rate_limits.max_interval_ticks != 0;
+    waiting                          = false;
+    for(uint32_t r = worker; r < MAX_ROOMS; r += stride)
+    {
+        const struct room *room;
+
+        room = &server->rooms.rooms[r];
+        for(uint32_t m = 0; m < room->member_count; m++)
+        {
+            struct priority_accumulator *accumulator;
+            struct send_rate            *rate;
+            const struct coordinates    *viewer;
+            uint32_t                     count;
+
+            accumulator = &server->accumulators[room->members[m]];
+            if(accumulator->count == 0)
+            {
+                continue;
+            }
+
+            // Not its turn, what it is owed waits and gathers in the accumulator
+            rate = &server->rates[room->members[m]];
+            if(adapted && !send_rate_due(rate, &server->rate_limits, now_ns))
+            {
+                waiting = true;
+                continue;
+            }
+
+            viewer = &server->clients[room->members[m]].coordinates;
+            count  = priority_accumulator_take(env, accumulator, viewer->new_x, viewer->new_y, adapted ? snapshot_updates_for_budget(send_rate_update_budget(rate)) : max_updates, taken);
+            pack_snapshot(env, server, room, room->members[m], taken, count);
+            if(adapted)
+            {
+                send_rate_schedule(rate, &server->rate_limits, now_ns);
+            }
+            server->snapshot_stats[worker].deferred += accumulator->count;
+            waiting                                  = waiting || accumulator->count > 0;
+        }
+    }
+
+    server->snapshots_waiting[worker] = waiting;
+    return waiting;
+}
+
+// Position packets back to back, as many to a datagram as fit. With adapted rates each datagram opens with
+// a record that carries its sequence number, for the viewer to ack.
+static void pack_snapshot(const struct p101_env *env, struct server_state *server, const struct room *room, int viewer, const struct pending_update *updates, uint32_t count)
+{
+    struct snapshot_stats *stats;
+    uint32_t               per_datagram;
+    bool                   adapted;
+
+    P101_TRACE(env);
+
+    stats        = &server->snapshot_stats[room_thread(server, room)];
+    adapted      = server->rate_limits.max_interval_ticks != 0;
+    per_datagram = adapted ? SNAPSHOT_MAX_UPDATES - 1 : SNAPSHOT_MAX_UPDATES;
+    for(uint32_t first = 0; first < count; first += per_datagram)
+    {
+        struct packet_buffer *packet;
+        uint32_t              last;
+
+        packet = packet_pool_acquire(env, &server->pool);
+        if(packet == NULL)
+        {
+            fprintf(stderr, "Packet pool exhausted, dropping snapshot in room %u\n", room->simulated_id);
+            return;
+        }
+
+        last           = first + per_datagram < count ? first + per_datagram : count;
+        packet->length = 0;
+        if(adapted)
+        {
+            struct packet_header header;
+            struct coordinates   opener;
+
+            header.sequence = send_rate_next_sequence(env, &server->rates[viewer], monotonic_now_ns() / NANOSECONDS_PER_MICROSECOND);
+            header.room     = room->simulated_id;
+            opener.old_x    = 0;
+            opener.old_y    = 0;
+            opener.new_x    = SNAPSHOT_COORDINATE;
+            opener.new_y    = SNAPSHOT_COORDINATE;
+            serialize_header_to_buffer(env, &header, packet->data);
+            serialize_position_to_buffer(env, &opener, packet->data + PACKET_HEADER_SIZE);
+            packet->length = POSITION_PACKET_SIZE;
+        }
+
+        for(uint32_t i = first; i < last; i++)
+        {
+            serialize_header_to_buffer(env, &updates[i].header, packet->data + packet->length);
+            serialize_position_to_buffer(env, &updates[i].coordinates, packet->data + packet->length + PACKET_HEADER_SIZE);
+            packet->length += POSITION_PACKET_SIZE;
+        }
+
+        queue_packet(env, server, room, viewer, packet, SEND_QUEUE_NO_ORIGIN);
+        packet_buffer_release(env, packet);
+        stats->datagrams++;
+        stats->updates += last - first;
+    }
+}
+
+// Index of the thread that simulates the room, and of its sender when there is a send stage
+static uint32_t room_thread(const struct server_state *server, const struct room *room)
+{
+    return server->worker_count == 0 ? 0 : (uint32_t)(room - server->rooms.rooms) % server->worker_count;
+}
@@ -0,0 +1,396 @@
+#include "../include/hot_restart.h"
+
+#define HOT_RESTART_BACKLOG 1
+
+static bool  unix_address(struct sockaddr_un *addr, const char *path);
+static bool  read_full(int fd, uint8_t *buffer, size_t length);
+static bool  write_full(int fd, const uint8_t *buffer, size_t length);
+static void *accept_successor(void *arg);
+static void  wake_handler(int signum);
+
+void hot_restart_init(const struct p101_env *env, struct hot_restart *restart, const char *path)
+{
+    P101_TRACE(env);
+
+    memset(restart, 0, sizeof(*restart));
+    restart->path      = path;
+    restart->listen_fd = -1;
+    atomic_init(&restart->successor_fd, -1);
+    atomic_init(&restart->acknowledged, false);
+}
+
+// Returns true and sets sockfd if a running server handed over its socket. No server listening
+// on the path, or a stale path left behind by a crash, means a normal start.
+bool hot_restart_inherit(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart, int *sockfd)
+{
+    struct sockaddr_un addr;
+    struct msghdr      msg;
+    struct iovec       iov;
+    struct cmsghdr    *cmsg;
+    uint8_t            header[HOT_RESTART_HEADER_SIZE];
+    uint32_t           fields[3];
+    ssize_t            bytes_read;
+    int                fd;
+    int                inherited_fd;
+    bool               inherited;
+
+    union
+    {
+        struct cmsghdr align;
+        uint8_t        buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    P101_TRACE(env);
+
+    inherited = false;
+    if(!unix_address(&addr, restart->path))
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart path is too long", EXIT_FAILURE);
+        goto done;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart socket creation failed", EXIT_FAILURE);
+        goto done;
+    }
+
+    if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+    {
+        if(errno != ENOENT && errno != ECONNREFUSED)
+        {
+            P101_ERROR_RAISE_USER(err, "could not reach the running server", EXIT_FAILURE);
+        }
+        goto close_socket;
+    }
+
+    printf("Taking over from the server on %s\n", restart->path);
+
+    // The descriptor rides on the first bytes of the header
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base       = header;
+    iov.iov_len        = sizeof(header);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    do
+    {
+        bytes_read = recvmsg(fd, &msg, 0);
+    } while(bytes_read == -1 && errno == EINTR);
+
+    cmsg = bytes_read > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if(cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        P101_ERROR_RAISE_USER(err, "running server did not hand over its socket", EXIT_FAILURE);
+        goto close_socket;
+    }
+    memcpy(&inherited_fd, CMSG_DATA(cmsg), sizeof(inherited_fd));
+
+    if(!read_full(fd, header + bytes_read, sizeof(header) - (size_t)bytes_read))
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart header truncated", EXIT_FAILURE);
+        goto close_inherited;
+    }
+
+    memcpy(fields, header, sizeof(fields));
+    if(ntohl(fields[0]) != HOT_RESTART_MAGIC || ntohl(fields[1]) != HOT_RESTART_VERSION || ntohl(fields[2]) > HOT_RESTART_MAX_SNAPSHOT)
+    {
+        P101_ERROR_RAISE_USER(err, "running server speaks another hot restart version", EXIT_FAILURE);
+        goto close_inherited;
+    }
+
+    restart->snapshot_length = ntohl(fields[2]);
+    restart->snapshot        = (uint8_t *)malloc(restart->snapshot_length + 1);
+    if(restart->snapshot == NULL || !read_full(fd, restart->snapshot, restart->snapshot_length))
+    {
+        P101_ERROR_RAISE_USER(err, "could not read the hot restart snapshot", EXIT_FAILURE);
+        free(restart->snapshot);
+        restart->snapshot = NULL;
+        goto close_inherited;
+    }
+
+    *sockfd   = inherited_fd;
+    inherited = true;
+    goto close_socket;
+
+close_inherited:
+    close(inherited_fd);
+
+close_socket:
+    close(fd);
+
+done:
+    return inherited;
+}
+
+void hot_restart_listen(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart)
+{
+    struct sockaddr_un addr;
+    struct sigaction   sa;
+
+    P101_TRACE(env);
+
+    if(!unix_address(&addr, restart->path))
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart path is too long", EXIT_FAILURE);
+        goto done;
+    }
+
+    restart->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(restart->listen_fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart socket creation failed", EXIT_FAILURE);
+        goto done;
+    }
+
+    // Replaces the predecessor's listener, or one left behind by a crash; the predecessor never unlinks after handing over
+    unlink(restart->path);
+    if(bind(restart->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(restart->listen_fd, HOT_RESTART_BACKLOG) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not listen for hot restart", EXIT_FAILURE);
+        goto close_socket;
+    }
+
+    // The accept thread interrupts the main thread's wait with SIGUSR2, so no SA_RESTART
+    memset(&sa, 0, sizeof(sa));
+#if defined(__clang__)
+    #pragma clang diagnostic push
+    #pragma clang diagnostic ignored "-Wdisabled-macro-expansion"
+#endif
+    sa.sa_handler = wake_handler;
+#if defined(__clang__)
+    #pragma clang diagnostic pop
+#endif
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGUSR2, &sa, NULL) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "sigaction SIGUSR2 failed", EXIT_FAILURE);
+        goto close_socket;
+    }
+
+    restart->main_thread = pthread_self();
+    if(pthread_create(&restart->thread, NULL, accept_successor, restart) != 0)
+    {
+        P101_ERROR_RAISE_USER(err, "hot restart thread creation failed", EXIT_FAILURE);
+        goto close_socket;
+    }
+    restart->thread_started = true;
+    goto done;
+
+close_socket:
+    close(restart->listen_fd);
+    restart->listen_fd = -1;
+
+done:
+    return;
+}
+
+bool hot_restart_requested(const struct p101_env *env, struct hot_restart *restart)
+{
+    P101_TRACE(env);
+
+    if(atomic_load(&restart->successor_fd) == -1)
+    {
+        return false;
+    }
+
+    atomic_store(&restart->acknowledged, true);
+    return true;
+}
+
+void hot_restart_hand_over(const struct p101_env *env, struct p101_error *err, struct hot_restart *restart, int sockfd, const uint8_t *snapshot, size_t length)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    uint32_t        fields[3];
+    ssize_t         bytes_written;
+    int             successor_fd;
+
+    union
+    {
+        struct cmsghdr align;
+        uint8_t        buffer[CMSG_SPACE(sizeof(int))];
+    } control;
+
+    P101_TRACE(env);
+
+    successor_fd = atomic_load(&restart->successor_fd);
+    fields[0]    = htonl(HOT_RESTART_MAGIC);
+    fields[1]    = htonl(HOT_RESTART_VERSION);
+    fields[2]    = htonl((uint32_t)length);
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+    iov.iov_base       = fields;
+    iov.iov_len        = sizeof(fields);
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buffer;
+    msg.msg_controllen = sizeof(control.buffer);
+
+    cmsg             = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &sockfd, sizeof(sockfd));
+
+    do
+    {
+        bytes_written = sendmsg(successor_fd, &msg, 0);
+    } while(bytes_written == -1 && errno == EINTR);
+
+    if(bytes_written == -1 || !write_full(successor_fd, (const uint8_t *)fields + bytes_written, sizeof(fields) - (size_t)bytes_written) || !write_full(successor_fd, snapshot, length))
+    {
+        P101_ERROR_RAISE_USER(err, "could not hand the socket to the new server", EXIT_FAILURE);
+        return;
+    }
+
+    // The path belongs to the successor from here on
+    restart->path = NULL;
+    printf("Handed the socket and a %zu byte snapshot to the new server\n", length);
+}
+
+void hot_restart_close(const struct p101_env *env, struct hot_restart *restart)
+{
+    int successor_fd;
+
+    P101_TRACE(env);
+
+    if(restart->thread_started)
+    {
+        pthread_cancel(restart->thread);
+        pthread_join(restart->thread, NULL);
+        restart->thread_started = false;
+    }
+
+    successor_fd = atomic_exchange(&restart->successor_fd, -1);
+    if(successor_fd != -1)
+    {
+        close(successor_fd);
+    }
+
+    if(restart->listen_fd != -1)
+    {
+        close(restart->listen_fd);
+        restart->listen_fd = -1;
+
+        if(restart->path != NULL)
+        {
+            unlink(restart->path);
+        }
+    }
+
+    free(restart->snapshot);
+    restart->snapshot = NULL;
+}
+
+static bool unix_address(struct sockaddr_un *addr, const char *path)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr->sun_path))
+    {
+        return false;
+    }
+
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+static bool read_full(int fd, uint8_t *buffer, size_t length)
+{
+    size_t total;
+
+    total = 0;
+    while(total < length)
+    {
+        ssize_t bytes_read;
+
+        bytes_read = read(fd, buffer + total, length - total);
+        if(bytes_read == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(bytes_read <= 0)
+        {
+            return false;
+        }
+
+        total += (size_t)bytes_read;
+    }
+
+    return true;
+}
+
+static bool write_full(int fd, const uint8_t *buffer, size_t length)
+{
+    size_t total;
+
+    total = 0;
+    while(total < length)
+    {
+        ssize_t bytes_written;
+
+        bytes_written = write(fd, buffer + total, length - total);
+        if(bytes_written == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if(bytes_written == -1)
+        {
+            return false;
+        }
+
+        total += (size_t)bytes_written;
+    }
+
+    return true;
+}
+
+static void *accept_successor(void *arg)
+{
+    struct hot_restart *restart;
+    struct timespec     interval;
+    int                 fd;
+
+    restart = (struct hot_restart *)arg;
+
+    do
+    {
+        fd = accept(restart->listen_fd, NULL, NULL);
+    } while(fd == -1 && errno == EINTR);
+
+    if(fd == -1)
+    {
+        return NULL;
+    }
+
+    atomic_store(&restart->successor_fd, fd);
+
+    // The main thread may be between its loop check and its wait when the first signal lands, so keep nudging until it notices
+    interval.tv_sec  = 0;
+    interval.tv_nsec = HOT_RESTART_WAKE_INTERVAL_NS;
+    while(!atomic_load(&restart->acknowledged))
+    {
+        pthread_kill(restart->main_thread, SIGUSR2);
+        nanosleep(&interval, NULL);
+    }
+
+    return NULL;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+static void wake_handler(int signum)
+{
+}
+
+#pragma GCC diagnostic pop
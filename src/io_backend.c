@@ -0,0 +1,248 @@
+#include "../include/io_backend.h"
+
+static void                   syscall_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+static void                   syscall_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static bool                   syscall_receive_one(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static enum send_queue_status syscall_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+static void                   syscall_destroy(const struct p101_env *env, struct io_backend *backend);
+
+static const struct io_backend_ops syscall_ops = {"syscall", syscall_wait, syscall_receive, syscall_flush, syscall_destroy, NULL, NULL};
+
+void io_backend_create(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, enum io_backend_kind kind, int sockfd, struct packet_pool *pool, bool offload)
+{
+    P101_TRACE(env);
+
+    memset(backend, 0, sizeof(*backend));
+    backend->sockfd = sockfd;
+    backend->pool   = pool;
+
+    if(kind == IO_BACKEND_URING)
+    {
+        if(io_uring_backend_init(env, backend))
+        {
+            if(offload)
+            {
+                fputs("UDP GSO/GRO is not used with the io_uring backend\n", stderr);
+            }
+            goto done;
+        }
+
+        fputs("io_uring backend unavailable, falling back to syscalls\n", stderr);
+    }
+
+    backend->ops = &syscall_ops;
+    udp_offload_enable(env, sockfd, &backend->offload, offload);
+
+    // A GRO read can hold many datagrams so it needs its own large buffer, otherwise one pooled buffer is enough
+    if(backend->offload.gro)
+    {
+        backend->gro_buffer = (uint8_t *)malloc(UDP_GRO_BUFFER_SIZE);
+        if(backend->gro_buffer == NULL)
+        {
+            P101_ERROR_RAISE_USER(err, "GRO buffer allocation failed", EXIT_FAILURE);
+            goto done;
+        }
+    }
+
+done:
+    if(backend->ops != NULL)
+    {
+        printf("Using %s network backend\n", backend->ops->name);
+    }
+}
+
+// Returns once the socket has something to read, queued sends can go again, or timeout_ms has passed
+void io_backend_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms)
+{
+    P101_TRACE(env);
+
+    backend->ops->wait(env, err, backend, pending_sends, timeout_ms);
+}
+
+void io_backend_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    P101_TRACE(env);
+
+    backend->ops->receive(env, err, backend, handler, arg);
+}
+
+enum send_queue_status io_backend_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen)
+{
+    P101_TRACE(env);
+
+    return backend->ops->flush(env, backend, queue, addr, addrlen);
+}
+
+// Stops taking datagrams off the socket and hands over any the backend already took, so whatever
+// is still queued in the kernel stays there for the next reader of the socket
+void io_backend_quiesce(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    P101_TRACE(env);
+
+    if(backend->ops->quiesce != NULL)
+    {
+        backend->ops->quiesce(env, err, backend, handler, arg);
+    }
+}
+
+// Pushes out flushed sends that are only queued in the backend and waits up to timeout_ms for them to
+// complete. True once none are left in flight, the backend can then be destroyed without losing any.
+bool io_backend_settle(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg, int timeout_ms)
+{
+    P101_TRACE(env);
+
+    if(backend->ops->settle == NULL)
+    {
+        return true;
+    }
+
+    return backend->ops->settle(env, err, backend, handler, arg, timeout_ms);
+}
+
+void io_backend_destroy(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    if(backend->ops != NULL)
+    {
+        backend->ops->destroy(env, backend);
+    }
+
+    backend->ops = NULL;
+}
+
+static void syscall_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms)
+{
+    struct pollfd pfd;
+
+    P101_TRACE(env);
+
+    pfd.fd            = backend->sockfd;
+    pfd.events        = POLLIN;
+    pfd.revents       = 0;
+    backend->readable = false;
+
+    // Only ask for writability while something is queued, otherwise poll would spin
+    if(pending_sends)
+    {
+        pfd.events |= POLLOUT;
+    }
+
+    if(poll(&pfd, 1, timeout_ms) == -1)
+    {
+        if(errno != EINTR)
+        {
+            P101_ERROR_RAISE_USER(err, "poll failed", EXIT_FAILURE);
+        }
+        return;
+    }
+
+    backend->readable = (pfd.revents & POLLIN) != 0;
+}
+
+static void syscall_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    P101_TRACE(env);
+
+    if(!backend->readable)
+    {
+        return;
+    }
+
+    for(int i = 0; i < IO_RECEIVE_BATCH_SIZE; i++)
+    {
+        if(!syscall_receive_one(env, err, backend, handler, arg) || p101_error_has_error(err))
+        {
+            break;
+        }
+    }
+}
+
+static bool syscall_receive_one(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    struct sockaddr_storage client_addr;
+    struct receive_metadata metadata;
+    socklen_t               client_addr_len;
+    struct packet_buffer   *packet;
+    uint8_t                *data;
+    size_t                  capacity;
+    size_t                  segment_size;
+    ssize_t                 bytes_read;
+
+    P101_TRACE(env);
+
+    client_addr_len = sizeof(client_addr);
+    memset(&client_addr, 0, sizeof(client_addr));
+
+    packet = NULL;
+    if(backend->gro_buffer != NULL)
+    {
+        data     = backend->gro_buffer;
+        capacity = UDP_GRO_BUFFER_SIZE;
+    }
+    else
+    {
+        packet = packet_pool_acquire(env, backend->pool);
+        if(packet == NULL)
+        {
+            // Pool exhausted, discard the datagram so it does not sit at the head of the receive queue
+            return recv(backend->sockfd, NULL, 0, MSG_DONTWAIT) != -1;
+        }
+        data     = packet->data;
+        capacity = PACKET_BUFFER_SIZE;
+    }
+
+    bytes_read = socket_read_message(env, backend->sockfd, data, capacity, MSG_DONTWAIT, (struct sockaddr *)&client_addr, &client_addr_len, &metadata);
+    if(bytes_read == -1)
+    {
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            P101_ERROR_RAISE_USER(err, "recvmsg failed", EXIT_FAILURE);
+        }
+
+        if(packet != NULL)
+        {
+            packet_buffer_release(env, packet);
+        }
+        return false;
+    }
+
+    segment_size = metadata.segment_size != 0 ? metadata.segment_size : (size_t)bytes_read;
+    if(segment_size == 0)
+    {
+        segment_size = 1;    // An empty datagram is still one datagram
+    }
+
+    for(size_t offset = 0; offset < (size_t)bytes_read || offset == 0; offset += segment_size)
+    {
+        size_t length;
+
+        length = (size_t)bytes_read - offset < segment_size ? (size_t)bytes_read - offset : segment_size;
+        handler(env, err, arg, (const struct sockaddr *)&client_addr, data + offset, length, &metadata);
+
+        // Only the first segment carries new drop counts, the rest would count them again
+        metadata.has_kernel_drops = false;
+    }
+
+    if(packet != NULL)
+    {
+        packet_buffer_release(env, packet);
+    }
+
+    return true;
+}
+
+static enum send_queue_status syscall_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen)
+{
+    P101_TRACE(env);
+
+    return send_queue_flush(env, queue, &backend->offload, backend->sockfd, addr, addrlen);
+}
+
+static void syscall_destroy(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    free(backend->gro_buffer);
+    backend->gro_buffer = NULL;
+}
@@ -0,0 +1,743 @@
+#include "../include/io_backend.h"
+
+#if defined(__linux__)
+
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+
+    #define URING_ENTRIES 256
+    #define URING_RECV_BUFFERS 256    // Must be a power of two, it sizes the provided buffer ring
+    #define URING_RECV_BUFFER_SIZE 2048
+    #define URING_SEND_SLOTS 128
+    #define URING_BUFFER_GROUP 0
+    #define URING_RECV_TAG UINT64_MAX
+    #define URING_CANCEL_TAG (UINT64_MAX - 1)
+    #define URING_POLL_TAG (UINT64_MAX - 2)
+    #define URING_NO_SLOT UINT32_MAX
+
+// A send in flight owns its msghdr and destination until the completion arrives
+struct uring_send_slot
+{
+    struct msghdr           msg;
+    struct iovec            iov;
+    struct sockaddr_storage addr;
+    struct packet_buffer   *packet;
+    struct send_queue      *queue;
+    uint32_t                next_free;
+    uint32_t                next_blocked;
+};
+
+struct uring_state
+{
+    int                       ring_fd;
+    bool                      fixed_file;
+    unsigned                 *sq_head;
+    unsigned                 *sq_tail;
+    unsigned                 *sq_array;
+    unsigned                  sq_mask;
+    unsigned                  sq_entries;
+    unsigned                  sq_local_tail;
+    unsigned                  to_submit;
+    struct io_uring_sqe      *sqes;
+    unsigned                 *cq_head;
+    unsigned                 *cq_tail;
+    unsigned                  cq_mask;
+    struct io_uring_cqe      *cqes;
+    void                     *sq_ring;
+    size_t                    sq_ring_size;
+    void                     *cq_ring;
+    size_t                    cq_ring_size;
+    size_t                    sqes_size;
+    struct io_uring_buf_ring *buf_ring;
+    size_t                    buf_ring_size;
+    uint8_t                  *recv_buffers;
+    uint16_t                  buf_ring_tail;
+    struct msghdr             recv_msg;    // Multishot template, only the name and control lengths are read
+    bool                      recv_armed;
+    bool                      quiescing;    // Receive was cancelled on purpose, do not arm it again
+    struct uring_send_slot    slots[URING_SEND_SLOTS];
+    uint32_t                  free_slot;
+    uint32_t                  in_flight;    // Slots holding a send that has not completed, submitted or not
+    uint32_t                  blocked_slot;    // Sends that found the socket buffer full, sent again once it has room
+};
+
+static void                   uring_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+static void                   uring_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static enum send_queue_status uring_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+static void                   uring_destroy(const struct p101_env *env, struct io_backend *backend);
+static void                   uring_quiesce(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static bool                   uring_settle(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg, int timeout_ms);
+static bool                   uring_map_rings(struct uring_state *state, const struct io_uring_params *params);
+static bool                   uring_register_buffers(struct uring_state *state);
+static struct io_uring_sqe   *uring_get_sqe(struct uring_state *state);
+static int                    uring_submit(struct uring_state *state, unsigned min_complete);
+static int                    uring_submit_and_wait(struct uring_state *state, int timeout_ms);
+static bool                   uring_arm_receive(struct uring_state *state, int sockfd);
+static void                   uring_prep_send(const struct uring_state *state, struct io_uring_sqe *sqe, uint32_t slot_index, int sockfd);
+static void                   uring_resubmit_blocked(struct uring_state *state, int sockfd);
+static void                   uring_handle_receive(const struct p101_env *env, struct p101_error *err, struct uring_state *state, const struct io_uring_cqe *cqe, io_receive_handler handler, void *arg, unsigned *recycled);
+static void                   uring_handle_send(const struct p101_env *env, struct uring_state *state, const struct io_uring_cqe *cqe);
+static void                   uring_recycle_buffer(struct uring_state *state, uint16_t bid, unsigned offset);
+static void                   uring_free_state(const struct p101_env *env, struct uring_state *state);
+
+static const struct io_backend_ops uring_ops = {"io_uring", uring_wait, uring_receive, uring_flush, uring_destroy, uring_quiesce, uring_settle};
+
+bool io_uring_backend_init(const struct p101_env *env, struct io_backend *backend)
+{
+    struct uring_state    *state;
+    struct io_uring_params params;
+
+    P101_TRACE(env);
+
+    state = (struct uring_state *)calloc(1, sizeof(*state));
+    if(state == NULL)
+    {
+        return false;
+    }
+    state->ring_fd = -1;
+
+    memset(&params, 0, sizeof(params));
+    params.flags   = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+    state->ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if(state->ring_fd == -1 && errno == EINVAL)
+    {
+        // Older kernels reject the optional setup flags, the ring still works without them
+        memset(&params, 0, sizeof(params));
+        state->ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+
+    if(state->ring_fd == -1)
+    {
+        fprintf(stderr, "io_uring_setup failed: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    if(!uring_map_rings(state, &params) || !uring_register_buffers(state))
+    {
+        goto fail;
+    }
+
+    // A registered file skips the fd table lookup on every submission, but is only an optimisation
+    state->fixed_file = syscall(__NR_io_uring_register, state->ring_fd, IORING_REGISTER_FILES, &backend->sockfd, 1) == 0;
+
+    for(uint32_t i = 0; i < URING_SEND_SLOTS; i++)
+    {
+        state->slots[i].next_free = i + 1 < URING_SEND_SLOTS ? i + 1 : URING_NO_SLOT;
+    }
+    state->free_slot    = 0;
+    state->blocked_slot = URING_NO_SLOT;
+
+    // The socket stays non-blocking, other writers share it. Sends that hit a full buffer complete with
+    // -EAGAIN and go out again once the socket polls writable.
+
+    // Multishot recvmsg needs Linux 6.0, an older kernel fails the request straight away at submit time
+    if(!uring_arm_receive(state, backend->sockfd) || uring_submit(state, 0) < 0)
+    {
+        goto fail;
+    }
+
+    if(*state->cq_head != __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        const struct io_uring_cqe *cqe;
+
+        cqe = &state->cqes[*state->cq_head & state->cq_mask];
+        if(cqe->user_data == URING_RECV_TAG && cqe->res < 0 && (cqe->flags & IORING_CQE_F_MORE) == 0)
+        {
+            fprintf(stderr, "io_uring multishot recvmsg unsupported: %s\n", strerror(-cqe->res));
+            goto fail;
+        }
+    }
+
+    backend->ops   = &uring_ops;
+    backend->state = state;
+    return true;
+
+fail:
+    uring_free_state(env, state);
+    return false;
+}
+
+static void uring_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms)
+{
+    struct uring_state *state;
+    unsigned            min_complete;
+    int                 result;
+
+    P101_TRACE(env);
+
+    (void)pending_sends;    // Blocked sends are waiting on slots, and only completions free those
+    state = (struct uring_state *)backend->state;
+    uring_resubmit_blocked(state, backend->sockfd);
+
+    // Don't block if completions are already waiting to be reaped
+    min_complete = *state->cq_head == __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE) ? 1 : 0;
+
+    result = min_complete > 0 && timeout_ms != IO_WAIT_FOREVER ? uring_submit_and_wait(state, timeout_ms) : uring_submit(state, min_complete);
+    if(result < 0)
+    {
+        if(errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME)
+        {
+            P101_ERROR_RAISE_USER(err, "io_uring_enter failed", EXIT_FAILURE);
+        }
+    }
+}
+
+static void uring_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    struct uring_state *state;
+    unsigned            head;
+    unsigned            tail;
+    unsigned            recycled;
+
+    P101_TRACE(env);
+
+    state    = (struct uring_state *)backend->state;
+    head     = *state->cq_head;
+    tail     = __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE);
+    recycled = 0;
+
+    // Reap everything that completed in one pass, then hand the ring back in a single store
+    while(head != tail)
+    {
+        const struct io_uring_cqe *cqe;
+
+        cqe = &state->cqes[head & state->cq_mask];
+        if(cqe->user_data == URING_RECV_TAG)
+        {
+            uring_handle_receive(env, err, state, cqe, handler, arg, &recycled);
+        }
+        else
+        {
+            uring_handle_send(env, state, cqe);
+        }
+        head++;
+    }
+
+    __atomic_store_n(state->cq_head, head, __ATOMIC_RELEASE);
+
+    if(recycled > 0)
+    {
+        state->buf_ring_tail = (uint16_t)(state->buf_ring_tail + recycled);
+        __atomic_store_n(&state->buf_ring->tail, state->buf_ring_tail, __ATOMIC_RELEASE);
+    }
+
+    if(!state->recv_armed && !state->quiescing && !uring_arm_receive(state, backend->sockfd))
+    {
+        P101_ERROR_RAISE_USER(err, "io_uring could not re-arm receive", EXIT_FAILURE);
+    }
+}
+
+static enum send_queue_status uring_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct uring_state *state;
+
+    P101_TRACE(env);
+
+    state = (struct uring_state *)backend->state;
+
+    while(queue->count > 0)
+    {
+        struct uring_send_slot *slot;
+        struct io_uring_sqe    *sqe;
+        uint32_t                slot_index;
+
+        slot_index = state->free_slot;
+        if(slot_index == URING_NO_SLOT)
+        {
+            return SEND_QUEUE_BLOCKED;
+        }
+
+        sqe = uring_get_sqe(state);
+        if(sqe == NULL)
+        {
+            // Submission ring is full, push what is there without waiting and try once more
+            uring_submit(state, 0);
+            sqe = uring_get_sqe(state);
+            if(sqe == NULL)
+            {
+                return SEND_QUEUE_BLOCKED;
+            }
+        }
+
+        slot             = &state->slots[slot_index];
+        state->free_slot = slot->next_free;
+        state->in_flight++;
+
+        // The queue drops its reference when the entry is popped, the slot keeps one until completion
+        slot->packet = queue->entries[queue->head].packet;
+        slot->queue  = queue;
+        packet_buffer_retain(env, slot->packet);
+        send_queue_pop(env, queue);
+
+        memcpy(&slot->addr, addr, addrlen);
+        memset(&slot->msg, 0, sizeof(slot->msg));
+        slot->iov.iov_base    = slot->packet->data;
+        slot->iov.iov_len     = slot->packet->length;
+        slot->msg.msg_name    = &slot->addr;
+        slot->msg.msg_namelen = addrlen;
+        slot->msg.msg_iov     = &slot->iov;
+        slot->msg.msg_iovlen  = 1;
+        uring_prep_send(state, sqe, slot_index, backend->sockfd);
+    }
+
+    return SEND_QUEUE_DRAINED;
+}
+
+static void uring_destroy(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    uring_free_state(env, (struct uring_state *)backend->state);
+    backend->state = NULL;
+}
+
+// Cancels the multishot receive and keeps reaping until its final completion, datagrams it already
+// pulled into provided buffers are handled on the way rather than lost with the ring
+static void uring_quiesce(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    struct uring_state  *state;
+    struct io_uring_sqe *sqe;
+
+    P101_TRACE(env);
+
+    state            = (struct uring_state *)backend->state;
+    state->quiescing = true;
+    if(!state->recv_armed)
+    {
+        return;
+    }
+
+    sqe = uring_get_sqe(state);
+    if(sqe == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "io_uring could not cancel receive", EXIT_FAILURE);
+        return;
+    }
+
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->addr      = URING_RECV_TAG;
+    sqe->user_data = URING_CANCEL_TAG;
+
+    while(state->recv_armed && !p101_error_has_error(err))
+    {
+        if(uring_submit(state, 1) < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            P101_ERROR_RAISE_USER(err, "io_uring_enter failed", EXIT_FAILURE);
+            return;
+        }
+
+        uring_receive(env, err, backend, handler, arg);
+    }
+}
+
+// Flush only fills submission entries, so sends still sit in the ring until something enters the
+// kernel. Submits them and reaps completions, waiting at most timeout_ms for the first one.
+static bool uring_settle(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg, int timeout_ms)
+{
+    struct uring_state *state;
+    int                 result;
+
+    P101_TRACE(env);
+
+    state = (struct uring_state *)backend->state;
+    if(state->in_flight == 0)
+    {
+        return true;
+    }
+
+    uring_resubmit_blocked(state, backend->sockfd);
+    result = *state->cq_head == __atomic_load_n(state->cq_tail, __ATOMIC_ACQUIRE) ? uring_submit_and_wait(state, timeout_ms) : uring_submit(state, 0);
+    if(result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY && errno != ETIME)
+    {
+        P101_ERROR_RAISE_USER(err, "io_uring_enter failed", EXIT_FAILURE);
+        return false;
+    }
+
+    uring_receive(env, err, backend, handler, arg);
+
+    return state->in_flight == 0;
+}
+
+static bool uring_map_rings(struct uring_state *state, const struct io_uring_params *params)
+{
+    uint8_t *sq_ring;
+    uint8_t *cq_ring;
+
+    state->sq_ring_size = params->sq_off.array + (params->sq_entries * sizeof(unsigned));
+    state->cq_ring_size = params->cq_off.cqes + (params->cq_entries * sizeof(struct io_uring_cqe));
+    state->sqes_size    = params->sq_entries * sizeof(struct io_uring_sqe);
+
+    // Newer kernels share one mapping for both rings
+    if(params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if(state->cq_ring_size > state->sq_ring_size)
+        {
+            state->sq_ring_size = state->cq_ring_size;
+        }
+        state->cq_ring_size = 0;
+    }
+
+    state->sq_ring = mmap(NULL, state->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_SQ_RING);
+    if(state->sq_ring == MAP_FAILED)
+    {
+        state->sq_ring = NULL;
+        return false;
+    }
+
+    if(state->cq_ring_size == 0)
+    {
+        state->cq_ring = NULL;
+        cq_ring        = (uint8_t *)state->sq_ring;
+    }
+    else
+    {
+        state->cq_ring = mmap(NULL, state->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_CQ_RING);
+        if(state->cq_ring == MAP_FAILED)
+        {
+            state->cq_ring = NULL;
+            return false;
+        }
+        cq_ring = (uint8_t *)state->cq_ring;
+    }
+
+    state->sqes = (struct io_uring_sqe *)mmap(NULL, state->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, state->ring_fd, IORING_OFF_SQES);
+    if(state->sqes == MAP_FAILED)
+    {
+        state->sqes = NULL;
+        return false;
+    }
+
+    sq_ring             = (uint8_t *)state->sq_ring;
+    state->sq_head      = (unsigned *)(void *)(sq_ring + params->sq_off.head);
+    state->sq_tail      = (unsigned *)(void *)(sq_ring + params->sq_off.tail);
+    state->sq_array     = (unsigned *)(void *)(sq_ring + params->sq_off.array);
+    state->sq_mask      = *(unsigned *)(void *)(sq_ring + params->sq_off.ring_mask);
+    state->sq_entries   = params->sq_entries;
+    state->sq_local_tail = *state->sq_tail;
+    state->cq_head      = (unsigned *)(void *)(cq_ring + params->cq_off.head);
+    state->cq_tail      = (unsigned *)(void *)(cq_ring + params->cq_off.tail);
+    state->cq_mask      = *(unsigned *)(void *)(cq_ring + params->cq_off.ring_mask);
+    state->cqes         = (struct io_uring_cqe *)(void *)(cq_ring + params->cq_off.cqes);
+
+    return true;
+}
+
+static bool uring_register_buffers(struct uring_state *state)
+{
+    struct io_uring_buf_reg reg;
+
+    state->buf_ring_size = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    state->buf_ring      = (struct io_uring_buf_ring *)mmap(NULL, state->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(state->buf_ring == MAP_FAILED)
+    {
+        state->buf_ring = NULL;
+        return false;
+    }
+
+    state->recv_buffers = (uint8_t *)aligned_alloc(CACHE_LINE_SIZE, (size_t)URING_RECV_BUFFERS * URING_RECV_BUFFER_SIZE);
+    if(state->recv_buffers == NULL)
+    {
+        return false;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr    = (uint64_t)(uintptr_t)state->buf_ring;
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid         = URING_BUFFER_GROUP;
+
+    if(syscall(__NR_io_uring_register, state->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1)
+    {
+        fprintf(stderr, "io_uring provided buffer ring unavailable: %s\n", strerror(errno));
+        munmap(state->buf_ring, state->buf_ring_size);
+        state->buf_ring = NULL;
+        return false;
+    }
+
+    for(uint16_t bid = 0; bid < URING_RECV_BUFFERS; bid++)
+    {
+        uring_recycle_buffer(state, bid, bid);
+    }
+    state->buf_ring_tail = URING_RECV_BUFFERS;
+    __atomic_store_n(&state->buf_ring->tail, state->buf_ring_tail, __ATOMIC_RELEASE);
+
+    // Every completion carries the source address and ancillary data ahead of the payload
+    state->recv_msg.msg_namelen    = sizeof(struct sockaddr_storage);
+    state->recv_msg.msg_controllen = RECEIVE_CONTROL_SIZE;
+
+    return true;
+}
+
+static struct io_uring_sqe *uring_get_sqe(struct uring_state *state)
+{
+    struct io_uring_sqe *sqe;
+    unsigned             index;
+
+    if(state->sq_local_tail - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE) >= state->sq_entries)
+    {
+        return NULL;
+    }
+
+    index                  = state->sq_local_tail & state->sq_mask;
+    sqe                    = &state->sqes[index];
+    state->sq_array[index] = index;
+    state->sq_local_tail++;
+    state->to_submit++;
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+static int uring_submit(struct uring_state *state, unsigned min_complete)
+{
+    unsigned flags;
+    int      submitted;
+
+    __atomic_store_n(state->sq_tail, state->sq_local_tail, __ATOMIC_RELEASE);
+
+    flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if(state->to_submit == 0 && flags == 0)
+    {
+        return 0;
+    }
+
+    submitted = (int)syscall(__NR_io_uring_enter, state->ring_fd, state->to_submit, min_complete, flags, NULL, 0);
+    if(submitted >= 0)
+    {
+        state->to_submit -= (unsigned)submitted;
+    }
+
+    return submitted;
+}
+
+// Like uring_submit waiting for one completion, but gives up after timeout_ms with ETIME. The
+// extended argument came with 5.11, well before the provided buffer rings this backend needs.
+static int uring_submit_and_wait(struct uring_state *state, int timeout_ms)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec      timeout;
+    int                           submitted;
+
+    __atomic_store_n(state->sq_tail, state->sq_local_tail, __ATOMIC_RELEASE);
+
+    timeout.tv_sec  = timeout_ms / MILLISECONDS_PER_SECOND;
+    timeout.tv_nsec = (long long)(timeout_ms % MILLISECONDS_PER_SECOND) * NANOSECONDS_PER_MILLISECOND;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (uint64_t)(uintptr_t)&timeout;
+
+    submitted = (int)syscall(__NR_io_uring_enter, state->ring_fd, state->to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if(submitted >= 0)
+    {
+        state->to_submit -= (unsigned)submitted;
+    }
+
+    return submitted;
+}
+
+static bool uring_arm_receive(struct uring_state *state, int sockfd)
+{
+    struct io_uring_sqe *sqe;
+
+    sqe = uring_get_sqe(state);
+    if(sqe == NULL)
+    {
+        return false;
+    }
+
+    sqe->opcode    = IORING_OP_RECVMSG;
+    sqe->fd        = state->fixed_file ? 0 : sockfd;
+    sqe->flags     = (uint8_t)(IOSQE_BUFFER_SELECT | (state->fixed_file ? IOSQE_FIXED_FILE : 0));
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->addr      = (uint64_t)(uintptr_t)&state->recv_msg;
+    sqe->len       = 1;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_RECV_TAG;
+
+    state->recv_armed = true;
+    return true;
+}
+
+static void uring_handle_receive(const struct p101_env *env, struct p101_error *err, struct uring_state *state, const struct io_uring_cqe *cqe, io_receive_handler handler, void *arg, unsigned *recycled)
+{
+    P101_TRACE(env);
+
+    // Without F_MORE the multishot request has ended (usually -ENOBUFS) and must be armed again
+    if((cqe->flags & IORING_CQE_F_MORE) == 0)
+    {
+        state->recv_armed = false;
+    }
+
+    if(cqe->res < 0)
+    {
+        // Running out of buffers is routine and a cancel is what quiesce asked for
+        if(cqe->res != -ENOBUFS && cqe->res != -ECANCELED)
+        {
+            fprintf(stderr, "io_uring recvmsg failed: %s\n", strerror(-cqe->res));
+        }
+        return;
+    }
+
+    if(cqe->flags & IORING_CQE_F_BUFFER)
+    {
+        const struct io_uring_recvmsg_out *out;
+        struct receive_metadata            metadata;
+        struct msghdr                      control_msg;
+        uint8_t                           *buffer;
+        uint16_t                           bid;
+
+        bid    = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        buffer = state->recv_buffers + ((size_t)bid * URING_RECV_BUFFER_SIZE);
+        out    = (const struct io_uring_recvmsg_out *)(void *)buffer;
+
+        memset(&control_msg, 0, sizeof(control_msg));
+        control_msg.msg_control    = buffer + sizeof(*out) + state->recv_msg.msg_namelen;
+        control_msg.msg_controllen = out->controllen;
+        parse_receive_metadata(env, &control_msg, &metadata);
+
+        if((out->flags & MSG_TRUNC) == 0)
+        {
+            handler(env, err, arg, (const struct sockaddr *)(const void *)(buffer + sizeof(*out)), buffer + sizeof(*out) + state->recv_msg.msg_namelen + state->recv_msg.msg_controllen, out->payloadlen, &metadata);
+        }
+
+        uring_recycle_buffer(state, bid, *recycled);
+        (*recycled)++;
+    }
+}
+
+static void uring_handle_send(const struct p101_env *env, struct uring_state *state, const struct io_uring_cqe *cqe)
+{
+    struct uring_send_slot *slot;
+    uint32_t                slot_index;
+
+    P101_TRACE(env);
+
+    slot_index = (uint32_t)cqe->user_data;
+    if(slot_index >= URING_SEND_SLOTS)
+    {
+        return;
+    }
+
+    slot = &state->slots[slot_index];
+
+    // The socket buffer was full, keep the slot and its packet for the next try
+    if(cqe->res == -EAGAIN)
+    {
+        slot->next_blocked  = state->blocked_slot;
+        state->blocked_slot = slot_index;
+        return;
+    }
+
+    if(cqe->res < 0)
+    {
+        slot->queue->failed++;
+    }
+    else
+    {
+        slot->queue->sent++;
+    }
+
+    packet_buffer_release(env, slot->packet);
+    slot->packet     = NULL;
+    slot->next_free  = state->free_slot;
+    state->free_slot = slot_index;
+    state->in_flight--;
+}
+
+static void uring_prep_send(const struct uring_state *state, struct io_uring_sqe *sqe, uint32_t slot_index, int sockfd)
+{
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = state->fixed_file ? 0 : sockfd;
+    sqe->flags     = state->fixed_file ? IOSQE_FIXED_FILE : 0;
+    sqe->addr      = (uint64_t)(uintptr_t)&state->slots[slot_index].msg;
+    sqe->len       = 1;
+    sqe->user_data = slot_index;
+}
+
+// Each blocked send goes out again behind a POLLOUT poll linked to it, so it waits in the kernel for room
+// rather than failing straight back. Whatever does not fit in the submission ring waits for the next call.
+static void uring_resubmit_blocked(struct uring_state *state, int sockfd)
+{
+    while(state->blocked_slot != URING_NO_SLOT && state->sq_local_tail + 2 - __atomic_load_n(state->sq_head, __ATOMIC_ACQUIRE) <= state->sq_entries)
+    {
+        struct io_uring_sqe *poll;
+        uint32_t             slot_index;
+
+        slot_index          = state->blocked_slot;
+        state->blocked_slot = state->slots[slot_index].next_blocked;
+
+        poll                = uring_get_sqe(state);
+        poll->opcode        = IORING_OP_POLL_ADD;
+        poll->fd            = state->fixed_file ? 0 : sockfd;
+        poll->flags         = (uint8_t)(IOSQE_IO_LINK | (state->fixed_file ? IOSQE_FIXED_FILE : 0));
+        poll->poll32_events = POLLOUT;
+        poll->user_data     = URING_POLL_TAG;
+        uring_prep_send(state, uring_get_sqe(state), slot_index, sockfd);
+    }
+}
+
+static void uring_recycle_buffer(struct uring_state *state, uint16_t bid, unsigned offset)
+{
+    struct io_uring_buf *buf;
+
+    // Set the fields one by one, the first entry's resv field doubles as the ring tail
+    buf       = &state->buf_ring->bufs[(state->buf_ring_tail + offset) & (URING_RECV_BUFFERS - 1)];
+    buf->addr = (uint64_t)(uintptr_t)(state->recv_buffers + ((size_t)bid * URING_RECV_BUFFER_SIZE));
+    buf->len  = URING_RECV_BUFFER_SIZE;
+    buf->bid  = bid;
+}
+
+static void uring_free_state(const struct p101_env *env, struct uring_state *state)
+{
+    P101_TRACE(env);
+
+    // Closing the ring cancels whatever is still in flight, after that the slots' references can go
+    if(state->ring_fd != -1)
+    {
+        close(state->ring_fd);
+    }
+
+    for(uint32_t i = 0; i < URING_SEND_SLOTS; i++)
+    {
+        if(state->slots[i].packet != NULL)
+        {
+            packet_buffer_release(env, state->slots[i].packet);
+        }
+    }
+
+    if(state->sqes != NULL)
+    {
+        munmap(state->sqes, state->sqes_size);
+    }
+
+    if(state->cq_ring != NULL)
+    {
+        munmap(state->cq_ring, state->cq_ring_size);
+    }
+
+    if(state->sq_ring != NULL)
+    {
+        munmap(state->sq_ring, state->sq_ring_size);
+    }
+
+    if(state->buf_ring != NULL)
+    {
+        munmap(state->buf_ring, state->buf_ring_size);
+    }
+
+    free(state->recv_buffers);
+    free(state);
+}
+
+#else
+
+bool io_uring_backend_init(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    (void)backend;
+    fputs("io_uring is only available on Linux\n", stderr);
+    return false;
+}
+
+#endif
@@ -0,0 +1,227 @@
+#include "../include/join_cookie.h"
+
+#define SIPHASH_C_ROUNDS 2
+#define SIPHASH_D_ROUNDS 4
+#define SIPHASH_FINAL_XOR 0xFFU
+#define SIPHASH_LENGTH_SHIFT 56
+#define BYTE_BITS 8
+#define WORD_BITS 64
+#define COOKIE_INPUT_SIZE (sizeof(uint32_t) + sizeof(uint16_t) + sizeof(uint64_t))    // Address, port, bucket
+
+static uint64_t current_bucket(void);
+static void     make_cookie(const struct join_cookies *cookies, const struct sockaddr_in *client, uint64_t bucket, uint8_t cookie[JOIN_COOKIE_SIZE]);
+static uint8_t  cookie_difference(const uint8_t *a, const uint8_t *b);
+static uint64_t siphash24(const uint64_t key[2], const uint8_t *data, size_t length);
+static uint64_t load_le64(const uint8_t *bytes, size_t length);
+static uint64_t rotl(uint64_t value, int bits);
+static void     sipround(uint64_t v[4]);
+
+void join_cookies_init(const struct p101_env *env, struct p101_error *err, struct join_cookies *cookies)
+{
+    uint8_t key[sizeof(cookies->key)];
+    size_t  total;
+    int     fd;
+
+    P101_TRACE(env);
+
+    memset(cookies, 0, sizeof(*cookies));
+
+    fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+    if(fd == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "could not open /dev/urandom for the cookie key", EXIT_FAILURE);
+        return;
+    }
+
+    total = 0;
+    while(total < sizeof(key))
+    {
+        ssize_t bytes_read;
+
+        bytes_read = read(fd, key + total, sizeof(key) - total);
+        if(bytes_read <= 0)
+        {
+            P101_ERROR_RAISE_USER(err, "could not read the cookie key", EXIT_FAILURE);
+            close(fd);
+            return;
+        }
+        total += (size_t)bytes_read;
+    }
+
+    close(fd);
+    cookies->key[0] = load_le64(key, sizeof(uint64_t));
+    cookies->key[1] = load_le64(key + sizeof(uint64_t), sizeof(uint64_t));
+}
+
+// Answers a datagram from an unknown address with the cookie for that address. The reply is no larger
+// than the datagram that caused it, so a spoofed source cannot use the server to amplify traffic.
+// buffer holds POSITION_PACKET_SIZE bytes.
+void join_cookie_write_challenge(const struct p101_env *env, struct join_cookies *cookies, const struct sockaddr_in *client, const struct packet_header *header, uint8_t *buffer)
+{
+    uint8_t            cookie[JOIN_COOKIE_SIZE];
+    uint32_t           halves[2];
+    struct coordinates coordinates;
+
+    P101_TRACE(env);
+
+    make_cookie(cookies, client, current_bucket(), cookie);
+    memcpy(halves, cookie, sizeof(halves));
+
+    coordinates.old_x = ntohl(halves[0]);
+    coordinates.old_y = ntohl(halves[1]);
+    coordinates.new_x = COOKIE_COORDINATE;
+    coordinates.new_y = COOKIE_COORDINATE;
+    serialize_header_to_buffer(env, header, buffer);
+    serialize_position_to_buffer(env, &coordinates, buffer + PACKET_HEADER_SIZE);
+    cookies->challenges++;
+}
+
+// Constant time in the cookie: both buckets are always computed and compared in full
+bool join_cookie_verify(const struct p101_env *env, struct join_cookies *cookies, const struct sockaddr_in *client, const uint8_t *cookie)
+{
+    uint8_t  current[JOIN_COOKIE_SIZE];
+    uint8_t  previous[JOIN_COOKIE_SIZE];
+    uint64_t bucket;
+    bool     valid;
+
+    P101_TRACE(env);
+
+    bucket = current_bucket();
+    make_cookie(cookies, client, bucket, current);
+    make_cookie(cookies, client, bucket - 1, previous);
+
+    valid = ((cookie_difference(cookie, current) == 0) | (cookie_difference(cookie, previous) == 0)) != 0;
+    if(valid)
+    {
+        cookies->accepted++;
+    }
+    else
+    {
+        cookies->rejected++;
+    }
+
+    return valid;
+}
+
+void join_cookies_print_stats(const struct p101_env *env, const struct join_cookies *cookies)
+{
+    P101_TRACE(env);
+
+    printf("Join cookies: %" PRIu64 " challenges, %" PRIu64 " accepted, %" PRIu64 " rejected\n", cookies->challenges, cookies->accepted, cookies->rejected);
+}
+
+static uint64_t current_bucket(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec / JOIN_COOKIE_BUCKET_SECONDS;
+}
+
+static void make_cookie(const struct join_cookies *cookies, const struct sockaddr_in *client, uint64_t bucket, uint8_t cookie[JOIN_COOKIE_SIZE])
+{
+    uint8_t  input[COOKIE_INPUT_SIZE];
+    uint64_t mac;
+
+    // Address and port stay in network byte order, only their bytes matter
+    memcpy(input, &client->sin_addr.s_addr, sizeof(uint32_t));
+    memcpy(input + sizeof(uint32_t), &client->sin_port, sizeof(uint16_t));
+    memcpy(input + sizeof(uint32_t) + sizeof(uint16_t), &bucket, sizeof(bucket));
+
+    mac = siphash24(cookies->key, input, sizeof(input));
+    for(size_t i = 0; i < JOIN_COOKIE_SIZE; i++)
+    {
+        cookie[i] = (uint8_t)(mac >> (i * BYTE_BITS));
+    }
+}
+
+// OR of the byte differences, no early exit so the time taken says nothing about how much matched
+static uint8_t cookie_difference(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t difference;
+
+    difference = 0;
+    for(size_t i = 0; i < JOIN_COOKIE_SIZE; i++)
+    {
+        difference |= (uint8_t)(a[i] ^ b[i]);
+    }
+
+    return difference;
+}
+
+static uint64_t siphash24(const uint64_t key[2], const uint8_t *data, size_t length)
+{
+    uint64_t v[4];
+    uint64_t last;
+    size_t   offset;
+
+    v[0] = key[0] ^ UINT64_C(0x736F6D6570736575);
+    v[1] = key[1] ^ UINT64_C(0x646F72616E646F6D);
+    v[2] = key[0] ^ UINT64_C(0x6C7967656E657261);
+    v[3] = key[1] ^ UINT64_C(0x7465646279746573);
+
+    for(offset = 0; offset + sizeof(uint64_t) <= length; offset += sizeof(uint64_t))
+    {
+        uint64_t word;
+
+        word = load_le64(data + offset, sizeof(uint64_t));
+        v[3] ^= word;
+        for(int r = 0; r < SIPHASH_C_ROUNDS; r++)
+        {
+            sipround(v);
+        }
+        v[0] ^= word;
+    }
+
+    last = ((uint64_t)length << SIPHASH_LENGTH_SHIFT) | load_le64(data + offset, length - offset);
+    v[3] ^= last;
+    for(int r = 0; r < SIPHASH_C_ROUNDS; r++)
+    {
+        sipround(v);
+    }
+    v[0] ^= last;
+
+    v[2] ^= SIPHASH_FINAL_XOR;
+    for(int r = 0; r < SIPHASH_D_ROUNDS; r++)
+    {
+        sipround(v);
+    }
+
+    return v[0] ^ v[1] ^ v[2] ^ v[3];
+}
+
+static uint64_t load_le64(const uint8_t *bytes, size_t length)
+{
+    uint64_t value;
+
+    value = 0;
+    for(size_t i = 0; i < length; i++)
+    {
+        value |= (uint64_t)bytes[i] << (i * BYTE_BITS);
+    }
+
+    return value;
+}
+
+static uint64_t rotl(uint64_t value, int bits)
+{
+    return (value << bits) | (value >> (WORD_BITS - bits));
+}
+
+static void sipround(uint64_t v[4])
+{
+    v[0] += v[1];
+    v[1] = rotl(v[1], 13);
+    v[1] ^= v[0];
+    v[0] = rotl(v[0], 32);
+    v[2] += v[3];
+    v[3] = rotl(v[3], 16);
+    v[3] ^= v[2];
+    v[0] += v[3];
+    v[3] = rotl(v[3], 21);
+    v[3] ^= v[0];
+    v[2] += v[1];
+    v[1] = rotl(v[1], 17);
+    v[1] ^= v[2];
+    v[2] = rotl(v[2], 32);
+}
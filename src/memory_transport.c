@@ -0,0 +1,344 @@
+#include "../include/memory_transport.h"
+
+#define MEMORY_TRANSPORT_EPOCH_NS NANOSECONDS_PER_SECOND                    // The virtual clock starts here, zero reads as never in places
+#define MEMORY_TRANSPORT_HOLD_NS (100 * NANOSECONDS_PER_MILLISECOND)    // Added to a held back datagram, longer than a 20 Hz client waits between moves
+
+static void                   memory_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+static void                   memory_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static enum send_queue_status memory_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+static void                   memory_destroy(const struct p101_env *env, struct io_backend *backend);
+static void                   launch(struct memory_transport *transport, struct memory_flight *flight, const struct sockaddr_in *addr, const uint8_t *data, size_t length);
+static bool                   due(const struct memory_transport *transport, const struct memory_flight *flight, int64_t until_ns);
+static uint32_t               land(struct memory_transport *transport, struct memory_flight *flight);
+static bool                   chance(struct memory_transport *transport, uint32_t ppm);
+static bool                   earlier(const struct memory_transport *transport, uint32_t a, uint32_t b);
+static void                   heap_push(const struct memory_transport *transport, struct memory_flight *flight, uint32_t slot);
+static uint32_t               heap_pop(const struct memory_transport *transport, struct memory_flight *flight);
+
+static const struct io_backend_ops memory_ops = {"memory", memory_wait, memory_receive, memory_flush, memory_destroy, NULL, NULL};
+
+void memory_transport_create(const struct p101_env *env, struct p101_error *err, struct memory_transport *transport, const struct memory_link *link, uint64_t seed)
+{
+    P101_TRACE(env);
+
+    memset(transport, 0, sizeof(*transport));
+    transport->link            = *link;
+    transport->random          = seed != 0 ? seed : 1;    // xorshift never leaves zero
+    transport->now_ns          = MEMORY_TRANSPORT_EPOCH_NS;
+    transport->slots           = (struct memory_datagram *)malloc(MEMORY_TRANSPORT_CAPACITY * sizeof(struct memory_datagram));
+    transport->free_slots      = (uint32_t *)malloc(MEMORY_TRANSPORT_CAPACITY * sizeof(uint32_t));
+    transport->to_server.heap  = (uint32_t *)malloc(MEMORY_TRANSPORT_CAPACITY * sizeof(uint32_t));
+    transport->to_clients.heap = (uint32_t *)malloc(MEMORY_TRANSPORT_CAPACITY * sizeof(uint32_t));
+    if(transport->slots == NULL || transport->free_slots == NULL || transport->to_server.heap == NULL || transport->to_clients.heap == NULL)
+    {
+        memory_transport_destroy(env, transport);
+        P101_ERROR_RAISE_USER(err, "Memory transport allocation failed", EXIT_FAILURE);
+        return;
+    }
+
+    for(uint32_t i = 0; i < MEMORY_TRANSPORT_CAPACITY; i++)
+    {
+        transport->free_slots[i] = MEMORY_TRANSPORT_CAPACITY - 1 - i;
+    }
+    transport->free_count = MEMORY_TRANSPORT_CAPACITY;
+}
+
+// Puts the transport under the server in place of a socket
+void memory_transport_attach(const struct p101_env *env, struct memory_transport *transport, struct io_backend *backend, struct packet_pool *pool)
+{
+    P101_TRACE(env);
+
+    memset(backend, 0, sizeof(*backend));
+    backend->ops    = &memory_ops;
+    backend->sockfd = -1;
+    backend->pool   = pool;
+    backend->state  = transport;
+}
+
+// A client's datagram to the server, it arrives once the clock reaches its delivery time
+void memory_transport_send(const struct p101_env *env, struct memory_transport *transport, const struct sockaddr_in *from, const uint8_t *data, size_t length)
+{
+    P101_TRACE(env);
+
+    launch(transport, &transport->to_server, from, data, length);
+}
+
+// Moves the clock to until_ns, handing each datagram for a client to handler at its delivery time on the way.
+// Datagrams for the server that come due wait for the next receive, as they would in a socket buffer.
+void memory_transport_advance(const struct p101_env *env, struct memory_transport *transport, int64_t until_ns, memory_client_handler handler, void *arg)
+{
+    P101_TRACE(env);
+
+    while(due(transport, &transport->to_clients, until_ns))
+    {
+        const struct memory_datagram *datagram;
+        uint32_t                      slot;
+
+        slot     = land(transport, &transport->to_clients);
+        datagram = &transport->slots[slot];
+        if(datagram->deliver_ns > transport->now_ns)
+        {
+            transport->now_ns = datagram->deliver_ns;
+        }
+
+        handler(env, arg, &datagram->addr, datagram->data, datagram->length);
+        transport->free_slots[transport->free_count++] = slot;
+    }
+
+    if(until_ns > transport->now_ns)
+    {
+        transport->now_ns = until_ns;
+    }
+}
+
+// When the next datagram either way is due, MEMORY_TRANSPORT_NONE if nothing is in flight
+int64_t memory_transport_next_ns(const struct memory_transport *transport)
+{
+    int64_t next_ns;
+
+    next_ns = MEMORY_TRANSPORT_NONE;
+    if(transport->to_server.count > 0)
+    {
+        next_ns = transport->slots[transport->to_server.heap[0]].deliver_ns;
+    }
+
+    if(transport->to_clients.count > 0 && transport->slots[transport->to_clients.heap[0]].deliver_ns < next_ns)
+    {
+        next_ns = transport->slots[transport->to_clients.heap[0]].deliver_ns;
+    }
+
+    return next_ns;
+}
+
+// xorshift64, the same seed gives the same run
+uint64_t memory_transport_random(struct memory_transport *transport)
+{
+    transport->random ^= transport->random << 13;
+    transport->random ^= transport->random >> 7;
+    transport->random ^= transport->random << 17;
+    return transport->random;
+}
+
+void memory_transport_print_stats(const struct p101_env *env, const struct memory_transport *transport)
+{
+    P101_TRACE(env);
+
+    printf("Memory transport to server: %" PRIu64 " sent, %" PRIu64 " delivered, %" PRIu64 " lost, %" PRIu64 " held back\n", transport->to_server.sent, transport->to_server.delivered, transport->to_server.lost, transport->to_server.held_back);
+    printf("Memory transport to clients: %" PRIu64 " sent, %" PRIu64 " delivered, %" PRIu64 " lost, %" PRIu64 " held back, %" PRIu64 " overflows\n", transport->to_clients.sent, transport->to_clients.delivered, transport->to_clients.lost, transport->to_clients.held_back, transport->overflows);
+}
+
+void memory_transport_destroy(const struct p101_env *env, struct memory_transport *transport)
+{
+    P101_TRACE(env);
+
+    free(transport->slots);
+    free(transport->free_slots);
+    free(transport->to_server.heap);
+    free(transport->to_clients.heap);
+    transport->slots           = NULL;
+    transport->free_slots      = NULL;
+    transport->to_server.heap  = NULL;
+    transport->to_clients.heap = NULL;
+}
+
+// Never blocks, the clock only moves when the caller advances it
+static void memory_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms)
+{
+    struct memory_transport *transport;
+
+    P101_TRACE(env);
+
+    (void)err;
+    (void)pending_sends;
+    (void)timeout_ms;
+
+    transport         = (struct memory_transport *)backend->state;
+    backend->readable = due(transport, &transport->to_server, transport->now_ns);
+}
+
+static void memory_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    struct memory_transport *transport;
+    struct receive_metadata  metadata;
+
+    P101_TRACE(env);
+
+    transport = (struct memory_transport *)backend->state;
+    memset(&metadata, 0, sizeof(metadata));    // No kernel, so no timestamps or drop counts
+    for(int i = 0; i < IO_RECEIVE_BATCH_SIZE && due(transport, &transport->to_server, transport->now_ns); i++)
+    {
+        const struct memory_datagram *datagram;
+        uint32_t                      slot;
+
+        slot     = land(transport, &transport->to_server);
+        datagram = &transport->slots[slot];
+        handler(env, err, arg, (const struct sockaddr *)&datagram->addr, datagram->data, datagram->length, &metadata);
+        transport->free_slots[transport->free_count++] = slot;
+        if(p101_error_has_error(err))
+        {
+            break;
+        }
+    }
+}
+
+// The link never pushes back, every queued packet leaves at once
+static enum send_queue_status memory_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct memory_transport *transport;
+    struct sockaddr_in       client;
+
+    P101_TRACE(env);
+
+    transport = (struct memory_transport *)backend->state;
+    memset(&client, 0, sizeof(client));
+    memcpy(&client, addr, addrlen < sizeof(client) ? addrlen : sizeof(client));
+    while(queue->count > 0)
+    {
+        const struct packet_buffer *packet;
+
+        packet = queue->entries[queue->head].packet;
+        launch(transport, &transport->to_clients, &client, packet->data, packet->length);
+        queue->sent++;
+        send_queue_pop(env, queue);
+    }
+
+    return SEND_QUEUE_DRAINED;
+}
+
+// The transport owns its memory, memory_transport_destroy frees it
+static void memory_destroy(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    (void)backend;
+}
+
+static void launch(struct memory_transport *transport, struct memory_flight *flight, const struct sockaddr_in *addr, const uint8_t *data, size_t length)
+{
+    struct memory_datagram *datagram;
+    uint32_t                slot;
+
+    flight->sent++;
+    if(chance(transport, transport->link.loss_ppm))
+    {
+        flight->lost++;
+        return;
+    }
+
+    if(transport->free_count == 0)
+    {
+        transport->overflows++;
+        return;
+    }
+
+    slot                 = transport->free_slots[--transport->free_count];
+    datagram             = &transport->slots[slot];
+    datagram->deliver_ns = transport->now_ns + transport->link.latency_ns;
+    datagram->order      = transport->next_order++;
+    datagram->addr       = *addr;
+    datagram->length     = length < sizeof(datagram->data) ? length : sizeof(datagram->data);
+    memcpy(datagram->data, data, datagram->length);
+
+    if(transport->link.jitter_ns > 0)
+    {
+        datagram->deliver_ns += (int64_t)(memory_transport_random(transport) % (uint64_t)(transport->link.jitter_ns + 1));
+    }
+
+    // Held back past whatever the jitter could do, so the datagrams sent after it really do overtake it
+    if(chance(transport, transport->link.reorder_ppm))
+    {
+        datagram->deliver_ns += transport->link.jitter_ns + MEMORY_TRANSPORT_HOLD_NS;
+        flight->held_back++;
+    }
+
+    heap_push(transport, flight, slot);
+}
+
+static bool due(const struct memory_transport *transport, const struct memory_flight *flight, int64_t until_ns)
+{
+    return flight->count > 0 && transport->slots[flight->heap[0]].deliver_ns <= until_ns;
+}
+
+static uint32_t land(struct memory_transport *transport, struct memory_flight *flight)
+{
+    flight->delivered++;
+    return heap_pop(transport, flight);
+}
+
+static bool chance(struct memory_transport *transport, uint32_t ppm)
+{
+    return ppm != 0 && memory_transport_random(transport) % PARTS_PER_MILLION < ppm;
+}
+
+static bool earlier(const struct memory_transport *transport, uint32_t a, uint32_t b)
+{
+    const struct memory_datagram *first;
+    const struct memory_datagram *second;
+
+    first  = &transport->slots[a];
+    second = &transport->slots[b];
+    return first->deliver_ns < second->deliver_ns || (first->deliver_ns == second->deliver_ns && first->order < second->order);
+}
+
+static void heap_push(const struct memory_transport *transport, struct memory_flight *flight, uint32_t slot)
+{
+    uint32_t child;
+
+    child = flight->count++;
+    while(child > 0)
+    {
+        uint32_t parent;
+
+        parent = (child - 1) / 2;
+        if(!earlier(transport, slot, flight->heap[parent]))
+        {
+            break;
+        }
+
+        flight->heap[child] = flight->heap[parent];
+        child               = parent;
+    }
+
+    flight->heap[child] = slot;
+}
+
+static uint32_t heap_pop(const struct memory_transport *transport, struct memory_flight *flight)
+{
+    uint32_t top;
+    uint32_t last;
+    uint32_t parent;
+
+    top    = flight->heap[0];
+    last   = flight->heap[--flight->count];
+    parent = 0;
+    while(true)
+    {
+        uint32_t child;
+
+        child = (2 * parent) + 1;
+        if(child >= flight->count)
+        {
+            break;
+        }
+
+        if(child + 1 < flight->count && earlier(transport, flight->heap[child + 1], flight->heap[child]))
+        {
+            child++;
+        }
+
+        if(!earlier(transport, flight->heap[child], last))
+        {
+            break;
+        }
+
+        flight->heap[parent] = flight->heap[child];
+        parent               = child;
+    }
+
+    if(flight->count > 0)
+    {
+        flight->heap[parent] = last;
+    }
+
+    return top;
+}
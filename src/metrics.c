@@ -0,0 +1,194 @@
+#include "../include/metrics.h"
+
+static const int64_t *virtual_clock_ns = NULL;    // NOLINT(cppcoreguidelines-avoid-non-const-global-variables)
+
+void latency_stats_init(const struct p101_env *env, struct latency_stats *stats)
+{
+    P101_TRACE(env);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->min_ns = UINT64_MAX;
+}
+
+void latency_stats_record(const struct p101_env *env, struct latency_stats *stats, int64_t elapsed_ns)
+{
+    uint64_t sample;
+
+    P101_TRACE(env);
+
+    // Realtime clock steps can make a sample negative, clamp rather than poison the totals
+    sample = elapsed_ns < 0 ? 0 : (uint64_t)elapsed_ns;
+
+    stats->count++;
+    stats->total_ns += sample;
+
+    if(sample < stats->min_ns)
+    {
+        stats->min_ns = sample;
+    }
+
+    if(sample > stats->max_ns)
+    {
+        stats->max_ns = sample;
+    }
+}
+
+void latency_stats_print(const struct p101_env *env, const struct latency_stats *stats, const char *label)
+{
+    P101_TRACE(env);
+
+    if(stats->count == 0)
+    {
+        printf("%s: no samples\n", label);
+        return;
+    }
+
+    printf("%s: %" PRIu64 " samples, min %" PRIu64 " us, avg %" PRIu64 " us, max %" PRIu64 " us\n", label, stats->count, stats->min_ns / NANOSECONDS_PER_MICROSECOND, stats->total_ns / stats->count / NANOSECONDS_PER_MICROSECOND, stats->max_ns / NANOSECONDS_PER_MICROSECOND);
+}
+
+int64_t timespec_diff_ns(const struct timespec *end, const struct timespec *start)
+{
+    return ((int64_t)(end->tv_sec - start->tv_sec) * NANOSECONDS_PER_SECOND) + (int64_t)(end->tv_nsec - start->tv_nsec);
+}
+
+// Nanoseconds on CLOCK_MONOTONIC, for deadlines that only ever get compared with each other
+int64_t monotonic_now_ns(void)
+{
+    struct timespec now;
+
+    if(virtual_clock_ns != NULL)
+    {
+        return *virtual_clock_ns;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((int64_t)now.tv_sec * NANOSECONDS_PER_SECOND) + now.tv_nsec;
+}
+
+// Makes monotonic_now_ns read clock_ns instead, so a simulation can run every deadline in the process
+// on time of its own. NULL goes back to CLOCK_MONOTONIC. Only for a single threaded process.
+void monotonic_clock_use(const int64_t *clock_ns)
+{
+    virtual_clock_ns = clock_ns;
+}
+
+void sequence_tracker_reset(const struct p101_env *env, struct sequence_tracker *tracker)
+{
+    P101_TRACE(env);
+
+    memset(tracker, 0, sizeof(*tracker));
+}
+
+uint32_t sequence_tracker_update(const struct p101_env *env, struct sequence_tracker *tracker, uint32_t sequence)
+{
+    int32_t distance;
+
+    P101_TRACE(env);
+
+    tracker->received++;
+
+    if(!tracker->started)
+    {
+        tracker->started  = true;
+        tracker->expected = sequence + 1;
+        tracker->seen     = 1;
+        return 0;
+    }
+
+    distance = (int32_t)(sequence - tracker->expected);
+
+    // Behind the newest: a gap filling in late, or a repeat. Lost stays as it was, the gap did open.
+    if(distance < 0)
+    {
+        uint32_t behind;
+
+        behind = tracker->expected - 1 - sequence;
+        if(behind >= SEQUENCE_WINDOW || (tracker->seen & ((uint64_t)1 << behind)) != 0)
+        {
+            tracker->duplicates++;
+            return 0;
+        }
+
+        tracker->seen |= (uint64_t)1 << behind;
+        tracker->late++;
+        return 0;
+    }
+
+    tracker->seen     = (uint32_t)distance + 1 >= SEQUENCE_WINDOW ? 1 : (tracker->seen << ((uint32_t)distance + 1)) | 1;
+    tracker->expected = sequence + 1;
+    tracker->lost += (uint64_t)distance;
+
+    return (uint32_t)distance;
+}
+
+bool rate_limiter_allow(const struct p101_env *env, struct rate_limiter *limiter)
+{
+    time_t now;
+
+    P101_TRACE(env);
+
+    now = time(NULL);
+
+    if(now - limiter->last < WARNING_INTERVAL_SECONDS)
+    {
+        limiter->suppressed++;
+        return false;
+    }
+
+    limiter->last = now;
+    return true;
+}
+
+void receive_stats_init(const struct p101_env *env, struct receive_stats *stats)
+{
+    P101_TRACE(env);
+
+    memset(stats, 0, sizeof(*stats));
+    latency_stats_init(env, &stats->latency);
+}
+
+// SO_RXQ_OVFL counts from when the socket was made, an inherited one has its predecessor's drops in it already
+void receive_stats_adopt_socket(const struct p101_env *env, struct receive_stats *stats)
+{
+    P101_TRACE(env);
+
+    stats->adopted_socket = true;
+}
+
+void receive_stats_record_kernel_drops(const struct p101_env *env, struct receive_stats *stats, uint32_t drop_count)
+{
+    uint32_t new_drops;
+
+    P101_TRACE(env);
+
+    if(stats->adopted_socket)
+    {
+        stats->adopted_socket         = false;
+        stats->last_kernel_drop_count = drop_count;
+        return;
+    }
+
+    // SO_RXQ_OVFL reports a cumulative per-socket counter, unsigned subtraction handles its wraparound
+    new_drops                     = drop_count - stats->last_kernel_drop_count;
+    stats->last_kernel_drop_count = drop_count;
+
+    if(new_drops == 0)
+    {
+        return;
+    }
+
+    stats->kernel_drops += new_drops;
+
+    if(rate_limiter_allow(env, &stats->drop_warning))
+    {
+        fprintf(stderr, "Warning: kernel dropped %u datagrams, %" PRIu64 " total (%" PRIu64 " warnings suppressed)\n", new_drops, stats->kernel_drops, stats->drop_warning.suppressed);
+        stats->drop_warning.suppressed = 0;
+    }
+}
+
+void receive_stats_print(const struct p101_env *env, const struct receive_stats *stats)
+{
+    P101_TRACE(env);
+
+    printf("Received %" PRIu64 " datagrams, %" PRIu64 " dropped by the kernel, %" PRIu64 " lost in transit, %" PRIu64 " late, %" PRIu64 " duplicated\n", stats->datagrams, stats->kernel_drops, stats->sequence_gaps - stats->late, stats->late, stats->duplicates);
+}
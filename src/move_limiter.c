@@ -0,0 +1,199 @@
+#include "../include/move_limiter.h"
+
+static bool take_token(struct move_limiter *limiter, int client_index, int64_t now_ns);
+static void fold_move(struct move_limiter *limiter, struct held_move *held, const struct packet_header *header, const struct coordinates *coordinates);
+static void unlist_client(struct move_limiter *limiter, int client_index);
+
+void move_limiter_init(const struct p101_env *env, struct move_limiter *limiter, uint32_t moves_per_second)
+{
+    P101_TRACE(env);
+
+    memset(limiter, 0, sizeof(*limiter));
+    if(moves_per_second == 0)
+    {
+        return;
+    }
+
+    limiter->interval_ns = NANOSECONDS_PER_SECOND / moves_per_second;
+    limiter->burst_ns    = limiter->interval_ns * (MOVE_LIMIT_BURST - 1);
+}
+
+// A new occupant starts with a full bucket, and whatever the last one had held goes with it
+void move_limiter_reset(const struct p101_env *env, struct move_limiter *limiter, int client_index)
+{
+    P101_TRACE(env);
+
+    limiter->due_ns[client_index] = 0;
+    if(limiter->held[client_index].held)
+    {
+        unlist_client(limiter, client_index);
+    }
+}
+
+// Decides whether a move from a known client goes through now. On MOVE_PASS header and coordinates
+// hold the move to apply, which is the one passed in or the held move it was folded into.
+enum move_verdict move_limiter_admit(const struct p101_env *env, struct move_limiter *limiter, int client_index, int64_t now_ns, struct packet_header *header, struct coordinates *coordinates)
+{
+    struct held_move *held;
+
+    P101_TRACE(env);
+
+    if(limiter->interval_ns == 0)
+    {
+        return MOVE_PASS;
+    }
+
+    // Once a move is held every later one joins it, applying them out of turn would skip cells
+    held = &limiter->held[client_index];
+    if(held->held)
+    {
+        fold_move(limiter, held, header, coordinates);
+        if(!take_token(limiter, client_index, now_ns))
+        {
+            return MOVE_HELD;
+        }
+
+        move_limiter_take(env, limiter, client_index, header, coordinates);
+        return MOVE_PASS;
+    }
+
+    if(take_token(limiter, client_index, now_ns))
+    {
+        return MOVE_PASS;
+    }
+
+    held->header                                 = *header;
+    held->coordinates                            = *coordinates;
+    held->held                                   = true;
+    limiter->held_clients[limiter->held_count++] = client_index;
+    limiter->deferred++;
+
+    return MOVE_HELD;
+}
+
+// Hands back the client's held move whatever its bucket says. Used before an exit, so the others
+// see the client reach the cell it leaves from.
+bool move_limiter_take(const struct p101_env *env, struct move_limiter *limiter, int client_index, struct packet_header *header, struct coordinates *coordinates)
+{
+    P101_TRACE(env);
+
+    if(!limiter->held[client_index].held)
+    {
+        return false;
+    }
+
+    *header      = limiter->held[client_index].header;
+    *coordinates = limiter->held[client_index].coordinates;
+    unlist_client(limiter, client_index);
+
+    return true;
+}
+
+// Returns a client whose held move is now due and hands the move back, or -1 once none is
+int move_limiter_release(const struct p101_env *env, struct move_limiter *limiter, int64_t now_ns, struct packet_header *header, struct coordinates *coordinates)
+{
+    P101_TRACE(env);
+
+    for(uint32_t n = 0; n < limiter->held_count; n++)
+    {
+        int client_index;
+
+        client_index = limiter->held_clients[n];
+        if(take_token(limiter, client_index, now_ns))
+        {
+            move_limiter_take(env, limiter, client_index, header, coordinates);
+            return client_index;
+        }
+    }
+
+    return -1;
+}
+
+// How long the server may sleep before the first held move falls due, -1 if nothing is held
+int move_limiter_timeout_ms(const struct p101_env *env, const struct move_limiter *limiter, int64_t now_ns)
+{
+    int64_t earliest_ns;
+
+    P101_TRACE(env);
+
+    if(limiter->held_count == 0)
+    {
+        return -1;
+    }
+
+    earliest_ns = INT64_MAX;
+    for(uint32_t n = 0; n < limiter->held_count; n++)
+    {
+        int64_t ready_ns;
+
+        ready_ns = limiter->due_ns[limiter->held_clients[n]] - limiter->burst_ns;
+        if(ready_ns < earliest_ns)
+        {
+            earliest_ns = ready_ns;
+        }
+    }
+
+    if(earliest_ns <= now_ns)
+    {
+        return 0;
+    }
+
+    // Round up, waking a little late is harmless but waking early would only spin
+    return (int)((earliest_ns - now_ns + NANOSECONDS_PER_MILLISECOND - 1) / NANOSECONDS_PER_MILLISECOND);
+}
+
+void move_limiter_print_stats(const struct p101_env *env, const struct move_limiter *limiter)
+{
+    P101_TRACE(env);
+
+    if(limiter->interval_ns == 0)
+    {
+        return;
+    }
+
+    printf("Move limit: %" PRId64 " per second, %" PRIu64 " moves deferred, %" PRIu64 " coalesced, %" PRIu64 " dropped\n", (int64_t)(NANOSECONDS_PER_SECOND / limiter->interval_ns), limiter->deferred, limiter->coalesced, limiter->dropped);
+}
+
+// GCRA: due is when the next move would be on schedule, and a client may run up to burst ahead of it
+static bool take_token(struct move_limiter *limiter, int client_index, int64_t now_ns)
+{
+    int64_t due_ns;
+
+    due_ns = limiter->due_ns[client_index] > now_ns ? limiter->due_ns[client_index] : now_ns;
+    if(due_ns - now_ns > limiter->burst_ns)
+    {
+        return false;
+    }
+
+    limiter->due_ns[client_index] = due_ns + limiter->interval_ns;
+    return true;
+}
+
+// Positions are absolute, so the newest destination is all a held move needs to carry forward.
+// A reordered or repeated datagram brings nothing new and is dropped.
+static void fold_move(struct move_limiter *limiter, struct held_move *held, const struct packet_header *header, const struct coordinates *coordinates)
+{
+    if((int32_t)(header->sequence - held->header.sequence) <= 0 || (coordinates->new_x == held->coordinates.new_x && coordinates->new_y == held->coordinates.new_y))
+    {
+        limiter->dropped++;
+        return;
+    }
+
+    held->header.sequence   = header->sequence;
+    held->coordinates.new_x = coordinates->new_x;
+    held->coordinates.new_y = coordinates->new_y;
+    limiter->coalesced++;
+}
+
+static void unlist_client(struct move_limiter *limiter, int client_index)
+{
+    limiter->held[client_index].held = false;
+    for(uint32_t n = 0; n < limiter->held_count; n++)
+    {
+        if(limiter->held_clients[n] == client_index)
+        {
+            limiter->held_clients[n] = limiter->held_clients[--limiter->held_count];
+            return;
+        }
+    }
+}
@@ -1,5 +1,7 @@
 #include "../include/network.h"
 
+#define STAMP_WORD_BITS 32
+
 void socket_create(const struct p101_env *env, struct p101_error *err, int *sockfd, int domain)
 {
     P101_TRACE(env);
@@ -66,6 +68,119 @@ done:
     return;
 }
 
+// Lets several spectators on one host bind the group port, must come before socket_bind
+void socket_share_port(const struct p101_env *env, struct p101_error *err, int sockfd)
+{
+    int enable;
+
+    P101_TRACE(env);
+
+    enable = 1;
+    if(setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "setsockopt SO_REUSEADDR failed", EXIT_FAILURE);
+    }
+}
+
+// Subscribes a socket bound to the group port to the group, on the interface that owns interface_addr
+void socket_join_group(const struct p101_env *env, struct p101_error *err, int sockfd, const struct sockaddr_storage *group, const struct sockaddr_storage *interface_addr)
+{
+    struct ip_mreq request;
+
+    P101_TRACE(env);
+
+    if(group->ss_family != AF_INET || interface_addr->ss_family != AF_INET)
+    {
+        P101_ERROR_RAISE_USER(err, "multicast groups are IPv4 only", EXIT_FAILURE);
+        return;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.imr_multiaddr = ((const struct sockaddr_in *)group)->sin_addr;
+    request.imr_interface = ((const struct sockaddr_in *)interface_addr)->sin_addr;
+    if(setsockopt(sockfd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &request, sizeof(request)) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "setsockopt IP_ADD_MEMBERSHIP failed", EXIT_FAILURE);
+    }
+}
+
+// Sends group traffic out of the interface the server is bound to, so a loopback server reaches
+// loopback spectators without a multicast route. The TTL stays at the default of 1, the local link.
+void socket_set_group_source(const struct p101_env *env, struct p101_error *err, int sockfd, const struct sockaddr_storage *interface_addr)
+{
+    unsigned char loop;
+
+    P101_TRACE(env);
+
+    if(interface_addr->ss_family != AF_INET)
+    {
+        P101_ERROR_RAISE_USER(err, "multicast groups are IPv4 only", EXIT_FAILURE);
+        return;
+    }
+
+    if(setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_IF, &((const struct sockaddr_in *)interface_addr)->sin_addr, sizeof(struct in_addr)) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "setsockopt IP_MULTICAST_IF failed", EXIT_FAILURE);
+        return;
+    }
+
+    // Spectators on the server's own host are members too
+    loop = 1;
+    if(setsockopt(sockfd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "setsockopt IP_MULTICAST_LOOP failed", EXIT_FAILURE);
+    }
+}
+
+void socket_set_nonblocking(const struct p101_env *env, struct p101_error *err, int sockfd)
+{
+    int flags;
+
+    P101_TRACE(env);
+
+    flags = fcntl(sockfd, F_GETFL, 0);
+    if(flags == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "fcntl F_GETFL failed", EXIT_FAILURE);
+        goto done;
+    }
+
+    if(fcntl(sockfd, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "fcntl F_SETFL O_NONBLOCK failed", EXIT_FAILURE);
+        goto done;
+    }
+
+done:
+    return;
+}
+
+void serialize_header_to_buffer(const struct p101_env *env, const struct packet_header *header, uint8_t *buffer)
+{
+    uint32_t net_sequence;
+    uint32_t net_room;
+
+    P101_TRACE(env);
+
+    net_sequence = htonl(header->sequence);
+    net_room     = htonl(header->room);
+    memcpy(buffer, &net_sequence, sizeof(net_sequence));
+    memcpy(buffer + sizeof(net_sequence), &net_room, sizeof(net_room));
+}
+
+void deserialize_header_from_buffer(const struct p101_env *env, struct packet_header *header, const uint8_t *buffer)
+{
+    uint32_t net_sequence;
+    uint32_t net_room;
+
+    P101_TRACE(env);
+
+    memcpy(&net_sequence, buffer, sizeof(net_sequence));
+    memcpy(&net_room, buffer + sizeof(net_sequence), sizeof(net_room));
+    header->sequence = ntohl(net_sequence);
+    header->room     = ntohl(net_room);
+}
+
 void serialize_position_to_buffer(const struct p101_env *env, const struct coordinates *coordinates, uint8_t *buffer)
 {
     uint32_t net_old_x;
@@ -106,6 +221,34 @@ void deserialize_position_from_buffer(const struct p101_env *env, struct coordin
     coordinates->new_y = ntohl(net_new_y);
 }
 
+// A clock stamp in microseconds, high word first like everything else on the wire
+void serialize_stamp_to_buffer(const struct p101_env *env, int64_t stamp_us, uint8_t *buffer)
+{
+    uint32_t net_high;
+    uint32_t net_low;
+
+    P101_TRACE(env);
+
+    net_high = htonl((uint32_t)((uint64_t)stamp_us >> STAMP_WORD_BITS));
+    net_low  = htonl((uint32_t)((uint64_t)stamp_us & UINT32_MAX));
+
+    memcpy(buffer, &net_high, sizeof(net_high));
+    memcpy(buffer + sizeof(net_high), &net_low, sizeof(net_low));
+}
+
+int64_t deserialize_stamp_from_buffer(const struct p101_env *env, const uint8_t *buffer)
+{
+    uint32_t net_high;
+    uint32_t net_low;
+
+    P101_TRACE(env);
+
+    memcpy(&net_high, buffer, sizeof(net_high));
+    memcpy(&net_low, buffer + sizeof(net_high), sizeof(net_low));
+
+    return (int64_t)(((uint64_t)ntohl(net_high) << STAMP_WORD_BITS) | ntohl(net_low));
+}
+
 ssize_t socket_read_full(const struct p101_env *env, int sockfd, uint8_t *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t addrlen)
 {
     size_t total_read;
@@ -136,6 +279,84 @@ ssize_t socket_read_full(const struct p101_env *env, int sockfd, uint8_t *buffer
     return (ssize_t)total_read;
 }
 
+ssize_t socket_read_message(const struct p101_env *env, int sockfd, uint8_t *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t *addrlen, struct receive_metadata *metadata)
+{
+    struct msghdr msg;
+    struct iovec  iov;
+    ssize_t       bytes_read;
+
+    union
+    {
+        char           buf[RECEIVE_CONTROL_SIZE];
+        struct cmsghdr align;
+    } control;
+
+    P101_TRACE(env);
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base       = buffer;
+    iov.iov_len        = size;
+    msg.msg_name       = addr;
+    msg.msg_namelen    = *addrlen;
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    bytes_read = recvmsg(sockfd, &msg, flags);
+    if(bytes_read == -1)
+    {
+        memset(metadata, 0, sizeof(*metadata));
+        return -1;
+    }
+
+    *addrlen = msg.msg_namelen;
+    parse_receive_metadata(env, &msg, metadata);
+
+    return bytes_read;
+}
+
+void parse_receive_metadata(const struct p101_env *env, const struct msghdr *msg, struct receive_metadata *metadata)
+{
+    struct cmsghdr *cmsg;
+
+    P101_TRACE(env);
+
+    memset(metadata, 0, sizeof(*metadata));
+
+    // The kernel only attaches these when SO_TIMESTAMPNS, SO_RXQ_OVFL and UDP_GRO are enabled
+    for(cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *)(uintptr_t)msg, cmsg))
+    {
+#ifdef UDP_GRO
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO)
+        {
+            int segment_size;
+
+            memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+            metadata->segment_size = (uint16_t)segment_size;
+            continue;
+        }
+#endif
+        if(cmsg->cmsg_level != SOL_SOCKET)
+        {
+            continue;
+        }
+#ifdef SCM_TIMESTAMPNS
+        if(cmsg->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            memcpy(&metadata->rx_time, CMSG_DATA(cmsg), sizeof(metadata->rx_time));
+        }
+#endif
+#ifdef SO_RXQ_OVFL
+        if(cmsg->cmsg_type == SO_RXQ_OVFL)
+        {
+            memcpy(&metadata->kernel_drops, CMSG_DATA(cmsg), sizeof(metadata->kernel_drops));
+            metadata->has_kernel_drops = true;
+        }
+#endif
+    }
+}
+
 ssize_t socket_write_full(const struct p101_env *env, int sockfd, const uint8_t *buffer, size_t size, const struct sockaddr *addr, socklen_t addrlen)
 {
     size_t total_written;
@@ -170,3 +391,25 @@ void socket_close(const struct p101_env *env, struct p101_error *err, const stru
         P101_ERROR_RAISE_USER(err, "socket close failed", EXIT_FAILURE);
     }
 }
+
+// True if (x, y) lies in a chunk within WORLD_VIEW_RADIUS of the viewer's chunk. Cells outside the
+// world, the sentinels among them, are never in view.
+bool world_in_view(uint32_t viewer_x, uint32_t viewer_y, uint32_t x, uint32_t y)
+{
+    uint32_t viewer_column;
+    uint32_t viewer_row;
+    uint32_t column;
+    uint32_t row;
+
+    if(x >= WORLD_COLUMNS || y >= WORLD_ROWS || viewer_x >= WORLD_COLUMNS || viewer_y >= WORLD_ROWS)
+    {
+        return false;
+    }
+
+    viewer_column = viewer_x / WORLD_CHUNK_COLUMNS;
+    viewer_row    = viewer_y / WORLD_CHUNK_ROWS;
+    column        = x / WORLD_CHUNK_COLUMNS;
+    row           = y / WORLD_CHUNK_ROWS;
+
+    return (column > viewer_column ? column - viewer_column : viewer_column - column) <= WORLD_VIEW_RADIUS && (row > viewer_row ? row - viewer_row : viewer_row - row) <= WORLD_VIEW_RADIUS;
+}
@@ -0,0 +1,168 @@
+#include "../include/occupancy.h"
+
+#define WORD_BITS 64
+#define WORD_SHIFT 6
+#define NIBBLE_MASK 0x0F
+#define NIBBLE_BITS 4
+
+static bool clamp_rect(uint32_t *x1, uint32_t *y1, uint32_t x0, uint32_t y0);
+static void column_mask(uint64_t mask[OCCUPANCY_ROW_WORDS], uint32_t x0, uint32_t x1);
+
+void occupancy_clear_all(const struct p101_env *env, struct occupancy_grid *grid)
+{
+    P101_TRACE(env);
+
+    memset(grid, 0, sizeof(*grid));
+}
+
+bool occupancy_test(const struct p101_env *env, const struct occupancy_grid *grid, uint32_t x, uint32_t y)
+{
+    P101_TRACE(env);
+
+    if(x >= OCCUPANCY_COLUMNS || y >= OCCUPANCY_ROWS)
+    {
+        return false;
+    }
+
+    return (grid->rows[y][x >> WORD_SHIFT] >> (x & (WORD_BITS - 1)) & 1U) != 0;
+}
+
+void occupancy_set(const struct p101_env *env, struct occupancy_grid *grid, uint32_t x, uint32_t y)
+{
+    P101_TRACE(env);
+
+    if(x < OCCUPANCY_COLUMNS && y < OCCUPANCY_ROWS)
+    {
+        grid->rows[y][x >> WORD_SHIFT] |= UINT64_C(1) << (x & (WORD_BITS - 1));
+    }
+}
+
+void occupancy_clear(const struct p101_env *env, struct occupancy_grid *grid, uint32_t x, uint32_t y)
+{
+    P101_TRACE(env);
+
+    if(x < OCCUPANCY_COLUMNS && y < OCCUPANCY_ROWS)
+    {
+        grid->rows[y][x >> WORD_SHIFT] &= ~(UINT64_C(1) << (x & (WORD_BITS - 1)));
+    }
+}
+
+// Inclusive rectangle. The vector paths count bits per byte (nibble lookup on x86, VCNT on ARM)
+// and widen into 64 bit lanes once per row, so no per-word population count instruction is needed.
+uint32_t occupancy_count_rect(const struct p101_env *env, const struct occupancy_grid *grid, uint32_t x0, uint32_t y0, uint32_t x1, uint32_t y1)
+{
+    uint64_t mask[OCCUPANCY_ROW_WORDS];
+
+    P101_TRACE(env);
+
+    if(!clamp_rect(&x1, &y1, x0, y0))
+    {
+        return 0;
+    }
+    column_mask(mask, x0, x1);
+
+#if defined(__SSSE3__)
+    {
+        __m128i  vector_mask;
+        __m128i  lookup;
+        __m128i  low_nibbles;
+        __m128i  total;
+        uint64_t lanes[2];
+
+        vector_mask = _mm_set_epi64x((long long)mask[1], (long long)mask[0]);
+        lookup      = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        low_nibbles = _mm_set1_epi8(NIBBLE_MASK);
+        total       = _mm_setzero_si128();
+        for(uint32_t y = y0; y <= y1; y++)
+        {
+            __m128i row;
+            __m128i counts;
+
+            row    = _mm_and_si128(_mm_load_si128((const __m128i *)(const void *)grid->rows[y]), vector_mask);
+            counts = _mm_add_epi8(_mm_shuffle_epi8(lookup, _mm_and_si128(row, low_nibbles)), _mm_shuffle_epi8(lookup, _mm_and_si128(_mm_srli_epi16(row, NIBBLE_BITS), low_nibbles)));
+            total  = _mm_add_epi64(total, _mm_sad_epu8(counts, _mm_setzero_si128()));
+        }
+
+        _mm_storeu_si128((__m128i *)(void *)lanes, total);
+        return (uint32_t)(lanes[0] + lanes[1]);
+    }
+#elif defined(__ARM_NEON)
+    {
+        uint64x2_t vector_mask;
+        uint64x2_t total;
+
+        vector_mask = vcombine_u64(vcreate_u64(mask[0]), vcreate_u64(mask[1]));
+        total       = vdupq_n_u64(0);
+        for(uint32_t y = y0; y <= y1; y++)
+        {
+            uint8x16_t counts;
+
+            counts = vcntq_u8(vreinterpretq_u8_u64(vandq_u64(vld1q_u64(grid->rows[y]), vector_mask)));
+            total  = vpadalq_u32(total, vpaddlq_u16(vpaddlq_u8(counts)));
+        }
+
+        return (uint32_t)(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1));
+    }
+#else
+    {
+        uint32_t total;
+
+        total = 0;
+        for(uint32_t y = y0; y <= y1; y++)
+        {
+            for(uint32_t w = 0; w < OCCUPANCY_ROW_WORDS; w++)
+            {
+                total += (uint32_t)__builtin_popcountll(grid->rows[y][w] & mask[w]);
+            }
+        }
+
+        return total;
+    }
+#endif
+}
+
+uint32_t occupancy_count(const struct p101_env *env, const struct occupancy_grid *grid)
+{
+    P101_TRACE(env);
+
+    return occupancy_count_rect(env, grid, 0, 0, OCCUPANCY_COLUMNS - 1, OCCUPANCY_ROWS - 1);
+}
+
+// Cuts the far corner back to the grid, false if nothing of the rectangle is left
+static bool clamp_rect(uint32_t *x1, uint32_t *y1, uint32_t x0, uint32_t y0)
+{
+    if(*x1 >= OCCUPANCY_COLUMNS)
+    {
+        *x1 = OCCUPANCY_COLUMNS - 1;
+    }
+
+    if(*y1 >= OCCUPANCY_ROWS)
+    {
+        *y1 = OCCUPANCY_ROWS - 1;
+    }
+
+    return x0 <= *x1 && y0 <= *y1;
+}
+
+static void column_mask(uint64_t mask[OCCUPANCY_ROW_WORDS], uint32_t x0, uint32_t x1)
+{
+    for(uint32_t w = 0; w < OCCUPANCY_ROW_WORDS; w++)
+    {
+        uint32_t first;
+        uint32_t last;
+        uint32_t width;
+
+        first = w * WORD_BITS;
+        last  = first + WORD_BITS - 1;
+        if(x1 < first || x0 > last)
+        {
+            mask[w] = 0;
+            continue;
+        }
+
+        first   = x0 > first ? x0 : first;
+        last    = x1 < last ? x1 : last;
+        width   = last - first + 1;
+        mask[w] = (width == WORD_BITS ? UINT64_MAX : (UINT64_C(1) << width) - 1) << (first & (WORD_BITS - 1));
+    }
+}
@@ -0,0 +1,128 @@
+#include "../include/packet_pool.h"
+
+#define FREE_LIST_INDEX_MASK 0xFFFFFFFFULL
+#define FREE_LIST_TAG_SHIFT 32
+
+static uint64_t pack_free_head(uint32_t index, uint32_t tag);
+static void     push_free_buffer(struct packet_pool *pool, struct packet_buffer *buffer);
+
+void packet_pool_create(const struct p101_env *env, struct p101_error *err, struct packet_pool *pool, uint32_t capacity)
+{
+    P101_TRACE(env);
+
+    memset(pool, 0, sizeof(*pool));
+
+    pool->buffers = (struct packet_buffer *)aligned_alloc(CACHE_LINE_SIZE, sizeof(struct packet_buffer) * capacity);
+    if(pool->buffers == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "packet pool allocation failed", EXIT_FAILURE);
+        goto done;
+    }
+
+    memset(pool->buffers, 0, sizeof(struct packet_buffer) * capacity);
+    pool->capacity = capacity;
+    atomic_init(&pool->free_head, pack_free_head(PACKET_POOL_EMPTY, 0));
+    atomic_init(&pool->in_use, 0);
+
+    // Push in reverse so the first acquire hands out buffer 0
+    for(uint32_t i = capacity; i > 0; i--)
+    {
+        struct packet_buffer *buffer;
+
+        buffer        = &pool->buffers[i - 1];
+        buffer->index = i - 1;
+        buffer->pool  = pool;
+        atomic_init(&buffer->refcount, 0);
+        atomic_init(&buffer->next, PACKET_POOL_EMPTY);
+        push_free_buffer(pool, buffer);
+    }
+
+done:
+    return;
+}
+
+void packet_pool_destroy(const struct p101_env *env, struct packet_pool *pool)
+{
+    P101_TRACE(env);
+
+    if(atomic_load(&pool->in_use) != 0)
+    {
+        fprintf(stderr, "packet pool destroyed with %u buffers still in use\n", atomic_load(&pool->in_use));
+    }
+
+    free(pool->buffers);
+    pool->buffers  = NULL;
+    pool->capacity = 0;
+}
+
+struct packet_buffer *packet_pool_acquire(const struct p101_env *env, struct packet_pool *pool)
+{
+    uint64_t              head;
+    struct packet_buffer *buffer;
+
+    P101_TRACE(env);
+
+    head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+
+    do
+    {
+        uint32_t index;
+        uint32_t next;
+
+        index = (uint32_t)(head & FREE_LIST_INDEX_MASK);
+        if(index == PACKET_POOL_EMPTY)
+        {
+            return NULL;
+        }
+
+        buffer = &pool->buffers[index];
+        next   = atomic_load_explicit(&buffer->next, memory_order_relaxed);
+
+        // The tag changes on every successful pop, so a buffer that was popped and pushed back in between is detected
+        if(atomic_compare_exchange_weak_explicit(&pool->free_head, &head, pack_free_head(next, (uint32_t)(head >> FREE_LIST_TAG_SHIFT) + 1), memory_order_acq_rel, memory_order_acquire))
+        {
+            break;
+        }
+    } while(1);
+
+    buffer->length = 0;
+    atomic_store_explicit(&buffer->refcount, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed);
+
+    return buffer;
+}
+
+void packet_buffer_retain(const struct p101_env *env, struct packet_buffer *buffer)
+{
+    P101_TRACE(env);
+
+    atomic_fetch_add_explicit(&buffer->refcount, 1, memory_order_relaxed);
+}
+
+void packet_buffer_release(const struct p101_env *env, struct packet_buffer *buffer)
+{
+    P101_TRACE(env);
+
+    if(atomic_fetch_sub_explicit(&buffer->refcount, 1, memory_order_acq_rel) == 1)
+    {
+        atomic_fetch_sub_explicit(&buffer->pool->in_use, 1, memory_order_relaxed);
+        push_free_buffer(buffer->pool, buffer);
+    }
+}
+
+static uint64_t pack_free_head(uint32_t index, uint32_t tag)
+{
+    return ((uint64_t)tag << FREE_LIST_TAG_SHIFT) | (uint64_t)index;
+}
+
+static void push_free_buffer(struct packet_pool *pool, struct packet_buffer *buffer)
+{
+    uint64_t head;
+
+    head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+
+    do
+    {
+        atomic_store_explicit(&buffer->next, (uint32_t)(head & FREE_LIST_INDEX_MASK), memory_order_relaxed);
+    } while(!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, pack_free_head(buffer->index, (uint32_t)(head >> FREE_LIST_TAG_SHIFT)), memory_order_release, memory_order_relaxed));
+}
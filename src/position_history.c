@@ -0,0 +1,55 @@
+#include "../include/position_history.h"
+
+void position_history_reset(const struct p101_env *env, struct position_history *history)
+{
+    P101_TRACE(env);
+
+    history->next  = 0;
+    history->count = 0;
+}
+
+// Called whenever the player lands on a cell, the oldest position is overwritten once the ring is full
+void position_history_record(const struct p101_env *env, struct position_history *history, int64_t time_us, uint32_t x, uint32_t y)
+{
+    struct position_sample *sample;
+
+    P101_TRACE(env);
+
+    sample          = &history->samples[history->next];
+    sample->time_us = time_us;
+    sample->x       = x;
+    sample->y       = y;
+    history->next   = (history->next + 1) & (POSITION_HISTORY_LENGTH - 1);
+    if(history->count < POSITION_HISTORY_LENGTH)
+    {
+        history->count++;
+    }
+}
+
+// Where the player stood at time_us. Returns false if it had not joined yet. A time older than the
+// whole ring gets the oldest position kept, the best guess left.
+bool position_history_at(const struct p101_env *env, const struct position_history *history, int64_t time_us, uint32_t *x, uint32_t *y)
+{
+    const struct position_sample *sample;
+
+    P101_TRACE(env);
+
+    sample = NULL;
+    for(uint32_t i = 1; i <= history->count; i++)
+    {
+        sample = &history->samples[(history->next - i) & (POSITION_HISTORY_LENGTH - 1)];
+        if(sample->time_us <= time_us)
+        {
+            break;
+        }
+    }
+
+    if(sample == NULL || (sample->time_us > time_us && history->count < POSITION_HISTORY_LENGTH))
+    {
+        return false;
+    }
+
+    *x = sample->x;
+    *y = sample->y;
+    return true;
+}
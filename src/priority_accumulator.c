@@ -0,0 +1,223 @@
+#include "../include/priority_accumulator.h"
+
+static struct pending_update *find_update(struct priority_accumulator *accumulator, int entity);
+static uint32_t               distance_weight(uint32_t viewer_x, uint32_t viewer_y, const struct coordinates *coordinates);
+static uint32_t               axis_distance(uint32_t a, uint32_t b);
+
+void priority_accumulator_clear(const struct p101_env *env, struct priority_accumulator *accumulator)
+{
+    P101_TRACE(env);
+
+    accumulator->count = 0;
+}
+
+// Queues a move of entity for the viewer. A move of an entity the viewer is still owed folds into the
+// update already waiting, which keeps its priority and where the viewer last saw the entity. Returns
+// false if the viewer has no slot left.
+bool priority_accumulator_push(const struct p101_env *env, struct priority_accumulator *accumulator, int entity, const struct packet_header *header, const struct coordinates *coordinates, bool urgent, struct snapshot_stats *stats)
+{
+    struct pending_update *update;
+
+    P101_TRACE(env);
+
+    update = find_update(accumulator, entity);
+    if(update != NULL)
+    {
+        update->header            = *header;
+        update->coordinates.new_x = coordinates->new_x;
+        update->coordinates.new_y = coordinates->new_y;
+        update->urgent            = urgent;
+        stats->coalesced++;
+        return true;
+    }
+
+    if(accumulator->count == PRIORITY_ACCUMULATOR_SLOTS)
+    {
+        return false;
+    }
+
+    update              = &accumulator->updates[accumulator->count++];
+    update->header      = *header;
+    update->coordinates = *coordinates;
+    update->entity      = entity;
+    update->priority    = 0;
+    update->urgent      = urgent;
+    return true;
+}
+
+// The entity just came into the viewer's view, the viewer forgot whatever it knew of it, so the update
+// starts and ends on the entity's position. Returns false if the viewer has no slot left.
+bool priority_accumulator_reveal(const struct p101_env *env, struct priority_accumulator *accumulator, int entity, const struct packet_header *header, const struct coordinates *position)
+{
+    struct pending_update *update;
+
+    P101_TRACE(env);
+
+    update = find_update(accumulator, entity);
+    if(update == NULL)
+    {
+        if(accumulator->count == PRIORITY_ACCUMULATOR_SLOTS)
+        {
+            return false;
+        }
+
+        update           = &accumulator->updates[accumulator->count++];
+        update->entity   = entity;
+        update->priority = 0;
+        update->urgent   = false;
+    }
+
+    update->header      = *header;
+    update->coordinates = *position;
+    return true;
+}
+
+// The entity left without an exit, say on a handoff to another zone, so its waiting moves are of no use.
+// An exit already waiting still goes out.
+void priority_accumulator_forget(const struct p101_env *env, struct priority_accumulator *accumulator, int entity)
+{
+    struct pending_update *update;
+
+    P101_TRACE(env);
+
+    update = find_update(accumulator, entity);
+    if(update != NULL)
+    {
+        *update = accumulator->updates[--accumulator->count];
+    }
+}
+
+// One tick for one viewer: every waiting update gains priority, then the urgent ones and the best of the
+// rest, up to max_updates in all, are moved to taken in the order they should be sent. Returns how many.
+uint32_t priority_accumulator_take(const struct p101_env *env, struct priority_accumulator *accumulator, uint32_t viewer_x, uint32_t viewer_y, uint32_t max_updates, struct pending_update *taken)
+{
+    uint32_t count;
+
+    P101_TRACE(env);
+
+    for(uint32_t i = 0; i < accumulator->count; i++)
+    {
+        accumulator->updates[i].priority += distance_weight(viewer_x, viewer_y, &accumulator->updates[i].coordinates);
+    }
+
+    // A viewer is owed a handful of updates, picking the best one at a time beats sorting them all
+    count = 0;
+    while(accumulator->count > 0)
+    {
+        uint32_t best;
+
+        best = 0;
+        for(uint32_t i = 1; i < accumulator->count; i++)
+        {
+            const struct pending_update *update;
+
+            update = &accumulator->updates[i];
+            if(update->urgent > accumulator->updates[best].urgent || (update->urgent == accumulator->updates[best].urgent && update->priority > accumulator->updates[best].priority))
+            {
+                best = i;
+            }
+        }
+
+        if(count >= max_updates && !accumulator->updates[best].urgent)
+        {
+            break;
+        }
+
+        taken[count++]             = accumulator->updates[best];
+        accumulator->updates[best] = accumulator->updates[--accumulator->count];
+    }
+
+    return count;
+}
+
+// Updates that fit in budget bytes, each datagram paying for its headers once. A budget too small for
+// even one still sends one a tick, so it slows the world down rather than freezing it.
+uint32_t snapshot_updates_for_budget(uint32_t budget)
+{
+    uint32_t full;
+    uint32_t rest;
+
+    full = budget / (SNAPSHOT_DATAGRAM_OVERHEAD + SNAPSHOT_MAX_UPDATES * POSITION_PACKET_SIZE);
+    rest = budget % (SNAPSHOT_DATAGRAM_OVERHEAD + SNAPSHOT_MAX_UPDATES * POSITION_PACKET_SIZE);
+    if(rest < SNAPSHOT_MIN_BUDGET)
+    {
+        return full == 0 ? 1 : full * SNAPSHOT_MAX_UPDATES;
+    }
+
+    return full * SNAPSHOT_MAX_UPDATES + (uint32_t)((rest - SNAPSHOT_DATAGRAM_OVERHEAD) / POSITION_PACKET_SIZE);
+}
+
+void snapshot_stats_print(const struct p101_env *env, const struct snapshot_stats *stats, uint32_t count, uint32_t budget)
+{
+    uint64_t datagrams;
+    uint64_t updates;
+    uint64_t coalesced;
+    uint64_t deferred;
+    uint64_t overflows;
+
+    P101_TRACE(env);
+
+    if(budget == 0)
+    {
+        return;
+    }
+
+    datagrams = 0;
+    updates   = 0;
+    coalesced = 0;
+    deferred  = 0;
+    overflows = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        datagrams += stats[i].datagrams;
+        updates   += stats[i].updates;
+        coalesced += stats[i].coalesced;
+        deferred  += stats[i].deferred;
+        overflows += stats[i].overflows;
+    }
+
+    printf("Snapshots: %u bytes per client per tick, %" PRIu64 " datagrams carrying %" PRIu64 " updates, %" PRIu64 " coalesced, %" PRIu64 " deferred, %" PRIu64 " overflows\n", budget, datagrams, updates, coalesced, deferred, overflows);
+}
+
+// A waiting exit is closed to further moves. The entity's slot may already be a new player's, whose
+// moves would otherwise fold into the exit and leave the old player standing as a ghost.
+static struct pending_update *find_update(struct priority_accumulator *accumulator, int entity)
+{
+    for(uint32_t i = 0; i < accumulator->count; i++)
+    {
+        if(accumulator->updates[i].entity == entity && !accumulator->updates[i].urgent)
+        {
+            return &accumulator->updates[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Falls off with distance but never reaches zero, so even the farthest entity in view gets its turn
+static uint32_t distance_weight(uint32_t viewer_x, uint32_t viewer_y, const struct coordinates *coordinates)
+{
+    uint32_t distance;
+    uint32_t dx;
+    uint32_t dy;
+
+    // An exit has no position of its own, it is weighed where the entity was last seen
+    if(coordinates->new_x >= WORLD_COLUMNS || coordinates->new_y >= WORLD_ROWS)
+    {
+        dx = axis_distance(viewer_x, coordinates->old_x);
+        dy = axis_distance(viewer_y, coordinates->old_y);
+    }
+    else
+    {
+        dx = axis_distance(viewer_x, coordinates->new_x);
+        dy = axis_distance(viewer_y, coordinates->new_y);
+    }
+
+    distance = dx > dy ? dx : dy;
+    return 1 + PRIORITY_MAX_WEIGHT * PRIORITY_FALLOFF_CELLS / (PRIORITY_FALLOFF_CELLS + distance);
+}
+
+static uint32_t axis_distance(uint32_t a, uint32_t b)
+{
+    return a > b ? a - b : b - a;
+}
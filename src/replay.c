@@ -0,0 +1,365 @@
+#include "../include/capture.h"
+#include "../include/game_server.h"
+#include "../include/signal_handler.h"
+#include <p101_c/p101_string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNKNOWN_OPTION_MESSAGE_LEN 24
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+// Stands in for the socket, counts and fingerprints what the server would have sent
+struct replay_sink
+{
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t digest;
+};
+
+static void                   parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
+static void                   check_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
+static _Noreturn void         usage(struct p101_env *env, struct p101_error *err, struct context *context);
+static void                   sink_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms);
+static void                   sink_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg);
+static enum send_queue_status sink_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen);
+static void                   sink_destroy(const struct p101_env *env, struct io_backend *backend);
+static void                   wait_until(const struct timespec *start, uint64_t offset_ns);
+static void                   print_replay_report(const struct p101_env *env, const struct capture_reader *reader, const struct replay_sink *sink, const struct latency_stats *processing, int64_t elapsed_ns, uint64_t span_ns);
+
+static const struct io_backend_ops sink_ops = {"replay", sink_wait, sink_receive, sink_flush, sink_destroy, NULL, NULL};
+
+int main(int argc, char *argv[])
+{
+    int                   ret_val;
+    struct p101_error    *error;
+    struct p101_env      *env;
+    struct arguments      arguments;
+    struct context        context;
+    struct server_state  *server;
+    struct capture_reader reader;
+    struct capture_record record;
+    struct replay_sink    sink;
+    struct latency_stats  processing;
+    struct timespec       start;
+    struct timespec       end;
+    uint8_t               payload[PACKET_BUFFER_SIZE];
+
+    error = p101_error_create(false);
+
+    if(error == NULL)
+    {
+        ret_val = EXIT_FAILURE;
+        goto done;
+    }
+
+    env = p101_env_create(error, true, NULL);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_error;
+    }
+
+    p101_memset(env, &arguments, 0, sizeof(arguments));    // Set memory of arguments to 0
+    p101_memset(env, &context, 0, sizeof(context));        // Set memory of context to 0
+    context.arguments       = &arguments;
+    context.arguments->argc = argc;
+    context.arguments->argv = argv;
+
+    parse_arguments(env, error, &context);
+    check_arguments(env, error, &context);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    capture_reader_open(env, error, &reader, context.arguments->capture_path);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    // Per-client tables make this megabytes, too much for the stack
+    server = (struct server_state *)malloc(sizeof(*server));
+    if(server == NULL)
+    {
+        P101_ERROR_RAISE_USER(error, "could not allocate the server state", EXIT_FAILURE);
+        ret_val = EXIT_FAILURE;
+        goto close_reader;
+    }
+
+    game_server_init(env, error, server, 0, false);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_server;
+    }
+
+    // The game logic runs unchanged, only the network underneath it is replaced by the sink
+    p101_memset(env, &sink, 0, sizeof(sink));
+    sink.digest           = FNV_OFFSET_BASIS;
+    server->backend.ops   = &sink_ops;
+    server->backend.pool  = &server->pool;
+    server->backend.state = &sink;
+    server->verbose       = false;
+    latency_stats_init(env, &processing);
+    record.timestamp_ns = 0;
+
+    setup_signal_handler();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(!exit_flag && capture_read(env, error, &reader, &record, payload, sizeof(payload)))
+    {
+        struct receive_metadata metadata;
+        struct timespec         before;
+        struct timespec         after;
+
+        if(!context.arguments->unpaced)
+        {
+            wait_until(&start, record.timestamp_ns);
+        }
+
+        // Receive metadata is left empty, kernel timestamps and drop counts from the capture host mean nothing here
+        memset(&metadata, 0, sizeof(metadata));
+
+        clock_gettime(CLOCK_MONOTONIC, &before);
+        game_server_handle_datagram(env, error, server, (const struct sockaddr *)&record.addr, payload, record.length, &metadata);
+        game_server_flush(env, server);
+        clock_gettime(CLOCK_MONOTONIC, &after);
+        latency_stats_record(env, &processing, timespec_diff_ns(&after, &before));
+
+        if(p101_error_has_error(error))
+        {
+            break;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    print_replay_report(env, &reader, &sink, &processing, timespec_diff_ns(&end, &start), record.timestamp_ns);
+    game_server_print_stats(env, server, false);
+    ret_val = p101_error_has_error(error) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    game_server_destroy(env, server);
+
+free_server:
+    free(server);
+
+close_reader:
+    capture_reader_close(env, &reader);
+
+free_env:
+    free(context.exit_message);
+    free(env);
+
+free_error:
+    if(p101_error_has_error(error))
+    {
+        fprintf(stderr, "Error: %s\n", p101_error_get_message(error));
+    }
+    p101_error_reset(error);
+    free(error);
+
+done:
+    printf("Exit code: %d\n", ret_val);
+    return ret_val;
+}
+
+static void parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    int opt;
+
+    P101_TRACE(env);
+
+    context->arguments->program_name = context->arguments->argv[0];
+    opterr                           = 0;
+
+    while((opt = getopt(context->arguments->argc, context->arguments->argv, "hf:x")) != -1)
+    {
+        switch(opt)
+        {
+            case 'f':    // Capture file argument
+            {
+                context->arguments->capture_path = optarg;
+                break;
+            }
+            case 'x':    // Unpaced replay argument
+            {
+                context->arguments->unpaced = true;
+                break;
+            }
+            case 'h':    // Help argument
+            {
+                goto usage;
+            }
+            case '?':
+            {
+                char message[UNKNOWN_OPTION_MESSAGE_LEN];
+
+                snprintf(message, sizeof(message), "Unknown option '-%c'.", optopt);
+                context->exit_message = p101_strdup(env, err, message);
+                goto usage;
+            }
+            default:
+            {
+                context->exit_message = p101_strdup(env, err, "Unknown error with getopt.");
+                goto usage;
+            }
+        }
+    }
+
+    if(optind < context->arguments->argc)
+    {
+        context->exit_message = p101_strdup(env, err, "Too many arguments.");
+        goto usage;
+    }
+
+    return;
+
+usage:
+    usage(env, err, context);
+}
+
+static void check_arguments(struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    P101_TRACE(env);
+
+    if(context->arguments->capture_path == NULL)
+    {
+        context->exit_message = p101_strdup(env, err, "<file> must be passed.");
+        goto usage;
+    }
+
+    return;
+
+usage:
+    usage(env, err, context);
+}
+
+static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    P101_TRACE(env);
+
+    context->exit_code = EXIT_FAILURE;
+
+    if(context->exit_message != NULL)
+    {
+        fprintf(stderr, "%s\n", context->exit_message);
+    }
+
+    fprintf(stderr, "Usage: %s [-h] -f <file> [-x]\n", context->arguments->program_name);
+    fputs("Options:\n", stderr);
+    fputs("  -h Display this help message\n", stderr);
+    fputs("  -f <file>        Option 'f' (required) capture file recorded with the server's -c option.\n", stderr);
+    fputs("  -x               Option 'x' (optional) replay as fast as possible instead of at recorded speed.\n", stderr);
+
+    free(context->exit_message);
+    free(env);
+    p101_error_reset(err);
+    free(err);
+
+    printf("Exit code: %d\n", context->exit_code);
+    exit(context->exit_code);
+}
+
+static void sink_wait(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, bool pending_sends, int timeout_ms)
+{
+    P101_TRACE(env);
+
+    (void)err;
+    (void)backend;
+    (void)pending_sends;
+    (void)timeout_ms;
+}
+
+static void sink_receive(const struct p101_env *env, struct p101_error *err, struct io_backend *backend, io_receive_handler handler, void *arg)
+{
+    P101_TRACE(env);
+
+    (void)err;
+    (void)backend;
+    (void)handler;
+    (void)arg;
+}
+
+static enum send_queue_status sink_flush(const struct p101_env *env, struct io_backend *backend, struct send_queue *queue, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct replay_sink *sink;
+
+    P101_TRACE(env);
+
+    sink = (struct replay_sink *)backend->state;
+
+    // Fold destination and payload into the digest, two replays of one capture must produce the same value
+    while(queue->count > 0)
+    {
+        const struct packet_buffer *packet;
+        const uint8_t              *bytes;
+
+        packet = queue->entries[queue->head].packet;
+        bytes  = (const uint8_t *)addr;
+        for(socklen_t i = 0; i < addrlen; i++)
+        {
+            sink->digest = (sink->digest ^ bytes[i]) * FNV_PRIME;
+        }
+
+        for(size_t i = 0; i < packet->length; i++)
+        {
+            sink->digest = (sink->digest ^ packet->data[i]) * FNV_PRIME;
+        }
+
+        sink->datagrams++;
+        sink->bytes += packet->length;
+        queue->sent++;
+        send_queue_pop(env, queue);
+    }
+
+    return SEND_QUEUE_DRAINED;
+}
+
+static void sink_destroy(const struct p101_env *env, struct io_backend *backend)
+{
+    P101_TRACE(env);
+
+    (void)backend;
+}
+
+static void wait_until(const struct timespec *start, uint64_t offset_ns)
+{
+    struct timespec now;
+    int64_t         remaining_ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    remaining_ns = (int64_t)offset_ns - timespec_diff_ns(&now, start);
+
+    if(remaining_ns > 0)
+    {
+        struct timespec delay;
+
+        delay.tv_sec  = (time_t)(remaining_ns / NANOSECONDS_PER_SECOND);
+        delay.tv_nsec = (long)(remaining_ns % NANOSECONDS_PER_SECOND);
+        nanosleep(&delay, NULL);
+    }
+}
+
+static void print_replay_report(const struct p101_env *env, const struct capture_reader *reader, const struct replay_sink *sink, const struct latency_stats *processing, int64_t elapsed_ns, uint64_t span_ns)
+{
+    double elapsed_seconds;
+
+    P101_TRACE(env);
+
+    elapsed_seconds = (double)elapsed_ns / (double)NANOSECONDS_PER_SECOND;
+
+    printf("Replayed %" PRIu64 " datagrams captured over %.3f s in %.3f s\n", reader->records, (double)span_ns / (double)NANOSECONDS_PER_SECOND, elapsed_seconds);
+    if(elapsed_seconds > 0)
+    {
+        printf("Throughput: %.0f datagrams/s in, %.0f datagrams/s out\n", (double)reader->records / elapsed_seconds, (double)sink->datagrams / elapsed_seconds);
+    }
+    printf("Sent %" PRIu64 " datagrams (%" PRIu64 " bytes), output digest %016" PRIx64 "\n", sink->datagrams, sink->bytes, sink->digest);
+    latency_stats_print(env, processing, "Handle and flush per datagram");
+    if(processing->count > 0)
+    {
+        printf("Handle and flush average: %" PRIu64 " ns\n", processing->total_ns / processing->count);
+    }
+}
@@ -0,0 +1,118 @@
+#include "../include/room.h"
+
+void room_table_init(const struct p101_env *env, struct room_table *table)
+{
+    P101_TRACE(env);
+
+    memset(table, 0, sizeof(*table));
+}
+
+uint32_t room_find(const struct p101_env *env, const struct room_table *table, uint32_t room_id)
+{
+    P101_TRACE(env);
+
+    for(uint32_t i = 0; i < MAX_ROOMS; i++)
+    {
+        if(table->rooms[i].active && table->rooms[i].id == room_id)
+        {
+            return i;
+        }
+    }
+
+    return ROOM_NONE;
+}
+
+// Finds the room with this id or opens a free slot for it, and reserves a place for one player.
+// Only runs on join, so a linear scan over the table is cheaper than keeping an index up to date.
+uint32_t room_admit(const struct p101_env *env, struct room_table *table, uint32_t room_id)
+{
+    uint32_t free_slot;
+
+    P101_TRACE(env);
+
+    free_slot = ROOM_NONE;
+
+    for(uint32_t i = 0; i < MAX_ROOMS; i++)
+    {
+        struct room *room;
+
+        room = &table->rooms[i];
+        if(room->active && room->id == room_id)
+        {
+            if(room->population == ROOM_CAPACITY)
+            {
+                return ROOM_NONE;
+            }
+
+            room->population++;
+            return i;
+        }
+
+        if(!room->active && free_slot == ROOM_NONE)
+        {
+            free_slot = i;
+        }
+    }
+
+    if(free_slot != ROOM_NONE)
+    {
+        struct room *room;
+
+        room             = &table->rooms[free_slot];
+        room->id         = room_id;
+        room->active     = true;
+        room->population = 1;
+        table->active++;
+
+        if(table->active > table->peak_active)
+        {
+            table->peak_active = table->active;
+        }
+    }
+
+    return free_slot;
+}
+
+void room_release(const struct p101_env *env, struct room_table *table, uint32_t slot)
+{
+    struct room *room;
+
+    P101_TRACE(env);
+
+    room = &table->rooms[slot];
+    room->population--;
+
+    // The slot can be handed to a new room straight away, its leave events are already queued ahead of any join
+    if(room->population == 0)
+    {
+        room->active = false;
+        table->active--;
+    }
+}
+
+void room_add_member(const struct p101_env *env, struct room *room, int client_index)
+{
+    P101_TRACE(env);
+
+    if(room->member_count < ROOM_CAPACITY)
+    {
+        room->members[room->member_count] = client_index;
+        room->member_count++;
+    }
+}
+
+void room_remove_member(const struct p101_env *env, struct room *room, int client_index)
+{
+    P101_TRACE(env);
+
+    // Order does not matter, so fill the hole with the last member
+    for(uint32_t i = 0; i < room->member_count; i++)
+    {
+        if(room->members[i] == client_index)
+        {
+            room->member_count--;
+            room->members[i] = room->members[room->member_count];
+            return;
+        }
+    }
+}
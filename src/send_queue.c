@@ -0,0 +1,190 @@
+#include "../include/send_queue.h"
+
+#define UDP_MAX_PAYLOAD 65507
+#define SEGMENT_BATCH_BLOCKED (-1)
+
+static int send_segment_batch(const struct p101_env *env, struct send_queue *queue, struct udp_offload *offload, int sockfd, const struct sockaddr *addr, socklen_t addrlen);
+
+void send_queue_init(const struct p101_env *env, struct send_queue *queue)
+{
+    P101_TRACE(env);
+
+    memset(queue, 0, sizeof(*queue));
+}
+
+void send_queue_push(const struct p101_env *env, struct send_queue *queue, struct packet_buffer *packet, int origin)
+{
+    struct send_queue_entry *entry;
+
+    P101_TRACE(env);
+
+    // Latest position wins: a newer update from the same origin replaces the queued one in place
+    for(uint32_t i = 0; i < queue->count && origin != SEND_QUEUE_NO_ORIGIN; i++)
+    {
+        entry = &queue->entries[(queue->head + i) % SEND_QUEUE_DEPTH];
+
+        if(entry->origin == origin)
+        {
+            packet_buffer_retain(env, packet);
+            packet_buffer_release(env, entry->packet);
+            entry->packet = packet;
+            queue->coalesced++;
+            return;
+        }
+    }
+
+    // Full queue: drop the oldest update rather than growing without bound
+    if(queue->count == SEND_QUEUE_DEPTH)
+    {
+        packet_buffer_release(env, queue->entries[queue->head].packet);
+        queue->entries[queue->head].packet = NULL;
+        queue->head                        = (queue->head + 1) % SEND_QUEUE_DEPTH;
+        queue->count--;
+        queue->dropped++;
+    }
+
+    entry = &queue->entries[(queue->head + queue->count) % SEND_QUEUE_DEPTH];
+    packet_buffer_retain(env, packet);
+    entry->packet = packet;
+    entry->origin = origin;
+    queue->count++;
+}
+
+enum send_queue_status send_queue_flush(const struct p101_env *env, struct send_queue *queue, struct udp_offload *offload, int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    P101_TRACE(env);
+
+    while(queue->count > 0)
+    {
+        struct send_queue_entry *entry;
+        ssize_t                  bytes_written;
+
+        if(offload != NULL && offload->gso && queue->count > 1)
+        {
+            int consumed;
+
+            consumed = send_segment_batch(env, queue, offload, sockfd, addr, addrlen);
+            if(consumed == SEGMENT_BATCH_BLOCKED)
+            {
+                return SEND_QUEUE_BLOCKED;
+            }
+
+            if(consumed > 0)
+            {
+                continue;
+            }
+        }
+
+        entry         = &queue->entries[queue->head];
+        bytes_written = sendto(sockfd, entry->packet->data, entry->packet->length, MSG_DONTWAIT, addr, addrlen);
+
+        if(bytes_written == -1)
+        {
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            {
+                return SEND_QUEUE_BLOCKED;
+            }
+
+            // Anything else is specific to this destination, so give up on the packet and keep going
+            queue->failed++;
+        }
+        else
+        {
+            queue->sent++;
+        }
+
+        send_queue_pop(env, queue);
+    }
+
+    return SEND_QUEUE_DRAINED;
+}
+
+void send_queue_pop(const struct p101_env *env, struct send_queue *queue)
+{
+    P101_TRACE(env);
+
+    packet_buffer_release(env, queue->entries[queue->head].packet);
+    queue->entries[queue->head].packet = NULL;
+    queue->head                        = (queue->head + 1) % SEND_QUEUE_DEPTH;
+    queue->count--;
+}
+
+void send_queue_clear(const struct p101_env *env, struct send_queue *queue)
+{
+    P101_TRACE(env);
+
+    while(queue->count > 0)
+    {
+        send_queue_pop(env, queue);
+    }
+
+    queue->head = 0;
+}
+
+// Sends the run of equal sized packets at the head of the queue as one GSO datagram train.
+// Returns how many entries were consumed, 0 when the caller should send the head on its own.
+static int send_segment_batch(const struct p101_env *env, struct send_queue *queue, struct udp_offload *offload, int sockfd, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct iovec iov[SEND_QUEUE_DEPTH];
+    size_t       segment_size;
+    size_t       total;
+    uint32_t     run;
+    ssize_t      bytes_written;
+
+    P101_TRACE(env);
+
+    segment_size = queue->entries[queue->head].packet->length;
+    total        = 0;
+    run          = 0;
+
+    while(run < queue->count && run < UDP_GSO_MAX_SEGMENTS && total + segment_size <= UDP_MAX_PAYLOAD)
+    {
+        struct packet_buffer *packet;
+
+        packet = queue->entries[(queue->head + run) % SEND_QUEUE_DEPTH].packet;
+        if(packet->length != segment_size)
+        {
+            break;
+        }
+
+        iov[run].iov_base = packet->data;
+        iov[run].iov_len  = packet->length;
+        total += packet->length;
+        run++;
+    }
+
+    if(run < 2)
+    {
+        return 0;
+    }
+
+    bytes_written = udp_offload_send_segments(env, offload, sockfd, iov, run, (uint16_t)segment_size, addr, addrlen);
+    if(bytes_written == -1)
+    {
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+        {
+            return SEGMENT_BATCH_BLOCKED;
+        }
+
+        if(udp_offload_send_unsupported(errno))
+        {
+            fprintf(stderr, "UDP GSO send failed, falling back to one sendto per datagram: %s\n", strerror(errno));
+            offload->gso = false;
+            return 0;
+        }
+
+        queue->failed += run;
+    }
+    else
+    {
+        queue->sent += run;
+        queue->segmented_sends++;
+    }
+
+    for(uint32_t i = 0; i < run; i++)
+    {
+        send_queue_pop(env, queue);
+    }
+
+    return (int)run;
+}
@@ -0,0 +1,328 @@
+#include "../include/send_rate.h"
+
+static int64_t  smooth(int64_t estimate, int64_t sample, int64_t weight);
+static uint32_t spaced_budget(const struct send_rate_limits *limits, uint32_t interval_ticks);
+static void     back_off(struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats);
+static void     recover(struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats);
+
+// tick_budget is what a client sent a snapshot every tick gets, one sent less often may get up to a full datagram
+void send_rate_limits_init(const struct p101_env *env, struct send_rate_limits *limits, uint32_t max_interval_ms, uint32_t tick_budget)
+{
+    int64_t max_interval_ticks;
+
+    P101_TRACE(env);
+
+    memset(limits, 0, sizeof(*limits));
+    if(max_interval_ms == 0 || tick_budget == 0)
+    {
+        return;
+    }
+
+    max_interval_ticks         = (int64_t)max_interval_ms * NANOSECONDS_PER_MILLISECOND / SNAPSHOT_TICK_NS;
+    limits->tick_ns            = SNAPSHOT_TICK_NS;
+    limits->max_interval_ticks = max_interval_ticks < 1 ? 1 : (uint32_t)max_interval_ticks;
+    limits->tick_budget        = tick_budget > SEND_RATE_MIN_BUDGET ? tick_budget : SEND_RATE_MIN_BUDGET;
+    limits->max_budget         = limits->tick_budget > SEND_RATE_FULL_BUDGET ? limits->tick_budget : SEND_RATE_FULL_BUDGET;
+}
+
+// Full rate, until the client's acks say otherwise
+void send_rate_reset(const struct p101_env *env, struct send_rate *rate, const struct send_rate_limits *limits)
+{
+    P101_TRACE(env);
+
+    memset(rate, 0, sizeof(*rate));
+    rate->min_rtt_us     = INT64_MAX;
+    rate->interval_ticks = 1;
+    rate->budget         = limits->tick_budget;
+}
+
+// Snapshots go out on the room thread's ticks, so half a tick early is as close as half a tick late
+bool send_rate_due(const struct send_rate *rate, const struct send_rate_limits *limits, int64_t now_ns)
+{
+    return now_ns >= rate->next_snapshot_ns - limits->tick_ns / 2;
+}
+
+void send_rate_schedule(struct send_rate *rate, const struct send_rate_limits *limits, int64_t now_ns)
+{
+    rate->next_snapshot_ns = now_ns + ((int64_t)rate->interval_ticks * limits->tick_ns);
+}
+
+// What is left of the client's budget for updates once every datagram's sequence record is paid for
+uint32_t send_rate_update_budget(const struct send_rate *rate)
+{
+    uint32_t records;
+
+    records = (rate->budget / PACKET_BUFFER_SIZE + 1) * (uint32_t)POSITION_PACKET_SIZE;
+    return rate->budget > records + SNAPSHOT_MIN_BUDGET ? rate->budget - records : (uint32_t)SNAPSHOT_MIN_BUDGET;
+}
+
+// The sequence number for the next snapshot datagram to the client
+uint32_t send_rate_next_sequence(const struct p101_env *env, struct send_rate *rate, int64_t now_us)
+{
+    uint32_t sequence;
+
+    P101_TRACE(env);
+
+    sequence                                    = rate->next_sequence++;
+    rate->sent_us[sequence % SEND_RATE_HISTORY] = now_us;
+    return sequence;
+}
+
+// Takes an ack of the snapshot numbered sequence, with received snapshots arrived in all, and moves the
+// client's rate at most once a round trip
+void send_rate_ack(const struct p101_env *env, struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats, uint32_t sequence, uint32_t received, int64_t now_us)
+{
+    bool queueing;
+
+    P101_TRACE(env);
+
+    stats->acks++;
+
+    // An ack overtaken by a newer one says nothing new, and one for a snapshot never sent is not believed
+    if((rate->acked && (int32_t)(sequence - rate->acked_sequence) <= 0) || (int32_t)(rate->next_sequence - sequence) <= 0)
+    {
+        return;
+    }
+
+    if(rate->next_sequence - sequence <= SEND_RATE_HISTORY)
+    {
+        int64_t rtt_us;
+
+        rtt_us = now_us - rate->sent_us[sequence % SEND_RATE_HISTORY];
+        if(rate->acked)
+        {
+            rate->srtt_us = smooth(rate->srtt_us, rtt_us, RTT_SMOOTHING);
+        }
+        else
+        {
+            rate->srtt_us = rtt_us;
+        }
+
+        if(rtt_us < rate->min_rtt_us)
+        {
+            rate->min_rtt_us = rtt_us;
+        }
+    }
+
+    // Whatever was sent between the two acks and did not arrive was lost, late arrivals count where they land.
+    // Every snapshot weighs the same however many an ack covers, and spaced out ones weigh more, so the
+    // estimate forgets a loss in about the same time at any rate.
+    if(rate->acked)
+    {
+        uint32_t expected;
+        uint32_t arrived;
+        int64_t  smoothing;
+
+        expected  = sequence - rate->acked_sequence;
+        arrived   = received - rate->acked_received;
+        arrived   = arrived > expected ? expected : arrived;
+        smoothing = SEND_RATE_LOSS_SMOOTHING / rate->interval_ticks;
+        smoothing = smoothing < SEND_RATE_LOSS_MIN_SMOOTHING ? SEND_RATE_LOSS_MIN_SMOOTHING : smoothing;
+        for(uint32_t i = 0; i < expected && i < SEND_RATE_HISTORY; i++)
+        {
+            rate->loss_ppm = smooth(rate->loss_ppm, i < expected - arrived ? SEND_RATE_PPM : 0, smoothing);
+        }
+    }
+
+    rate->acked_sequence = sequence;
+    rate->acked_received = received;
+    rate->acked          = true;
+    if(now_us < rate->settle_us)
+    {
+        return;
+    }
+
+    // A round trip well above the shortest one seen means a queue is building somewhere on the path
+    queueing = rate->min_rtt_us != INT64_MAX && rate->srtt_us > (2 * rate->min_rtt_us) + SEND_RATE_QUEUE_SLACK_US;
+    if(rate->loss_ppm > SEND_RATE_LOSS_HIGH_PPM || queueing)
+    {
+        back_off(rate, limits, stats);
+    }
+    else if(rate->loss_ppm < SEND_RATE_LOSS_LOW_PPM)
+    {
+        recover(rate, limits, stats);
+    }
+    else
+    {
+        return;
+    }
+
+    rate->settle_us = now_us + (rate->srtt_us > SEND_RATE_MIN_SETTLE_US ? rate->srtt_us : SEND_RATE_MIN_SETTLE_US);
+}
+
+void send_rate_print_stats(const struct p101_env *env, const struct send_rate_limits *limits, const struct send_rate_stats *stats, uint32_t count, const struct send_rate *rates, const atomic_bool *active)
+{
+    uint64_t acks;
+    uint64_t backoffs;
+    uint64_t recoveries;
+    uint32_t acking;
+    uint32_t backed_off;
+    double   interval_ms;
+    double   budget;
+    double   loss_ppm;
+    double   srtt_us;
+
+    P101_TRACE(env);
+
+    if(limits->max_interval_ticks == 0)
+    {
+        return;
+    }
+
+    acks       = 0;
+    backoffs   = 0;
+    recoveries = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        acks       += stats[i].acks;
+        backoffs   += stats[i].backoffs;
+        recoveries += stats[i].recoveries;
+    }
+
+    acking      = 0;
+    backed_off  = 0;
+    interval_ms = 0;
+    budget      = 0;
+    loss_ppm    = 0;
+    srtt_us     = 0;
+    for(uint32_t i = 0; i < MAX_CLIENTS; i++)
+    {
+        if(!atomic_load_explicit(&active[i], memory_order_acquire) || !rates[i].acked)
+        {
+            continue;
+        }
+
+        acking++;
+        backed_off  += rates[i].interval_ticks > 1 || rates[i].budget < limits->tick_budget ? 1 : 0;
+        interval_ms += (double)rates[i].interval_ticks * (double)limits->tick_ns / (double)NANOSECONDS_PER_MILLISECOND;
+        budget      += (double)rates[i].budget;
+        loss_ppm    += (double)rates[i].loss_ppm;
+        srtt_us     += (double)rates[i].srtt_us;
+    }
+
+    printf("Send rate: %" PRIu64 " acks, %" PRIu64 " backoffs, %" PRIu64 " recoveries, %u of %u acking clients backed off", acks, backoffs, recoveries, backed_off, acking);
+    if(acking > 0)
+    {
+        printf(", mean %.1f ms between snapshots of %.0f bytes, %.1f%% lost, %.3f ms round trip", interval_ms / acking, budget / acking, loss_ppm / acking / (SEND_RATE_PPM / SEND_RATE_PERCENT), srtt_us / acking / MICROSECONDS_PER_MILLISECOND);
+    }
+    printf("\n");
+}
+
+void snapshot_acker_reset(struct snapshot_acker *acker)
+{
+    memset(acker, 0, sizeof(*acker));
+}
+
+// Takes a record off a snapshot datagram. Returns true if it was the record that opens one, which is then done with.
+bool snapshot_acker_read(const struct p101_env *env, struct snapshot_acker *acker, const struct packet_header *header, const struct coordinates *coordinates)
+{
+    P101_TRACE(env);
+
+    if(coordinates->new_x != SNAPSHOT_COORDINATE || coordinates->new_y != SNAPSHOT_COORDINATE)
+    {
+        return false;
+    }
+
+    if(!acker->started || (int32_t)(header->sequence - acker->newest) > 0)
+    {
+        acker->newest = header->sequence;
+    }
+
+    acker->received++;
+    acker->started = true;
+    acker->unacked = true;
+    return true;
+}
+
+// Acks go out right after the snapshot they name arrives, so the server's round trip has no wait of ours in it
+bool snapshot_acker_ack_due(const struct snapshot_acker *acker, int64_t now_us)
+{
+    return acker->unacked && now_us - acker->last_ack_us >= SNAPSHOT_ACK_INTERVAL_US;
+}
+
+void snapshot_acker_write_ack(const struct p101_env *env, struct snapshot_acker *acker, const struct packet_header *header, int64_t now_us, uint8_t *buffer)
+{
+    struct coordinates ack;
+
+    P101_TRACE(env);
+
+    ack.old_x = acker->newest;
+    ack.old_y = acker->received;
+    ack.new_x = ACK_COORDINATE;
+    ack.new_y = ACK_COORDINATE;
+    serialize_header_to_buffer(env, header, buffer);
+    serialize_position_to_buffer(env, &ack, buffer + PACKET_HEADER_SIZE);
+
+    acker->last_ack_us = now_us;
+    acker->unacked     = false;
+}
+
+bool is_ack(const struct coordinates *coordinates)
+{
+    return coordinates->new_x == ACK_COORDINATE && coordinates->new_y == ACK_COORDINATE;
+}
+
+// Moves the estimate a weight'th of the way to the sample, rounding away from the estimate so it always
+// gets there rather than stalling a few parts short once the step falls below one
+static int64_t smooth(int64_t estimate, int64_t sample, int64_t weight)
+{
+    int64_t step;
+
+    step = sample - estimate;
+    return estimate + (step >= 0 ? step + weight - 1 : step - weight + 1) / weight;
+}
+
+// A snapshot every interval_ticks gets half the bytes the ticks in between would have had, as far as a
+// full datagram. Fewer datagrams, each carrying more of what changed, and fewer bytes in all.
+static uint32_t spaced_budget(const struct send_rate_limits *limits, uint32_t interval_ticks)
+{
+    uint64_t budget;
+
+    budget = (uint64_t)limits->tick_budget * (interval_ticks + 1) / 2;
+    return budget > limits->max_budget ? limits->max_budget : (uint32_t)budget;
+}
+
+// Less often and fuller first. Once that is as far as it goes, smaller again, but never below what a tick gets.
+static void back_off(struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats)
+{
+    if(rate->interval_ticks < limits->max_interval_ticks)
+    {
+        rate->interval_ticks += (rate->interval_ticks + 1) / 2;
+        rate->interval_ticks = rate->interval_ticks > limits->max_interval_ticks ? limits->max_interval_ticks : rate->interval_ticks;
+        rate->budget         = spaced_budget(limits, rate->interval_ticks);
+    }
+    else if(rate->budget > limits->tick_budget)
+    {
+        rate->budget = rate->budget * 3 / 4 < limits->tick_budget ? limits->tick_budget : rate->budget * 3 / 4;
+    }
+    else
+    {
+        return;
+    }
+
+    stats->backoffs++;
+}
+
+// The other way round: size back first, then rate
+static void recover(struct send_rate *rate, const struct send_rate_limits *limits, struct send_rate_stats *stats)
+{
+    uint32_t spaced;
+
+    spaced = spaced_budget(limits, rate->interval_ticks);
+    if(rate->budget < spaced)
+    {
+        rate->budget += limits->max_budget / SEND_RATE_BUDGET_STEPS;
+        rate->budget = rate->budget > spaced ? spaced : rate->budget;
+    }
+    else if(rate->interval_ticks > 1)
+    {
+        rate->interval_ticks--;
+        rate->budget = spaced_budget(limits, rate->interval_ticks);
+    }
+    else
+    {
+        return;
+    }
+
+    stats->recoveries++;
+}
@@ -1,30 +1,33 @@
 #include "../include/convert.h"
-#include "../include/network.h"
+#include "../include/game_server.h"
+#include "../include/hot_restart.h"
 #include "../include/signal_handler.h"
+#include "../include/socket_options.h"
 #include <p101_c/p101_string.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #define UNKNOWN_OPTION_MESSAGE_LEN 24
-#define REQUIRED_ARGS_NUM 5
 
 static void           parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
 static void           check_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
 static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct context *context);
-static int            check_existing_client_address(const struct p101_env *env, struct client_info *clients, const char *ip_address);
-static void           add_client(const struct p101_env *env, struct client_info *clients, const char *ip_address, in_port_t port, struct coordinates *coordinates);
-static void           update_client(const struct p101_env *env, struct client_info *clients, struct coordinates *coordinates, int client_index);
-static void           broadcast_coordinates(const struct p101_env *env, struct p101_error *err, int sockfd, struct client_info *clients, const char *address, int client_index);
 
 int main(int argc, char *argv[])
 {
-    int                ret_val;
-    struct p101_error *error;
-    struct p101_env   *env;
-    struct arguments   arguments;
-    struct context     context;
-    struct client_info clients[MAX_CLIENTS] = {0};
+    int                   ret_val;
+    struct p101_error    *error;
+    struct p101_env      *env;
+    struct arguments      arguments;
+    struct context        context;
+    struct server_state  *server;
+    struct capture_writer capture;
+    struct checkpoint     checkpoint;
+    struct hot_restart    restart;
+    struct join_cookies   cookies;
+    bool                  inherited;
+    bool                  handing_over;
 
     error = p101_error_create(false);
 
@@ -56,71 +59,236 @@ int main(int argc, char *argv[])
         goto free_env;
     }
 
-    socket_create(env, error, &context.settings.sockfd, context.settings.src_addr.ss_family);
+    // A server already running on the restart path hands over its bound socket instead
+    hot_restart_init(env, &restart, context.arguments->restart_path);
+    inherited    = context.arguments->restart_path != NULL && hot_restart_inherit(env, error, &restart, &context.settings.sockfd);
+    handing_over = false;
     if(p101_error_has_error(error))
     {
         ret_val = EXIT_FAILURE;
-        goto free_env;
+        goto close_restart;
     }
 
-    socket_bind(env, error, context.settings.sockfd, context.settings.src_port, &context.settings.src_addr);
+    if(!inherited)
+    {
+        socket_create(env, error, &context.settings.sockfd, context.settings.src_addr.ss_family);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_restart;
+        }
+
+        socket_bind(env, error, context.settings.sockfd, context.settings.src_port, &context.settings.src_addr);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_socket;
+        }
+    }
+
+    socket_apply_options(env, error, context.settings.sockfd, context.settings.src_addr.ss_family, &context.settings.options);
     if(p101_error_has_error(error))
     {
         ret_val = EXIT_FAILURE;
         goto close_socket;
     }
 
+    // Applied to an inherited socket too, the old server may have run without a group
+    if(context.settings.group_addr_len != 0)
+    {
+        socket_set_group_source(env, error, context.settings.sockfd, &context.settings.src_addr);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_socket;
+        }
+    }
+
+    socket_enable_drop_counter(env, context.settings.sockfd);
+    socket_set_nonblocking(env, error, context.settings.sockfd);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto close_socket;
+    }
+
+    // Per-client tables make this megabytes, too much for the stack
+    server = (struct server_state *)malloc(sizeof(*server));
+    if(server == NULL)
+    {
+        P101_ERROR_RAISE_USER(error, "could not allocate the server state", EXIT_FAILURE);
+        ret_val = EXIT_FAILURE;
+        goto close_socket;
+    }
+
+    game_server_init(env, error, server, context.settings.workers, context.arguments->pipelined);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_server;
+    }
+    server->verbose         = true;
+    server->collisions      = context.arguments->collisions;
+    server->group_addr      = context.settings.group_addr;
+    server->group_addr_len  = context.settings.group_addr_len;
+    server->snapshot_budget = context.settings.snapshot_budget;
+    move_limiter_init(env, &server->limiter, context.settings.move_limit);
+    send_rate_limits_init(env, &server->rate_limits, context.settings.snapshot_interval, context.settings.snapshot_budget);
+
+    if(context.arguments->cookies)
+    {
+        join_cookies_init(env, error, &cookies);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto destroy_server;
+        }
+        server->cookies = &cookies;
+    }
+
+    if(context.arguments->cluster_str != NULL)
+    {
+        zone_cluster_init(env, error, &server->cluster, context.arguments->cluster_str, context.settings.zone);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto destroy_server;
+        }
+    }
+
+    if(context.arguments->capture_path != NULL)
+    {
+        capture_writer_open(env, error, &capture, context.arguments->capture_path);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto destroy_server;
+        }
+        server->capture = &capture;
+    }
+
+    if(context.arguments->checkpoint_path != NULL)
+    {
+        checkpoint_open(env, error, &checkpoint, context.arguments->checkpoint_path);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto close_capture;
+        }
+        server->checkpoint = &checkpoint;
+    }
+
+    // The predecessor's memory is newer than anything it wrote to the checkpoint
+    if(inherited)
+    {
+        receive_stats_adopt_socket(env, &server->stats);
+        game_server_adopt(env, server, restart.snapshot, restart.snapshot_length);
+    }
+    else if(server->checkpoint != NULL && checkpoint.restored)
+    {
+        game_server_restore(env, server);
+    }
+
+    io_backend_create(env, error, &server->backend, context.arguments->uring ? IO_BACKEND_URING : IO_BACKEND_SYSCALL, context.settings.sockfd, &server->pool, context.arguments->offload);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto close_checkpoint;
+    }
+
+    if(context.arguments->restart_path != NULL)
+    {
+        hot_restart_listen(env, error, &restart);
+        if(p101_error_has_error(error))
+        {
+            ret_val = EXIT_FAILURE;
+            goto destroy_backend;
+        }
+    }
+
     setup_signal_handler();
     while(!exit_flag)
     {
-        struct sockaddr_in client_addr;
-        char               client_ip[INET6_ADDRSTRLEN];
-        socklen_t          client_addr_len;
-        struct coordinates coordinates;
-        ssize_t            bytes_read;
-        uint8_t            buffer[sizeof(coordinates.old_x) + sizeof(coordinates.old_y) + sizeof(coordinates.new_x) + sizeof(coordinates.new_y)];
-        int                client_index;
-
-        client_addr_len = sizeof(client_addr);
-        memset(&client_addr, 0, sizeof(client_addr));
-
-        bytes_read = socket_read_full(env, context.settings.sockfd, buffer, sizeof(buffer), 0, (struct sockaddr *)&client_addr, client_addr_len);
-        if(bytes_read == -1)
+        if(context.arguments->restart_path != NULL && hot_restart_requested(env, &restart))
         {
+            handing_over = true;
             break;
         }
-        deserialize_position_from_buffer(env, &coordinates, buffer);
-        printf("Bytes read: %zd\nold X: %d\nold Y: %d\nnew x: %d\nnew y: %d\n", bytes_read, (int)coordinates.old_x, (int)coordinates.old_y, (int)coordinates.new_x, (int)coordinates.new_y);
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        printf("Client ip: %s\n", client_ip);
-        client_index = check_existing_client_address(env, clients, client_ip);
-        printf("client index: %d\n", client_index);
-        if(client_index == -1)
+
+        io_backend_wait(env, error, &server->backend, game_server_has_pending_sends(env, server), game_server_timeout_ms(env, server));
+        io_backend_receive(env, error, &server->backend, game_server_handle_datagram, server);
+        if(p101_error_has_error(error))
         {
-            add_client(env, clients, client_ip, client_addr.sin_port, &coordinates);
+            break;
         }
-        else
+
+        game_server_flush(env, server);
+    }
+
+    if(handing_over)
+    {
+        // Stop taking datagrams off the socket, whatever arrives from here on waits in the kernel for the successor
+        io_backend_quiesce(env, error, &server->backend, game_server_handle_datagram, server);
+        game_server_flush(env, server);
+    }
+
+    game_server_stop(env, server);
+
+    // The drain's sends belong in the counts below
+    if(handing_over)
+    {
+        game_server_drain(env, error, server);
+    }
+
+    game_server_print_stats(env, server, context.settings.options.timestamps);
+
+    if(handing_over)
+    {
+        uint8_t *snapshot;
+        size_t   length;
+
+        snapshot = game_server_snapshot(env, server, &length);
+        if(snapshot == NULL)
         {
-            update_client(env, clients, &coordinates, client_index);
-            // broadcast
-            broadcast_coordinates(env, error, context.settings.sockfd, clients, client_ip, client_index);
+            P101_ERROR_RAISE_USER(error, "could not snapshot the game state", EXIT_FAILURE);
         }
-
-        // Remove if exit coords
-        if((coordinates.new_x == EXIT_COORDINATE && coordinates.new_y == EXIT_COORDINATE) && client_index != 1)
+        else
         {
-            printf("Removed client address %s\n", clients[client_index].client_ip);
-            clients[client_index].client_ip[0] = '\0';
-            clients[client_index].client_port  = 0;
-            memset(&clients[client_index].coordinates, 0, sizeof(struct coordinates));
+            hot_restart_hand_over(env, error, &restart, context.settings.sockfd, snapshot, length);
+            free(snapshot);
         }
     }
 
-    ret_val = EXIT_SUCCESS;
+    ret_val = p101_error_has_error(error) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+destroy_backend:
+    // Stop the backend first, it may still hold references to queued packets
+    io_backend_destroy(env, &server->backend);
+
+close_checkpoint:
+    if(server->checkpoint != NULL)
+    {
+        checkpoint_close(env, server->checkpoint);
+    }
+
+close_capture:
+    if(server->capture != NULL)
+    {
+        capture_writer_close(env, server->capture);
+    }
+
+destroy_server:
+    game_server_destroy(env, server);
+
+free_server:
+    free(server);
 
 close_socket:
     socket_close(env, error, &context);
 
+close_restart:
+    hot_restart_close(env, &restart);
+
 free_env:
     free(context.exit_message);
     free(env);
@@ -147,7 +315,7 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
     context->arguments->program_name = context->arguments->argv[0];
     opterr                           = 0;
 
-    while((opt = getopt(context->arguments->argc, context->arguments->argv, "ha:p:")) != -1)
+    while((opt = getopt(context->arguments->argc, context->arguments->argv, "ha:p:r:s:b:d:c:K:H:w:Z:C:M:m:L:B:A:PJktzgu")) != -1)
     {
         switch(opt)
         {
@@ -161,6 +329,116 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
                 context->arguments->src_port_str = optarg;
                 break;
             }
+            case 'r':    // Receive buffer size argument
+            {
+                context->arguments->rcvbuf_str = optarg;
+                break;
+            }
+            case 's':    // Send buffer size argument
+            {
+                context->arguments->sndbuf_str = optarg;
+                break;
+            }
+            case 'b':    // Busy poll argument
+            {
+                context->arguments->busy_poll_str = optarg;
+                break;
+            }
+            case 'd':    // DSCP argument
+            {
+                context->arguments->dscp_str = optarg;
+                break;
+            }
+            case 'c':    // Capture file argument
+            {
+                context->arguments->capture_path = optarg;
+                break;
+            }
+            case 'K':    // Checkpoint file argument
+            {
+                context->arguments->checkpoint_path = optarg;
+                break;
+            }
+            case 'H':    // Hot restart socket argument
+            {
+                context->arguments->restart_path = optarg;
+                break;
+            }
+            case 'w':    // Room worker threads argument
+            {
+                context->arguments->workers_str = optarg;
+                break;
+            }
+            case 'Z':    // Zone number argument
+            {
+                context->arguments->zone_str = optarg;
+                break;
+            }
+            case 'C':    // Cluster nodes argument
+            {
+                context->arguments->cluster_str = optarg;
+                break;
+            }
+            case 'M':    // Multicast group address argument
+            {
+                context->arguments->group_ip_address = optarg;
+                break;
+            }
+            case 'm':    // Multicast group port argument
+            {
+                context->arguments->group_port_str = optarg;
+                break;
+            }
+            case 'L':    // Move limit argument
+            {
+                context->arguments->move_limit_str = optarg;
+                break;
+            }
+            case 'B':    // Snapshot budget argument
+            {
+                context->arguments->snapshot_budget_str = optarg;
+                break;
+            }
+            case 'A':    // Snapshot interval argument
+            {
+                context->arguments->snapshot_interval_str = optarg;
+                break;
+            }
+            case 'P':    // Send stage argument
+            {
+                context->arguments->pipelined = true;
+                break;
+            }
+            case 'J':    // Join cookies argument
+            {
+                context->arguments->cookies = true;
+                break;
+            }
+            case 'k':    // Collisions argument
+            {
+                context->arguments->collisions = true;
+                break;
+            }
+            case 't':    // Kernel receive timestamps argument
+            {
+                context->arguments->timestamps = true;
+                break;
+            }
+            case 'z':    // Zero copy argument
+            {
+                context->arguments->zerocopy = true;
+                break;
+            }
+            case 'g':    // UDP GSO/GRO argument
+            {
+                context->arguments->offload = true;
+                break;
+            }
+            case 'u':    // io_uring backend argument
+            {
+                context->arguments->uring = true;
+                break;
+            }
             case 'h':    // Help argument
             {
                 goto usage;
@@ -181,7 +459,7 @@ static void parse_arguments(struct p101_env *env, struct p101_error *err, struct
         }
     }
 
-    if(optind > REQUIRED_ARGS_NUM)
+    if(optind < context->arguments->argc)
     {
         context->exit_message = p101_strdup(env, err, "Too many arguments.");
         goto usage;
@@ -227,11 +505,33 @@ static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct
         fprintf(stderr, "%s\n", context->exit_message);
     }
 
-    fprintf(stderr, "Usage: %s [-h] -a <ip_address> -p <port>\n", context->arguments->program_name);
+    fprintf(stderr, "Usage: %s [-h] -a <ip_address> -p <port> [-r <bytes>] [-s <bytes>] [-b <usec>] [-d <dscp>] [-c <file>] [-K <file>] [-H <path>] [-w <threads>] [-P] [-Z <zone> -C <nodes>] [-M <group> -m <port>] [-L <moves>] [-B <bytes> [-A <ms>]] [-J] [-k] [-t] [-z] [-g] [-u]\n", context->arguments->program_name);
     fputs("Options:\n", stderr);
     fputs("  -h Display this help message\n", stderr);
     fputs("  -a <ip_address>  Option 'a' (required) with an IP Address.\n", stderr);
     fputs("  -p <port>        Option 'p' (required) with a port.\n", stderr);
+    fputs("  -r <bytes>       Option 'r' (optional) socket receive buffer size.\n", stderr);
+    fputs("  -s <bytes>       Option 's' (optional) socket send buffer size.\n", stderr);
+    fputs("  -b <usec>        Option 'b' (optional) busy poll timeout in microseconds.\n", stderr);
+    fputs("  -d <dscp>        Option 'd' (optional) DSCP code point for outgoing packets.\n", stderr);
+    fputs("  -c <file>        Option 'c' (optional) record every inbound datagram to a capture file for replay.\n", stderr);
+    fputs("  -K <file>        Option 'K' (optional) keep the client registry in a mapped checkpoint file and restore it on start.\n", stderr);
+    fputs("  -H <path>        Option 'H' (optional) take the socket and players over from a server listening on this unix socket, then listen there for the next one.\n", stderr);
+    fputs("  -w <threads>     Option 'w' (optional) number of room worker threads, 0 simulates rooms on the network thread.\n", stderr);
+    fputs("  -P               Option 'P' (optional) give every room worker its own sender thread, so slow sends never hold up simulation.\n", stderr);
+    fputs("  -Z <zone>        Option 'Z' (optional) zone this server owns, counted from 0, defaults to 0.\n", stderr);
+    fputs("  -C <nodes>       Option 'C' (optional) ip:port of every zone server in zone order, comma separated, this server included.\n", stderr);
+    fputs("  -M <group>       Option 'M' (optional) IPv4 multicast group that every move is also sent to once, for spectators.\n", stderr);
+    fputs("  -m <port>        Option 'm' (optional) port of the multicast group, required with -M.\n", stderr);
+    fputs("  -L <moves>       Option 'L' (optional) moves per second each client may make, faster moves are merged, 0 or unset is unlimited.\n", stderr);
+    fputs("  -B <bytes>       Option 'B' (optional) bytes of updates each client is sent per tick, nearest players first, 0 or unset sends every move at once.\n", stderr);
+    fputs("  -A <ms>          Option 'A' (optional) adapt each client's snapshots to its measured loss and round trip, never further apart than this, needs -B.\n", stderr);
+    fputs("  -J               Option 'J' (optional) make new clients echo a join cookie before they get a slot, sheds spoofed sources.\n", stderr);
+    fputs("  -k               Option 'k' (optional) refuse moves onto a cell another player in the same room stands on.\n", stderr);
+    fputs("  -t               Option 't' (optional) enable kernel receive timestamps and report latency.\n", stderr);
+    fputs("  -z               Option 'z' (optional) enable SO_ZEROCOPY on the socket.\n", stderr);
+    fputs("  -g               Option 'g' (optional) use UDP GSO/GRO when the kernel supports it.\n", stderr);
+    fputs("  -u               Option 'u' (optional) use the io_uring network backend, falls back to syscalls if unavailable.\n", stderr);
 
     free(context->exit_message);
     free(env);
@@ -241,73 +541,3 @@ static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct
     printf("Exit code: %d\n", context->exit_code);
     exit(context->exit_code);
 }
-
-static int check_existing_client_address(const struct p101_env *env, struct client_info *clients, const char *ip_address)    // cppcheck-suppress constParameterPointer
-{
-    P101_TRACE(env);
-
-    for(int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if(strcmp(clients[i].client_ip, ip_address) == 0)
-        {
-            return i;
-        }
-    }
-
-    return -1;
-}
-
-static void add_client(const struct p101_env *env, struct client_info *clients, const char *ip_address, in_port_t port, struct coordinates *coordinates)    // cppcheck-suppress constParameterPointer
-{
-    P101_TRACE(env);
-
-    for(int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if(clients[i].client_ip[0] == '\0')
-        {
-            strncpy(clients[i].client_ip, ip_address, INET6_ADDRSTRLEN);
-            clients[i].client_ip[INET6_ADDRSTRLEN - 1] = '\0';
-            clients[i].client_port                     = htons(port);
-            clients[i].coordinates                     = *coordinates;
-            break;
-        }
-    }
-}
-
-static void update_client(const struct p101_env *env, struct client_info *clients, struct coordinates *coordinates, int client_index)    // cppcheck-suppress constParameterPointer
-{
-    P101_TRACE(env);
-
-    clients[client_index].coordinates = *coordinates;
-}
-
-static void broadcast_coordinates(const struct p101_env *env, struct p101_error *err, int sockfd, struct client_info *clients, const char *address, int client_index)    // cppcheck-suppress constParameterPointer
-{
-    struct coordinates      coordinates;
-    uint8_t                 buffer[sizeof(coordinates.old_x) + sizeof(coordinates.old_y) + sizeof(coordinates.new_x) + sizeof(coordinates.new_y)];
-    struct sockaddr_storage addr;
-    socklen_t               addr_len;
-    ssize_t                 bytes_written;
-
-    P101_TRACE(env);
-
-    for(int i = 0; i < MAX_CLIENTS; i++)
-    {
-        if(clients[i].client_ip[0] != '\0')
-        {
-            printf("%s %s\n", address, clients[i].client_ip);
-            // Skip if the received address is the index address
-            if(strcmp(address, clients[i].client_ip) == 0)
-            {
-                continue;
-            }
-
-            convert_address(env, err, clients[i].client_ip, &addr, &addr_len);
-            get_address_to_server(env, err, &addr, clients[i].client_port);
-
-            serialize_position_to_buffer(env, &clients[client_index].coordinates, buffer);
-            bytes_written = socket_write_full(env, sockfd, buffer, sizeof(buffer), (struct sockaddr *)&addr, addr_len);
-            printf("%zd bytes sent to client %s\n", bytes_written, clients[i].client_ip);
-        }
-    }
-}
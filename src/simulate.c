@@ -0,0 +1,562 @@
+#include "../include/game_server.h"
+#include "../include/memory_transport.h"
+#include "../include/signal_handler.h"
+#include <p101_c/p101_string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define UNKNOWN_OPTION_MESSAGE_LEN 24
+#define DEFAULT_CLIENTS 256
+#define DEFAULT_DURATION_SECONDS 10
+#define DEFAULT_MOVE_RATE 20              // Moves per second per client
+#define DEFAULT_LATENCY_MS 30             // One way
+#define MAX_MOVE_RATE 1000
+#define PERCENT_PPM 10000                 // Parts per million in one percent
+#define SIMULATION_SPREAD_CELLS 64        // Clients start in a square this wide, so a room's members see each other
+#define SIMULATION_ADDRESS 0x0A000000U    // 10.0.0.0, each client gets the next address
+#define SIMULATION_PORT 4000
+#define DIRECTIONS 4
+
+struct simulation_config
+{
+    uint32_t           clients;
+    int64_t            duration_ns;
+    int64_t            move_interval_ns;    // Between two moves of one client
+    struct memory_link link;
+    uint64_t           seed;
+};
+
+struct simulated_client
+{
+    struct sockaddr_in    addr;
+    struct packet_header  header;
+    struct coordinates    coordinates;
+    struct snapshot_acker acker;
+};
+
+// The clients' side of the run. Moves go out round robin, evenly spread over each move interval, and
+// snapshots are acked as the real client acks them.
+struct simulation
+{
+    struct simulated_client  clients[MAX_CLIENTS];
+    struct memory_transport *transport;
+    uint32_t                 count;
+    int64_t                  start_ns;
+    int64_t                  move_interval_ns;
+    uint64_t                 moves;        // Sent, joins included
+    uint64_t                 datagrams;    // Received
+    uint64_t                 updates;      // Snapshots' sequence records not counted
+    uint64_t                 bytes;
+};
+
+static void           parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context);
+static void           convert_arguments(struct p101_env *env, struct p101_error *err, struct context *context, struct simulation_config *config);
+static int            convert_option(struct p101_env *env, struct p101_error *err, const char *value_str, int max, int fallback);
+static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct context *context);
+static void           simulation_start(const struct p101_env *env, struct simulation *simulation, struct memory_transport *transport, uint32_t count, int64_t move_interval_ns);
+static int64_t        simulation_next_move_ns(const struct simulation *simulation);
+static void           simulation_move(const struct p101_env *env, struct simulation *simulation, struct memory_transport *transport);
+static void           simulation_receive(const struct p101_env *env, void *arg, const struct sockaddr_in *addr, const uint8_t *data, size_t length);
+static int64_t        server_deadline_ns(const struct p101_env *env, const struct server_state *server, int64_t now_ns);
+static void           print_simulation_report(const struct p101_env *env, const struct simulation *simulation, int64_t virtual_ns, int64_t elapsed_ns);
+
+int main(int argc, char *argv[])
+{
+    int                      ret_val;
+    struct p101_error       *error;
+    struct p101_env         *env;
+    struct arguments         arguments;
+    struct context           context;
+    struct simulation_config config;
+    struct server_state     *server;
+    struct memory_transport  transport;
+    struct simulation        simulation;
+    struct timespec          start;
+    struct timespec          end;
+    int64_t                  end_ns;
+    int64_t                  first_ns;
+
+    error = p101_error_create(false);
+
+    if(error == NULL)
+    {
+        ret_val = EXIT_FAILURE;
+        goto done;
+    }
+
+    env = p101_env_create(error, true, NULL);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_error;
+    }
+
+    p101_memset(env, &arguments, 0, sizeof(arguments));    // Set memory of arguments to 0
+    p101_memset(env, &context, 0, sizeof(context));        // Set memory of context to 0
+    context.arguments       = &arguments;
+    context.arguments->argc = argc;
+    context.arguments->argv = argv;
+
+    parse_arguments(env, error, &context);
+    convert_arguments(env, error, &context, &config);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    memory_transport_create(env, error, &transport, &config.link, config.seed);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_env;
+    }
+
+    // Per-client tables make this megabytes, too much for the stack
+    server = (struct server_state *)malloc(sizeof(*server));
+    if(server == NULL)
+    {
+        P101_ERROR_RAISE_USER(error, "could not allocate the server state", EXIT_FAILURE);
+        ret_val = EXIT_FAILURE;
+        goto destroy_transport;
+    }
+
+    game_server_init(env, error, server, 0, false);
+    if(p101_error_has_error(error))
+    {
+        ret_val = EXIT_FAILURE;
+        goto free_server;
+    }
+
+    // The game logic runs unchanged on one thread, the socket and the clock under it are simulated
+    memory_transport_attach(env, &transport, &server->backend, &server->pool);
+    monotonic_clock_use(&transport.now_ns);
+    server->verbose         = false;
+    server->collisions      = context.arguments->collisions;
+    server->snapshot_budget = context.settings.snapshot_budget;
+    move_limiter_init(env, &server->limiter, context.settings.move_limit);
+    send_rate_limits_init(env, &server->rate_limits, context.settings.snapshot_interval, context.settings.snapshot_budget);
+    simulation_start(env, &simulation, &transport, config.clients, config.move_interval_ns);
+    end_ns   = transport.now_ns + config.duration_ns;
+    first_ns = transport.now_ns;
+
+    setup_signal_handler();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while(!exit_flag && transport.now_ns < end_ns)
+    {
+        int64_t next_ns;
+        int64_t deadline_ns;
+
+        // Jump straight to whatever happens next, a client's move, a datagram landing or a server deadline
+        deadline_ns = server_deadline_ns(env, server, transport.now_ns);
+        next_ns     = simulation_next_move_ns(&simulation);
+        if(memory_transport_next_ns(&transport) < next_ns)
+        {
+            next_ns = memory_transport_next_ns(&transport);
+        }
+
+        if(deadline_ns < next_ns)
+        {
+            next_ns = deadline_ns;
+        }
+
+        memory_transport_advance(env, &transport, next_ns < end_ns ? next_ns : end_ns, simulation_receive, &simulation);
+        while(simulation_next_move_ns(&simulation) <= transport.now_ns)
+        {
+            simulation_move(env, &simulation, &transport);
+        }
+
+        // The server only runs when the network thread would have woken up, not for every datagram a client gets.
+        // Sends never block on the memory link, so there are none pending to wait on.
+        io_backend_wait(env, error, &server->backend, false, 0);
+        if(!server->backend.readable && transport.now_ns < deadline_ns)
+        {
+            continue;
+        }
+
+        io_backend_receive(env, error, &server->backend, game_server_handle_datagram, server);
+        if(p101_error_has_error(error))
+        {
+            break;
+        }
+
+        game_server_flush(env, server);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    monotonic_clock_use(NULL);
+
+    print_simulation_report(env, &simulation, transport.now_ns - first_ns, timespec_diff_ns(&end, &start));
+    memory_transport_print_stats(env, &transport);
+    game_server_print_stats(env, server, false);
+    ret_val = p101_error_has_error(error) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    game_server_destroy(env, server);
+
+free_server:
+    free(server);
+
+destroy_transport:
+    memory_transport_destroy(env, &transport);
+
+free_env:
+    free(context.exit_message);
+    free(env);
+
+free_error:
+    if(p101_error_has_error(error))
+    {
+        fprintf(stderr, "Error: %s\n", p101_error_get_message(error));
+    }
+    p101_error_reset(error);
+    free(error);
+
+done:
+    printf("Exit code: %d\n", ret_val);
+    return ret_val;
+}
+
+static void parse_arguments(struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    int opt;
+
+    P101_TRACE(env);
+
+    context->arguments->program_name = context->arguments->argv[0];
+    opterr                           = 0;
+
+    while((opt = getopt(context->arguments->argc, context->arguments->argv, "hn:t:r:l:j:d:o:s:B:A:L:g")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n':    // Client count argument
+            {
+                context->arguments->clients_str = optarg;
+                break;
+            }
+            case 't':    // Duration argument
+            {
+                context->arguments->duration_str = optarg;
+                break;
+            }
+            case 'r':    // Move rate argument
+            {
+                context->arguments->move_rate_str = optarg;
+                break;
+            }
+            case 'l':    // Latency argument
+            {
+                context->arguments->latency_str = optarg;
+                break;
+            }
+            case 'j':    // Jitter argument
+            {
+                context->arguments->jitter_str = optarg;
+                break;
+            }
+            case 'd':    // Loss argument
+            {
+                context->arguments->loss_str = optarg;
+                break;
+            }
+            case 'o':    // Reordering argument
+            {
+                context->arguments->reorder_str = optarg;
+                break;
+            }
+            case 's':    // Seed argument
+            {
+                context->arguments->seed_str = optarg;
+                break;
+            }
+            case 'B':    // Snapshot budget argument
+            {
+                context->arguments->snapshot_budget_str = optarg;
+                break;
+            }
+            case 'A':    // Snapshot interval argument
+            {
+                context->arguments->snapshot_interval_str = optarg;
+                break;
+            }
+            case 'L':    // Move limit argument
+            {
+                context->arguments->move_limit_str = optarg;
+                break;
+            }
+            case 'g':    // Collision argument
+            {
+                context->arguments->collisions = true;
+                break;
+            }
+            case 'h':    // Help argument
+            {
+                goto usage;
+            }
+            case '?':
+            {
+                char message[UNKNOWN_OPTION_MESSAGE_LEN];
+
+                snprintf(message, sizeof(message), "Unknown option '-%c'.", optopt);
+                context->exit_message = p101_strdup(env, err, message);
+                goto usage;
+            }
+            default:
+            {
+                context->exit_message = p101_strdup(env, err, "Unknown error with getopt.");
+                goto usage;
+            }
+        }
+    }
+
+    if(optind < context->arguments->argc)
+    {
+        context->exit_message = p101_strdup(env, err, "Too many arguments.");
+        goto usage;
+    }
+
+    return;
+
+usage:
+    usage(env, err, context);
+}
+
+static void convert_arguments(struct p101_env *env, struct p101_error *err, struct context *context, struct simulation_config *config)
+{
+    int rate;
+
+    P101_TRACE(env);
+
+    if(p101_error_has_error(err))
+    {
+        return;
+    }
+
+    memset(config, 0, sizeof(*config));
+    config->clients                   = (uint32_t)convert_option(env, err, context->arguments->clients_str, MAX_CLIENTS, DEFAULT_CLIENTS);
+    config->duration_ns               = convert_option(env, err, context->arguments->duration_str, INT_MAX, DEFAULT_DURATION_SECONDS) * NANOSECONDS_PER_SECOND;
+    rate                              = convert_option(env, err, context->arguments->move_rate_str, MAX_MOVE_RATE, DEFAULT_MOVE_RATE);
+    config->link.latency_ns           = (int64_t)convert_option(env, err, context->arguments->latency_str, INT_MAX, DEFAULT_LATENCY_MS) * NANOSECONDS_PER_MILLISECOND;
+    config->link.jitter_ns            = (int64_t)convert_option(env, err, context->arguments->jitter_str, INT_MAX, 0) * NANOSECONDS_PER_MILLISECOND;
+    config->link.loss_ppm             = (uint32_t)convert_option(env, err, context->arguments->loss_str, PARTS_PER_MILLION / PERCENT_PPM, 0) * PERCENT_PPM;
+    config->link.reorder_ppm          = (uint32_t)convert_option(env, err, context->arguments->reorder_str, PARTS_PER_MILLION / PERCENT_PPM, 0) * PERCENT_PPM;
+    config->seed                      = (uint64_t)convert_option(env, err, context->arguments->seed_str, INT_MAX, 1);
+    context->settings.move_limit        = (uint32_t)convert_option(env, err, context->arguments->move_limit_str, INT_MAX, 0);
+    context->settings.snapshot_budget   = (uint32_t)convert_option(env, err, context->arguments->snapshot_budget_str, INT_MAX, 0);
+    context->settings.snapshot_interval = (uint32_t)convert_option(env, err, context->arguments->snapshot_interval_str, INT_MAX, 0);
+    if(p101_error_has_error(err))
+    {
+        return;
+    }
+
+    if(config->clients == 0 || rate == 0)
+    {
+        context->exit_message = p101_strdup(env, err, "<clients> and <rate> must be at least 1.");
+        usage(env, err, context);
+    }
+
+    if(context->settings.snapshot_interval != 0 && context->settings.snapshot_budget == 0)
+    {
+        context->exit_message = p101_strdup(env, err, "-A needs a snapshot budget, pass -B.");
+        usage(env, err, context);
+    }
+
+    config->move_interval_ns = NANOSECONDS_PER_SECOND / rate;
+}
+
+// An option left out takes its default
+static int convert_option(struct p101_env *env, struct p101_error *err, const char *value_str, int max, int fallback)
+{
+    P101_TRACE(env);
+
+    if(value_str == NULL || p101_error_has_error(err))
+    {
+        return fallback;
+    }
+
+    return parse_int_option(env, err, value_str, max);
+}
+
+static _Noreturn void usage(struct p101_env *env, struct p101_error *err, struct context *context)
+{
+    P101_TRACE(env);
+
+    context->exit_code = EXIT_FAILURE;
+
+    if(context->exit_message != NULL)
+    {
+        fprintf(stderr, "%s\n", context->exit_message);
+    }
+
+    fprintf(stderr, "Usage: %s [-h] [-n <clients>] [-t <seconds>] [-r <moves>] [-l <ms>] [-j <ms>] [-d <percent>] [-o <percent>] [-s <seed>] [-B <bytes> [-A <ms>]] [-L <moves>] [-g]\n", context->arguments->program_name);
+    fputs("Options:\n", stderr);
+    fputs("  -h Display this help message\n", stderr);
+    fputs("  -n <clients>     Option 'n' (optional) simulated clients, 16 to a room, 256 if unset.\n", stderr);
+    fputs("  -t <seconds>     Option 't' (optional) virtual time to simulate, 10 if unset.\n", stderr);
+    fputs("  -r <moves>       Option 'r' (optional) moves per second each client makes, 20 if unset.\n", stderr);
+    fputs("  -l <ms>          Option 'l' (optional) one way latency of the simulated link, 30 if unset.\n", stderr);
+    fputs("  -j <ms>          Option 'j' (optional) up to this much extra latency per datagram, 0 if unset.\n", stderr);
+    fputs("  -d <percent>     Option 'd' (optional) datagrams lost each way, 0 if unset.\n", stderr);
+    fputs("  -o <percent>     Option 'o' (optional) datagrams held back so later ones overtake them, 0 if unset.\n", stderr);
+    fputs("  -s <seed>        Option 's' (optional) seed for the link and the clients' moves, the same seed gives the same run.\n", stderr);
+    fputs("  -B <bytes>       Option 'B' (optional) bytes of updates each client is sent per tick, as for the server.\n", stderr);
+    fputs("  -A <ms>          Option 'A' (optional) adapt each client's snapshots to its loss and round trip, as for the server.\n", stderr);
+    fputs("  -L <moves>       Option 'L' (optional) moves per second each client may make, as for the server.\n", stderr);
+    fputs("  -g               Option 'g' (optional) block moves into occupied cells, as for the server.\n", stderr);
+
+    free(context->exit_message);
+    free(env);
+    p101_error_reset(err);
+    free(err);
+
+    printf("Exit code: %d\n", context->exit_code);
+    exit(context->exit_code);
+}
+
+static void simulation_start(const struct p101_env *env, struct simulation *simulation, struct memory_transport *transport, uint32_t count, int64_t move_interval_ns)
+{
+    P101_TRACE(env);
+
+    memset(simulation, 0, sizeof(*simulation));
+    simulation->transport        = transport;
+    simulation->count            = count;
+    simulation->start_ns         = transport->now_ns;
+    simulation->move_interval_ns = move_interval_ns;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        struct simulated_client *client;
+        uint32_t                 x;
+        uint32_t                 y;
+
+        client                       = &simulation->clients[i];
+        client->addr.sin_family      = AF_INET;
+        client->addr.sin_addr.s_addr = htonl(SIMULATION_ADDRESS + i + 1);
+        client->addr.sin_port        = htons(SIMULATION_PORT);
+        client->header.room          = i / ROOM_CAPACITY;
+        x                            = 1 + (uint32_t)(memory_transport_random(transport) % SIMULATION_SPREAD_CELLS);
+        y                            = 1 + (uint32_t)(memory_transport_random(transport) % SIMULATION_SPREAD_CELLS);
+        client->coordinates.old_x    = x;
+        client->coordinates.old_y    = y;
+        client->coordinates.new_x    = x;
+        client->coordinates.new_y    = y;
+        snapshot_acker_reset(&client->acker);
+    }
+}
+
+// Move k is client k % count's, a fraction of the interval after the one before it
+static int64_t simulation_next_move_ns(const struct simulation *simulation)
+{
+    uint64_t round;
+    uint64_t client;
+
+    round  = simulation->moves / simulation->count;
+    client = simulation->moves % simulation->count;
+    return simulation->start_ns + ((int64_t)round * simulation->move_interval_ns) + ((int64_t)client * simulation->move_interval_ns / simulation->count);
+}
+
+// A client's first datagram joins it where it stands, after that it takes a step in a random direction
+static void simulation_move(const struct p101_env *env, struct simulation *simulation, struct memory_transport *transport)
+{
+    struct simulated_client *client;
+    uint8_t                  buffer[POSITION_PACKET_SIZE];
+
+    P101_TRACE(env);
+
+    client = &simulation->clients[simulation->moves % simulation->count];
+    if(simulation->moves >= simulation->count)
+    {
+        client->coordinates.old_x = client->coordinates.new_x;
+        client->coordinates.old_y = client->coordinates.new_y;
+        switch(memory_transport_random(transport) % DIRECTIONS)
+        {
+            case 0:
+                client->coordinates.new_y -= client->coordinates.new_y > 1 ? 1 : 0;
+                break;
+            case 1:
+                client->coordinates.new_y += client->coordinates.new_y < WORLD_ROWS - 2 ? 1 : 0;
+                break;
+            case 2:
+                client->coordinates.new_x -= client->coordinates.new_x > 1 ? 1 : 0;
+                break;
+            default:
+                client->coordinates.new_x += client->coordinates.new_x < WORLD_COLUMNS - 2 ? 1 : 0;
+                break;
+        }
+    }
+
+    client->header.sequence++;
+    serialize_header_to_buffer(env, &client->header, buffer);
+    serialize_position_to_buffer(env, &client->coordinates, buffer + PACKET_HEADER_SIZE);
+    memory_transport_send(env, transport, &client->addr, buffer, sizeof(buffer));
+    simulation->moves++;
+}
+
+// Counts what arrived and acks the snapshots in it, the client is told apart by its address
+static void simulation_receive(const struct p101_env *env, void *arg, const struct sockaddr_in *addr, const uint8_t *data, size_t length)
+{
+    struct simulation       *simulation;
+    struct simulated_client *client;
+    int64_t                  now_us;
+
+    P101_TRACE(env);
+
+    simulation = (struct simulation *)arg;
+    client     = &simulation->clients[ntohl(addr->sin_addr.s_addr) - SIMULATION_ADDRESS - 1];
+    simulation->datagrams++;
+    simulation->bytes += length;
+    for(size_t offset = 0; offset + POSITION_PACKET_SIZE <= length; offset += POSITION_PACKET_SIZE)
+    {
+        struct packet_header header;
+        struct coordinates   coordinates;
+
+        deserialize_header_from_buffer(env, &header, data + offset);
+        deserialize_position_from_buffer(env, &coordinates, data + offset + PACKET_HEADER_SIZE);
+        if(!snapshot_acker_read(env, &client->acker, &header, &coordinates))
+        {
+            simulation->updates++;
+        }
+    }
+
+    now_us = simulation->transport->now_ns / NANOSECONDS_PER_MICROSECOND;
+    if(snapshot_acker_ack_due(&client->acker, now_us))
+    {
+        uint8_t buffer[POSITION_PACKET_SIZE];
+
+        client->header.sequence++;
+        snapshot_acker_write_ack(env, &client->acker, &client->header, now_us, buffer);
+        memory_transport_send(env, simulation->transport, &client->addr, buffer, sizeof(buffer));
+    }
+}
+
+// When the server wants to run again with no datagram to wake it, as the network thread's poll timeout would
+static int64_t server_deadline_ns(const struct p101_env *env, const struct server_state *server, int64_t now_ns)
+{
+    int timeout_ms;
+
+    P101_TRACE(env);
+
+    timeout_ms = game_server_timeout_ms(env, server);
+    if(timeout_ms == IO_WAIT_FOREVER)
+    {
+        return MEMORY_TRANSPORT_NONE;
+    }
+
+    // A deadline already due still has to move the clock, or the loop would spin without time passing
+    return now_ns + (timeout_ms > 0 ? (int64_t)timeout_ms * NANOSECONDS_PER_MILLISECOND : 1);
+}
+
+static void print_simulation_report(const struct p101_env *env, const struct simulation *simulation, int64_t virtual_ns, int64_t elapsed_ns)
+{
+    double elapsed_seconds;
+
+    P101_TRACE(env);
+
+    elapsed_seconds = (double)elapsed_ns / (double)NANOSECONDS_PER_SECOND;
+
+    printf("Simulated %u clients for %.3f s of virtual time in %.3f s\n", simulation->count, (double)virtual_ns / (double)NANOSECONDS_PER_SECOND, elapsed_seconds);
+    if(elapsed_seconds > 0)
+    {
+        printf("Throughput: %.0f moves/s in, %.0f updates/s out\n", (double)simulation->moves / elapsed_seconds, (double)simulation->updates / elapsed_seconds);
+    }
+    printf("Clients sent %" PRIu64 " moves and received %" PRIu64 " datagrams carrying %" PRIu64 " updates (%" PRIu64 " bytes)\n", simulation->moves, simulation->datagrams, simulation->updates, simulation->bytes);
+}
@@ -0,0 +1,109 @@
+#include "../include/socket_options.h"
+
+static void set_int_option(int sockfd, int level, int name, int value, const char *label);
+static void report_buffer_size(int sockfd, int name, const char *label);
+
+void socket_apply_options(const struct p101_env *env, struct p101_error *err, int sockfd, int domain, const struct socket_options *options)
+{
+    P101_TRACE(env);
+
+    // Buffer sizes are what the drop counters get tuned against, so failing to set them is fatal
+    if(options->rcvbuf > 0)
+    {
+        if(setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &options->rcvbuf, sizeof(options->rcvbuf)) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "setsockopt SO_RCVBUF failed", EXIT_FAILURE);
+            goto done;
+        }
+        report_buffer_size(sockfd, SO_RCVBUF, "SO_RCVBUF");
+    }
+
+    if(options->sndbuf > 0)
+    {
+        if(setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, &options->sndbuf, sizeof(options->sndbuf)) == -1)
+        {
+            P101_ERROR_RAISE_USER(err, "setsockopt SO_SNDBUF failed", EXIT_FAILURE);
+            goto done;
+        }
+        report_buffer_size(sockfd, SO_SNDBUF, "SO_SNDBUF");
+    }
+
+    // The remaining options depend on kernel support and privileges, so they only warn when unavailable
+    if(options->busy_poll > 0)
+    {
+#ifdef SO_BUSY_POLL
+        set_int_option(sockfd, SOL_SOCKET, SO_BUSY_POLL, options->busy_poll, "SO_BUSY_POLL");
+#else
+        fputs("SO_BUSY_POLL is not supported on this platform\n", stderr);
+#endif
+    }
+
+    if(options->timestamps)
+    {
+#ifdef SO_TIMESTAMPNS
+        set_int_option(sockfd, SOL_SOCKET, SO_TIMESTAMPNS, 1, "SO_TIMESTAMPNS");
+#else
+        fputs("SO_TIMESTAMPNS is not supported on this platform\n", stderr);
+#endif
+    }
+
+    if(options->dscp >= 0)
+    {
+        if(domain == AF_INET6)
+        {
+            set_int_option(sockfd, IPPROTO_IPV6, IPV6_TCLASS, options->dscp << DSCP_SHIFT, "IPV6_TCLASS");
+        }
+        else
+        {
+            set_int_option(sockfd, IPPROTO_IP, IP_TOS, options->dscp << DSCP_SHIFT, "IP_TOS");
+        }
+    }
+
+    if(options->zerocopy)
+    {
+#ifdef SO_ZEROCOPY
+        set_int_option(sockfd, SOL_SOCKET, SO_ZEROCOPY, 1, "SO_ZEROCOPY");
+#else
+        fputs("SO_ZEROCOPY is not supported on this platform\n", stderr);
+#endif
+    }
+
+done:
+    return;
+}
+
+void socket_enable_drop_counter(const struct p101_env *env, int sockfd)
+{
+    P101_TRACE(env);
+
+#ifdef SO_RXQ_OVFL
+    set_int_option(sockfd, SOL_SOCKET, SO_RXQ_OVFL, 1, "SO_RXQ_OVFL");
+#else
+    (void)sockfd;
+    fputs("SO_RXQ_OVFL is not supported on this platform, kernel drops will not be reported\n", stderr);
+#endif
+}
+
+static void set_int_option(int sockfd, int level, int name, int value, const char *label)
+{
+    if(setsockopt(sockfd, level, name, &value, sizeof(value)) == -1)
+    {
+        fprintf(stderr, "setsockopt %s failed: %s\n", label, strerror(errno));
+        return;
+    }
+
+    printf("%s set to %d\n", label, value);
+}
+
+static void report_buffer_size(int sockfd, int name, const char *label)
+{
+    int       actual;
+    socklen_t len;
+
+    // Linux doubles the requested size and clamps it to net.core.{r,w}mem_max, so show what was granted
+    len = sizeof(actual);
+    if(getsockopt(sockfd, SOL_SOCKET, name, &actual, &len) == 0)
+    {
+        printf("%s is %d bytes\n", label, actual);
+    }
+}
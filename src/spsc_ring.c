@@ -0,0 +1,126 @@
+#include "../include/spsc_ring.h"
+
+static void copy_in(struct spsc_ring *ring, uint32_t index, const uint8_t *elements, uint32_t count);
+static void copy_out(const struct spsc_ring *ring, uint32_t index, uint8_t *elements, uint32_t count);
+
+void spsc_ring_create(const struct p101_env *env, struct p101_error *err, struct spsc_ring *ring, uint32_t capacity, size_t element_size)
+{
+    P101_TRACE(env);
+
+    memset(ring, 0, sizeof(*ring));
+
+    // Indices wrap with a mask, so the capacity has to be a power of two
+    if(capacity == 0 || (capacity & (capacity - 1)) != 0)
+    {
+        P101_ERROR_RAISE_USER(err, "ring capacity must be a power of two", EXIT_FAILURE);
+        goto done;
+    }
+
+    ring->slots = (uint8_t *)calloc(capacity, element_size);
+    if(ring->slots == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "ring allocation failed", EXIT_FAILURE);
+        goto done;
+    }
+
+    ring->element_size = element_size;
+    ring->mask         = capacity - 1;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+done:
+    return;
+}
+
+void spsc_ring_destroy(const struct p101_env *env, struct spsc_ring *ring)
+{
+    P101_TRACE(env);
+
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+// Pushes as many of count elements as fit and publishes them with a single store, so the consumer
+// sees the whole batch at once and the shared tail line moves once per batch rather than per element.
+// Returns how many were pushed.
+uint32_t spsc_ring_push_batch(const struct p101_env *env, struct spsc_ring *ring, const void *elements, uint32_t count)
+{
+    uint32_t tail;
+    uint32_t space;
+
+    P101_TRACE(env);
+
+    tail  = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    space = ring->mask + 1 - (tail - ring->cached_head);
+    if(space < count)
+    {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        space             = ring->mask + 1 - (tail - ring->cached_head);
+    }
+
+    count = count < space ? count : space;
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    copy_in(ring, tail, (const uint8_t *)elements, count);
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+
+    return count;
+}
+
+// Pops up to max elements and frees their slots with a single store. Returns how many were popped.
+uint32_t spsc_ring_pop_batch(const struct p101_env *env, struct spsc_ring *ring, void *elements, uint32_t max)
+{
+    uint32_t head;
+    uint32_t available;
+
+    P101_TRACE(env);
+
+    head      = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    available = ring->cached_tail - head;
+    if(available < max)
+    {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        available         = ring->cached_tail - head;
+    }
+
+    max = max < available ? max : available;
+    if(max == 0)
+    {
+        return 0;
+    }
+
+    copy_out(ring, head, (uint8_t *)elements, max);
+    atomic_store_explicit(&ring->head, head + max, memory_order_release);
+
+    return max;
+}
+
+// At most two copies, one up to the end of the slot array and one from its start
+static void copy_in(struct spsc_ring *ring, uint32_t index, const uint8_t *elements, uint32_t count)
+{
+    uint32_t offset;
+    uint32_t first;
+
+    offset = index & ring->mask;
+    first  = ring->mask + 1 - offset;
+    first  = count < first ? count : first;
+
+    memcpy(ring->slots + ((size_t)offset * ring->element_size), elements, (size_t)first * ring->element_size);
+    memcpy(ring->slots, elements + ((size_t)first * ring->element_size), (size_t)(count - first) * ring->element_size);
+}
+
+static void copy_out(const struct spsc_ring *ring, uint32_t index, uint8_t *elements, uint32_t count)
+{
+    uint32_t offset;
+    uint32_t first;
+
+    offset = index & ring->mask;
+    first  = ring->mask + 1 - offset;
+    first  = count < first ? count : first;
+
+    memcpy(elements, ring->slots + ((size_t)offset * ring->element_size), (size_t)first * ring->element_size);
+    memcpy(elements + ((size_t)first * ring->element_size), ring->slots, (size_t)(count - first) * ring->element_size);
+}
@@ -0,0 +1,188 @@
+#include "../include/staged_worker.h"
+
+static void *staged_worker_run(void *arg);
+static void  staged_worker_drain(struct staged_worker *worker);
+static void  staged_worker_publish(const struct p101_env *env, struct staged_worker *worker);
+
+void staged_worker_start(const struct p101_env *env, struct p101_error *err, struct staged_worker *worker, uint32_t index, uint32_t capacity, size_t item_size, const struct staged_worker_ops *ops, void *arg)
+{
+    P101_TRACE(env);
+
+    memset(worker, 0, sizeof(*worker));
+    worker->index     = index;
+    worker->item_size = item_size;
+    worker->env       = env;
+    worker->ops       = ops;
+    worker->arg       = arg;
+    atomic_init(&worker->running, true);
+
+    // Separate blocks, the producer and the worker each write their own
+    worker->staged = (uint8_t *)malloc(STAGED_WORKER_BATCH * item_size);
+    worker->batch  = (uint8_t *)malloc(STAGED_WORKER_BATCH * item_size);
+    if(worker->staged == NULL || worker->batch == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "worker batch allocation failed", EXIT_FAILURE);
+        goto free_batches;
+    }
+
+    spsc_ring_create(env, err, &worker->ring, capacity, item_size);
+    if(p101_error_has_error(err))
+    {
+        goto free_batches;
+    }
+
+    if(sem_init(&worker->wakeup, 0, 0) == -1)
+    {
+        P101_ERROR_RAISE_USER(err, "sem_init failed", EXIT_FAILURE);
+        goto destroy_ring;
+    }
+
+    if(pthread_create(&worker->thread, NULL, staged_worker_run, worker) != 0)
+    {
+        P101_ERROR_RAISE_USER(err, "worker thread creation failed", EXIT_FAILURE);
+        goto destroy_semaphore;
+    }
+
+    goto done;
+
+destroy_semaphore:
+    sem_destroy(&worker->wakeup);
+
+destroy_ring:
+    spsc_ring_destroy(env, &worker->ring);
+
+free_batches:
+    free(worker->staged);
+    free(worker->batch);
+    worker->staged = NULL;
+    worker->batch  = NULL;
+    atomic_store(&worker->running, false);
+
+done:
+    return;
+}
+
+void staged_worker_post(const struct p101_env *env, struct staged_worker *worker, const void *item)
+{
+    P101_TRACE(env);
+
+    memcpy(worker->staged + (worker->staged_count * worker->item_size), item, worker->item_size);
+    worker->staged_count++;
+    if(worker->staged_count == STAGED_WORKER_BATCH)
+    {
+        staged_worker_publish(env, worker);
+    }
+
+    worker->wake_pending = true;
+}
+
+void staged_worker_wake(const struct p101_env *env, struct staged_worker *worker)
+{
+    P101_TRACE(env);
+
+    staged_worker_publish(env, worker);
+    if(worker->wake_pending)
+    {
+        worker->wake_pending = false;
+        sem_post(&worker->wakeup);
+    }
+}
+
+// Only once the producer has stopped, so nothing can be staged behind the final drain
+void staged_worker_stop(const struct p101_env *env, struct staged_worker *worker)
+{
+    P101_TRACE(env);
+
+    if(!atomic_load(&worker->running))
+    {
+        return;
+    }
+
+    // Whatever is still staged has to reach the worker before it is told to finish
+    staged_worker_publish(env, worker);
+    atomic_store(&worker->running, false);
+
+    sem_post(&worker->wakeup);
+    pthread_join(worker->thread, NULL);
+    sem_destroy(&worker->wakeup);
+    spsc_ring_destroy(env, &worker->ring);
+    free(worker->staged);
+    free(worker->batch);
+    worker->staged = NULL;
+    worker->batch  = NULL;
+}
+
+static void *staged_worker_run(void *arg)
+{
+    struct staged_worker *worker;
+    bool                  blocked;
+
+    worker  = (struct staged_worker *)arg;
+    blocked = false;
+
+    while(atomic_load(&worker->running))
+    {
+        if(blocked)
+        {
+            struct timespec deadline;
+
+            // Sends are waiting on socket buffer space, come back soon even if no new items arrive
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += STAGED_WORKER_RETRY_NS;
+            if(deadline.tv_nsec >= NANOSECONDS_PER_SECOND)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= NANOSECONDS_PER_SECOND;
+            }
+            sem_timedwait(&worker->wakeup, &deadline);
+        }
+        else
+        {
+            sem_wait(&worker->wakeup);
+        }
+
+        staged_worker_drain(worker);
+        blocked = worker->ops->flush(worker->env, worker->arg, worker->index);
+    }
+
+    // Finish whatever was queued before the stop so leaves are not lost, the owner drains what is still blocked
+    staged_worker_drain(worker);
+    worker->ops->flush(worker->env, worker->arg, worker->index);
+
+    return NULL;
+}
+
+static void staged_worker_drain(struct staged_worker *worker)
+{
+    uint32_t count;
+
+    while((count = spsc_ring_pop_batch(worker->env, &worker->ring, worker->batch, STAGED_WORKER_BATCH)) > 0)
+    {
+        for(uint32_t i = 0; i < count; i++)
+        {
+            worker->ops->handle(worker->env, worker->arg, worker->index, worker->batch + (i * worker->item_size));
+        }
+        worker->items += count;
+        worker->batches++;
+    }
+}
+
+// Items carry joins, leaves and packet references that must not be lost, so a full ring pushes back on the producer instead of dropping
+static void staged_worker_publish(const struct p101_env *env, struct staged_worker *worker)
+{
+    uint32_t published;
+
+    published = 0;
+    while(published < worker->staged_count)
+    {
+        published += spsc_ring_push_batch(env, &worker->ring, worker->staged + (published * worker->item_size), worker->staged_count - published);
+        if(published < worker->staged_count)
+        {
+            worker->stalls++;
+            sem_post(&worker->wakeup);
+            sched_yield();
+        }
+    }
+
+    worker->staged_count = 0;
+}
@@ -0,0 +1,92 @@
+#include "../include/udp_offload.h"
+
+void udp_offload_enable(const struct p101_env *env, int sockfd, struct udp_offload *offload, bool enable)
+{
+    P101_TRACE(env);
+
+    offload->gso = false;
+    offload->gro = false;
+
+    if(!enable)
+    {
+        return;
+    }
+
+#if defined(UDP_SEGMENT) && defined(UDP_GRO)
+    {
+        int segment_size;
+        int on;
+
+        // A zero segment size is accepted by any kernel that knows UDP_SEGMENT and leaves plain sends unchanged
+        segment_size = 0;
+        if(setsockopt(sockfd, SOL_UDP, UDP_SEGMENT, &segment_size, sizeof(segment_size)) == 0)
+        {
+            offload->gso = true;
+        }
+        else
+        {
+            fprintf(stderr, "UDP_SEGMENT unavailable, using one sendto per datagram: %s\n", strerror(errno));
+        }
+
+        on = 1;
+        if(setsockopt(sockfd, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0)
+        {
+            offload->gro = true;
+        }
+        else
+        {
+            fprintf(stderr, "UDP_GRO unavailable, receiving one datagram per read: %s\n", strerror(errno));
+        }
+    }
+#else
+    (void)sockfd;
+    fputs("UDP GSO/GRO is not supported on this platform\n", stderr);
+#endif
+
+    printf("UDP offload: GSO %s, GRO %s\n", offload->gso ? "on" : "off", offload->gro ? "on" : "off");
+}
+
+ssize_t udp_offload_send_segments(const struct p101_env *env, struct udp_offload *offload, int sockfd, struct iovec *iov, size_t iov_count, uint16_t segment_size, const struct sockaddr *addr, socklen_t addrlen)
+{
+    struct msghdr msg;
+
+    union
+    {
+        char           buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    } control;
+
+    P101_TRACE(env);
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name    = (void *)(uintptr_t)addr;
+    msg.msg_namelen = addrlen;
+    msg.msg_iov     = iov;
+    msg.msg_iovlen  = iov_count;
+
+#ifdef UDP_SEGMENT
+    if(offload->gso)
+    {
+        struct cmsghdr *cmsg;
+
+        memset(&control, 0, sizeof(control));
+        msg.msg_control    = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        cmsg               = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level   = SOL_UDP;
+        cmsg->cmsg_type    = UDP_SEGMENT;
+        cmsg->cmsg_len     = CMSG_LEN(sizeof(segment_size));
+        memcpy(CMSG_DATA(cmsg), &segment_size, sizeof(segment_size));
+    }
+#else
+    (void)segment_size;
+#endif
+
+    return sendmsg(sockfd, &msg, MSG_DONTWAIT);
+}
+
+bool udp_offload_send_unsupported(int error_number)
+{
+    // EIO comes back when the egress device cannot segment, the others when the kernel rejects the request
+    return error_number == EIO || error_number == EINVAL || error_number == ENOPROTOOPT || error_number == EOPNOTSUPP;
+}
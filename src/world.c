@@ -0,0 +1,139 @@
+#include "../include/world.h"
+
+static int find_chunk(const struct chunk_table *table, uint32_t column, uint32_t row);
+
+// Records a player on (x, y), loading the chunk if nobody was in it. Cells outside the world are
+// not recorded. Returns false if the cell was not recorded.
+bool chunk_table_enter(const struct p101_env *env, struct chunk_table *table, uint32_t x, uint32_t y)
+{
+    struct world_chunk *chunk;
+    int                 slot;
+
+    P101_TRACE(env);
+
+    if(x >= WORLD_COLUMNS || y >= WORLD_ROWS)
+    {
+        return false;
+    }
+
+    slot = find_chunk(table, x / WORLD_CHUNK_COLUMNS, y / WORLD_CHUNK_ROWS);
+    if(slot == -1)
+    {
+        if(table->loaded == CHUNK_TABLE_SLOTS)
+        {
+            return false;
+        }
+
+        chunk = (struct world_chunk *)aligned_alloc(alignof(struct world_chunk), sizeof(struct world_chunk));
+        if(chunk == NULL)
+        {
+            return false;
+        }
+
+        occupancy_clear_all(env, &chunk->occupancy);
+        chunk->column     = x / WORLD_CHUNK_COLUMNS;
+        chunk->row        = y / WORLD_CHUNK_ROWS;
+        chunk->population = 0;
+        slot              = (int)table->loaded;
+        table->chunks[table->loaded++] = chunk;
+        table->loads++;
+    }
+
+    chunk = table->chunks[slot];
+    chunk->population++;
+    occupancy_set(env, &chunk->occupancy, x % WORLD_CHUNK_COLUMNS, y % WORLD_CHUNK_ROWS);
+
+    return true;
+}
+
+// Undoes one chunk_table_enter. The cell's bit is only cleared when the caller knows nobody else
+// stands there, the chunk goes once its last player has left.
+void chunk_table_leave(const struct p101_env *env, struct chunk_table *table, uint32_t x, uint32_t y, bool clear_cell)
+{
+    struct world_chunk *chunk;
+    int                 slot;
+
+    P101_TRACE(env);
+
+    if(x >= WORLD_COLUMNS || y >= WORLD_ROWS)
+    {
+        return;
+    }
+
+    slot = find_chunk(table, x / WORLD_CHUNK_COLUMNS, y / WORLD_CHUNK_ROWS);
+    if(slot == -1)
+    {
+        return;
+    }
+
+    chunk = table->chunks[slot];
+    if(clear_cell)
+    {
+        occupancy_clear(env, &chunk->occupancy, x % WORLD_CHUNK_COLUMNS, y % WORLD_CHUNK_ROWS);
+    }
+
+    chunk->population--;
+    if(chunk->population == 0)
+    {
+        free(chunk);
+        table->chunks[slot] = table->chunks[--table->loaded];
+        table->unloads++;
+    }
+}
+
+// Cells in chunks nobody stands in are empty by definition, so an unloaded chunk is never loaded to answer this
+bool chunk_table_occupied(const struct p101_env *env, const struct chunk_table *table, uint32_t x, uint32_t y)
+{
+    int slot;
+
+    P101_TRACE(env);
+
+    if(x >= WORLD_COLUMNS || y >= WORLD_ROWS)
+    {
+        return false;
+    }
+
+    slot = find_chunk(table, x / WORLD_CHUNK_COLUMNS, y / WORLD_CHUNK_ROWS);
+    return slot != -1 && occupancy_test(env, &table->chunks[slot]->occupancy, x % WORLD_CHUNK_COLUMNS, y % WORLD_CHUNK_ROWS);
+}
+
+uint32_t chunk_table_count(const struct p101_env *env, const struct chunk_table *table)
+{
+    uint32_t total;
+
+    P101_TRACE(env);
+
+    total = 0;
+    for(uint32_t i = 0; i < table->loaded; i++)
+    {
+        total += occupancy_count(env, &table->chunks[i]->occupancy);
+    }
+
+    return total;
+}
+
+void chunk_table_clear(const struct p101_env *env, struct chunk_table *table)
+{
+    P101_TRACE(env);
+
+    for(uint32_t i = 0; i < table->loaded; i++)
+    {
+        free(table->chunks[i]);
+    }
+    table->unloads += table->loaded;
+    table->loaded = 0;
+}
+
+// At most one chunk per member is loaded, so a scan beats keeping a map from chunk to slot
+static int find_chunk(const struct chunk_table *table, uint32_t column, uint32_t row)
+{
+    for(uint32_t i = 0; i < table->loaded; i++)
+    {
+        if(table->chunks[i]->column == column && table->chunks[i]->row == row)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
@@ -0,0 +1,232 @@
+#include "../include/zone.h"
+
+#define NODE_ENTRY_SIZE (INET_ADDRSTRLEN + 1 + PORT_SIZE + 1)    // "ip:port" plus the terminator
+
+static uint32_t zone_start(const struct zone_cluster *cluster, uint32_t zone);
+static void     parse_node(const struct p101_env *env, struct p101_error *err, struct sockaddr_in *node, const char *entry, size_t length);
+
+void zone_cluster_init(const struct p101_env *env, struct p101_error *err, struct zone_cluster *cluster, const char *nodes_str, uint32_t self)
+{
+    const char *entry;
+
+    P101_TRACE(env);
+
+    memset(cluster, 0, sizeof(*cluster));
+    entry = nodes_str;
+
+    // Comma separated "ip:port" list, the position in the list is the zone number
+    while(*entry != '\0')
+    {
+        size_t length;
+
+        if(cluster->count == MAX_ZONES)
+        {
+            P101_ERROR_RAISE_USER(err, "Too many zone nodes", EXIT_FAILURE);
+            goto done;
+        }
+
+        length = strcspn(entry, ",");
+        parse_node(env, err, &cluster->nodes[cluster->count], entry, length);
+        if(p101_error_has_error(err))
+        {
+            goto done;
+        }
+        cluster->count++;
+
+        entry += length;
+        if(*entry == ',')
+        {
+            entry++;
+        }
+    }
+
+    if(self >= cluster->count)
+    {
+        P101_ERROR_RAISE_USER(err, "Zone number is not in the node list", EXIT_FAILURE);
+        goto done;
+    }
+
+    cluster->self = self;
+    printf("Zone %u of %u, owns columns %u to %u\n", self, cluster->count, zone_start(cluster, self), zone_start(cluster, self + 1) - 1);
+
+done:
+    return;
+}
+
+uint32_t zone_owner(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t x)
+{
+    uint32_t zone;
+
+    P101_TRACE(env);
+
+    zone = (uint32_t)(((uint64_t)x * cluster->count) / ZONE_WORLD_WIDTH);
+
+    // Anything past the right edge still belongs to someone, the last zone takes it
+    if(zone >= cluster->count)
+    {
+        zone = cluster->count - 1;
+    }
+
+    return zone;
+}
+
+uint32_t zone_find_node(const struct p101_env *env, const struct zone_cluster *cluster, const struct sockaddr_in *addr)
+{
+    P101_TRACE(env);
+
+    for(uint32_t i = 0; i < cluster->count; i++)
+    {
+        if(cluster->nodes[i].sin_addr.s_addr == addr->sin_addr.s_addr && cluster->nodes[i].sin_port == addr->sin_port)
+        {
+            return i;
+        }
+    }
+
+    return ZONE_NONE;
+}
+
+// True if x, a column this node owns, is close enough to the neighbour's side that its players should see it
+bool zone_near_border(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t x, uint32_t neighbour)
+{
+    P101_TRACE(env);
+
+    if(neighbour > cluster->self)
+    {
+        return x + ZONE_BORDER_WIDTH >= zone_start(cluster, neighbour);
+    }
+
+    return x < zone_start(cluster, cluster->self) + ZONE_BORDER_WIDTH;
+}
+
+bool zone_decode(const struct p101_env *env, struct zone_message *message, const uint8_t *data, size_t length)
+{
+    uint32_t net_magic;
+    uint32_t net_type;
+    uint16_t net_port;
+
+    P101_TRACE(env);
+
+    if(length < ZONE_MESSAGE_SIZE)
+    {
+        return false;
+    }
+
+    memcpy(&net_magic, data, sizeof(net_magic));
+    memcpy(&net_type, data + sizeof(uint32_t), sizeof(net_type));
+    if(ntohl(net_magic) != ZONE_MESSAGE_MAGIC)
+    {
+        return false;
+    }
+
+    // The client address is copied as is, it is already in network byte order on both ends
+    memset(&message->client, 0, sizeof(message->client));
+    message->client.sin_family = AF_INET;
+    memcpy(&message->client.sin_addr.s_addr, data + 2 * sizeof(uint32_t), sizeof(message->client.sin_addr.s_addr));
+    memcpy(&net_port, data + 3 * sizeof(uint32_t), sizeof(net_port));
+    message->client.sin_port = net_port;
+    message->type            = (enum zone_message_type)ntohl(net_type);
+    message->packet          = data + ZONE_MESSAGE_HEADER_SIZE;
+
+    return message->type >= ZONE_MESSAGE_FORWARD && message->type <= ZONE_MESSAGE_CLAIM;
+}
+
+// buffer holds ZONE_MESSAGE_SIZE bytes
+void zone_write_message(const struct p101_env *env, enum zone_message_type type, const struct sockaddr_in *client, const uint8_t *packet, uint8_t *buffer)
+{
+    uint32_t net_magic;
+    uint32_t net_type;
+
+    P101_TRACE(env);
+
+    net_magic = htonl(ZONE_MESSAGE_MAGIC);
+    net_type  = htonl((uint32_t)type);
+    memset(buffer, 0, ZONE_MESSAGE_SIZE);
+    memcpy(buffer, &net_magic, sizeof(net_magic));
+    memcpy(buffer + sizeof(uint32_t), &net_type, sizeof(net_type));
+    if(client != NULL)
+    {
+        memcpy(buffer + 2 * sizeof(uint32_t), &client->sin_addr.s_addr, sizeof(client->sin_addr.s_addr));
+        memcpy(buffer + 3 * sizeof(uint32_t), &client->sin_port, sizeof(client->sin_port));
+    }
+    memcpy(buffer + ZONE_MESSAGE_HEADER_SIZE, packet, POSITION_PACKET_SIZE);
+}
+
+// Tells a client which server owns it now, as a position packet the client recognises by its coordinates.
+// buffer holds POSITION_PACKET_SIZE bytes.
+void zone_write_redirect(const struct p101_env *env, const struct zone_cluster *cluster, uint32_t zone, uint8_t *buffer)
+{
+    struct packet_header header;
+    struct coordinates   coordinates;
+
+    P101_TRACE(env);
+
+    memset(&header, 0, sizeof(header));
+    coordinates.old_x = ntohl(cluster->nodes[zone].sin_addr.s_addr);
+    coordinates.old_y = ntohs(cluster->nodes[zone].sin_port);
+    coordinates.new_x = REDIRECT_COORDINATE;
+    coordinates.new_y = REDIRECT_COORDINATE;
+    serialize_header_to_buffer(env, &header, buffer);
+    serialize_position_to_buffer(env, &coordinates, buffer + PACKET_HEADER_SIZE);
+}
+
+void zone_cluster_print_stats(const struct p101_env *env, const struct zone_cluster *cluster)
+{
+    P101_TRACE(env);
+
+    if(cluster->count == 0)
+    {
+        return;
+    }
+
+    printf("Zone %u: %" PRIu64 " handoffs out, %" PRIu64 " handoffs in, %" PRIu64 " forwarded, %" PRIu64 " ghosts out, %" PRIu64 " ghosts in, %" PRIu64 " redirects, %" PRIu64 " send failures\n", cluster->self, cluster->handoffs_out, cluster->handoffs_in, cluster->forwarded, cluster->ghosts_out, cluster->ghosts_in, cluster->redirects, cluster->send_failures);
+}
+
+// First column of a zone, the same rounding zone_owner uses so the two always agree
+static uint32_t zone_start(const struct zone_cluster *cluster, uint32_t zone)
+{
+    return (uint32_t)(((uint64_t)zone * ZONE_WORLD_WIDTH + cluster->count - 1) / cluster->count);
+}
+
+static void parse_node(const struct p101_env *env, struct p101_error *err, struct sockaddr_in *node, const char *entry, size_t length)
+{
+    char      buffer[NODE_ENTRY_SIZE];
+    char     *colon;
+    in_port_t port;
+
+    P101_TRACE(env);
+
+    if(length == 0 || length >= sizeof(buffer))
+    {
+        P101_ERROR_RAISE_USER(err, "Zone node must be <ip_address>:<port>", EXIT_FAILURE);
+        goto done;
+    }
+
+    memcpy(buffer, entry, length);
+    buffer[length] = '\0';
+    colon          = strrchr(buffer, ':');
+    if(colon == NULL)
+    {
+        P101_ERROR_RAISE_USER(err, "Zone node must be <ip_address>:<port>", EXIT_FAILURE);
+        goto done;
+    }
+    *colon = '\0';
+
+    port = parse_in_port_t(env, err, colon + 1);
+    if(p101_error_has_error(err))
+    {
+        goto done;
+    }
+
+    // Clients are tracked by IPv4 address, so the cluster is IPv4 only as well
+    memset(node, 0, sizeof(*node));
+    if(inet_pton(AF_INET, buffer, &node->sin_addr) != 1)
+    {
+        P101_ERROR_RAISE_USER(err, "Zone node address is not an IPv4 address", EXIT_FAILURE);
+        goto done;
+    }
+    node->sin_family = AF_INET;
+    node->sin_port   = htons(port);
+
+done:
+    return;
+}